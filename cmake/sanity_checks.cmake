@@ -17,6 +17,12 @@ check_function_exists(malloc_trim HAVE_MALLOC_TRIM)
 check_function_exists(memrchr HAVE_MEMRCHR)
 check_function_exists(sigaction HAVE_SIGACTION)
 
+# shm_open lives in librt on older glibc
+check_library_exists(rt shm_open "" HAVE_LIBRT)
+if (HAVE_LIBRT)
+    set(RT_LIBRARIES rt)
+endif()
+
 #--------------------------------------------------------------------------
 # Checks for typedefs, structures, and compiler characteristics.
 #--------------------------------------------------------------------------
@@ -95,6 +101,7 @@ endif()
 # set library variables
 if (HS_FOUND)
     check_library_exists (${HS_LIBRARIES} hs_scan "" HAVE_HYPERSCAN)
+    check_library_exists (${HS_LIBRARIES} hs_compress_stream "" HAVE_HS_COMPRESS_STREAM)
 endif()
 
 if (DEFINED LIBLZMA_LIBRARIES)
@@ -26,11 +26,13 @@
 #include "managers/plugin_manager.h"
 
 extern const snort::BaseApi* file_connector[];
+extern const snort::BaseApi* shm_connector[];
 extern const snort::BaseApi* tcp_connector[];
 
 void load_connectors()
 {
     PluginManager::load_plugins(file_connector);
+    PluginManager::load_plugins(shm_connector);
     PluginManager::load_plugins(tcp_connector);
 }
 
@@ -0,0 +1,453 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// shm_connector.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "shm_connector.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <thread>
+
+#include "log/messages.h"
+#include "main/thread.h"
+#include "profiler/profiler_defs.h"
+
+#include "shm_connector_module.h"
+
+using namespace snort;
+
+/* Globals ****************************************************************/
+
+THREAD_LOCAL ShmConnectorStats shm_connector_stats;
+THREAD_LOCAL ProfileStats shm_connector_perfstats;
+
+#define SHM_MAGIC 0x534d5243  // "SMRC"
+#define SHM_HDR_SIZE 64
+#define SHM_WAIT_MSEC 1000
+
+struct ShmRegionHdr
+{
+    std::atomic<uint32_t> magic;  // set last by the creator
+    uint32_t version;
+    uint32_t ring_size;
+};
+
+//-------------------------------------------------------------------------
+// futex
+//-------------------------------------------------------------------------
+
+static void wait_for_change(std::atomic<uint32_t>* word, uint32_t val)
+{
+#ifdef __linux__
+    // not FUTEX_PRIVATE, the word is shared with the partner process
+    struct timespec ts = { SHM_WAIT_MSEC / 1000, (SHM_WAIT_MSEC % 1000) * 1000000 };
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, val, &ts, nullptr, 0);
+#else
+    if ( word->load() == val )
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+}
+
+static void wake_all(std::atomic<uint32_t>* word)
+{
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    UNUSED(word);
+#endif
+}
+
+//-------------------------------------------------------------------------
+// ring access; sizes are powers of 2 so positions just wrap
+//-------------------------------------------------------------------------
+
+static void copy_in(uint8_t* ring, uint32_t size, uint32_t pos, const void* src, uint32_t len)
+{
+    uint32_t off = pos & (size - 1);
+    uint32_t first = (len < size - off) ? len : size - off;
+
+    memcpy(ring + off, src, first);
+    memcpy(ring, (const uint8_t*)src + first, len - first);
+}
+
+static void copy_out(const uint8_t* ring, uint32_t size, uint32_t pos, void* dst, uint32_t len)
+{
+    uint32_t off = pos & (size - 1);
+    uint32_t first = (len < size - off) ? len : size - off;
+
+    memcpy(dst, ring + off, first);
+    memcpy((uint8_t*)dst + first, ring, len - first);
+}
+
+//-------------------------------------------------------------------------
+// class stuff
+//-------------------------------------------------------------------------
+
+ShmConnectorMsgHandle::ShmConnectorMsgHandle(const uint32_t length)
+{
+    connector_msg.length = length;
+    connector_msg.data = new uint8_t[length];
+}
+
+ShmConnectorMsgHandle::~ShmConnectorMsgHandle()
+{
+    delete[] connector_msg.data;
+}
+
+ShmConnectorCommon::ShmConnectorCommon(ShmConnectorConfig::ShmConnectorConfigSet* conf)
+{
+    config_set = (ConnectorConfig::ConfigSet*)conf;
+}
+
+ShmConnectorCommon::~ShmConnectorCommon()
+{
+    for ( auto conf : *config_set )
+        delete conf;
+
+    config_set->clear();
+    delete config_set;
+}
+
+size_t ShmConnector::get_region_size(uint32_t ring_size)
+{ return SHM_HDR_SIZE + 2 * sizeof(ShmRing) + 2 * (size_t)ring_size; }
+
+ShmConnector::ShmConnector(ShmConnectorConfig* cfg, const std::string& name, uint8_t* base,
+    size_t size, bool create) : shm_name(name)
+{
+    config = cfg;
+    region = base;
+    region_size = size;
+    owner = create;
+
+    ring_size = ((ShmRegionHdr*)region)->ring_size;
+
+    ShmRing* rings = (ShmRing*)(region + SHM_HDR_SIZE);
+    uint8_t* data = (uint8_t*)(rings + 2);
+
+    // the creator transmits on ring 0 and the partner on ring 1
+    unsigned t = owner ? 0 : 1;
+
+    tx = rings + t;
+    tx_data = data + t * ring_size;
+    rx = rings + (t ^ 1);
+    rx_data = data + (t ^ 1) * ring_size;
+}
+
+ShmConnector::~ShmConnector()
+{
+    munmap(region, region_size);
+
+    if ( owner )
+        shm_unlink(shm_name.c_str());
+}
+
+bool ShmConnector::write(const uint8_t* data, uint32_t len)
+{
+    uint32_t head = tx->head.load(std::memory_order_relaxed);
+    uint32_t tail = tx->tail.load(std::memory_order_acquire);
+    uint32_t need = sizeof(len) + len;
+
+    if ( need > ring_size - (head - tail) )
+        return false;
+
+    copy_in(tx_data, ring_size, head, &len, sizeof(len));
+    copy_in(tx_data, ring_size, head + sizeof(len), data, len);
+
+    tx->head.store(head + need, std::memory_order_release);
+    tx->seq++;
+
+    // the syscall is only paid when the consumer is actually asleep
+    if ( tx->waiters.load() )
+        wake_all(&tx->seq);
+
+    return true;
+}
+
+ShmConnectorMsgHandle* ShmConnector::read()
+{
+    uint32_t tail = rx->tail.load(std::memory_order_relaxed);
+    uint32_t head = rx->head.load(std::memory_order_acquire);
+
+    if ( head == tail )
+        return nullptr;
+
+    uint32_t len;
+    copy_out(rx_data, ring_size, tail, &len, sizeof(len));
+
+    if ( len > head - tail - sizeof(len) )
+    {
+        ErrorMessage("ShmConnector: bad message length %u on %s\n", len, shm_name.c_str());
+        rx->tail.store(head, std::memory_order_release);
+        return nullptr;
+    }
+
+    ShmConnectorMsgHandle* handle = new ShmConnectorMsgHandle(len);
+    copy_out(rx_data, ring_size, tail + sizeof(len), handle->connector_msg.data, len);
+
+    rx->tail.store(tail + sizeof(len) + len, std::memory_order_release);
+    return handle;
+}
+
+ConnectorMsgHandle* ShmConnector::alloc_message(const uint32_t length, const uint8_t** data)
+{
+    ShmConnectorMsgHandle* msg = new ShmConnectorMsgHandle(length);
+
+    *data = (uint8_t*)msg->connector_msg.data;
+
+    return msg;
+}
+
+void ShmConnector::discard_message(ConnectorMsgHandle* msg)
+{
+    ShmConnectorMsgHandle* smsg = (ShmConnectorMsgHandle*)msg;
+    delete smsg;
+}
+
+bool ShmConnector::transmit_message(ConnectorMsgHandle* msg)
+{
+    ShmConnectorMsgHandle* smsg = (ShmConnectorMsgHandle*)msg;
+    bool ok = write(smsg->connector_msg.data, smsg->connector_msg.length);
+
+    if ( ok )
+        shm_connector_stats.transmits++;
+    else
+        shm_connector_stats.overruns++;
+
+    delete smsg;
+    return ok;
+}
+
+ConnectorMsgHandle* ShmConnector::receive_message(bool block)
+{
+    // sample the futex word first so a write after the check wakes us
+    uint32_t seq = rx->seq.load();
+    ShmConnectorMsgHandle* handle = read();
+
+    if ( !handle and block )
+    {
+        rx->waiters++;
+
+        if ( !(handle = read()) )
+        {
+            shm_connector_stats.waits++;
+            wait_for_change(&rx->seq, seq);
+            handle = read();
+        }
+        rx->waiters--;
+    }
+
+    if ( handle )
+        shm_connector_stats.receives++;
+
+    return handle;
+}
+
+//-------------------------------------------------------------------------
+// api stuff
+//-------------------------------------------------------------------------
+
+static Module* mod_ctor()
+{
+    return new ShmConnectorModule;
+}
+
+static void mod_dtor(Module* m)
+{
+    delete m;
+}
+
+static uint8_t* map_region(int fd, size_t size)
+{
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if ( p == MAP_FAILED )
+    {
+        ErrorMessage("mmap() failure: %s\n", strerror(errno));
+        return nullptr;
+    }
+    return (uint8_t*)p;
+}
+
+static ShmConnector* shm_connector_tinit_create(ShmConnectorConfig* cfg, const std::string& name)
+{
+    uint32_t ring_size = 1;
+
+    while ( ring_size < cfg->ring_size )
+        ring_size <<= 1;
+
+    size_t size = ShmConnector::get_region_size(ring_size);
+
+    // a crashed partner may have left the object behind
+    shm_unlink(name.c_str());
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+    if ( fd < 0 )
+    {
+        ErrorMessage("shm_open(%s) failure: %s\n", name.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    if ( ftruncate(fd, size) < 0 )
+    {
+        ErrorMessage("ftruncate(%s) failure: %s\n", name.c_str(), strerror(errno));
+        close(fd);
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    uint8_t* region = map_region(fd, size);
+
+    if ( !region )
+    {
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    // the new object is zero filled so the rings start out empty
+    ShmRegionHdr* hdr = (ShmRegionHdr*)region;
+    hdr->version = SHM_FORMAT_VERSION;
+    hdr->ring_size = ring_size;
+    hdr->magic.store(SHM_MAGIC, std::memory_order_release);
+
+    return new ShmConnector(cfg, name, region, size, true);
+}
+
+static ShmConnector* shm_connector_tinit_attach(ShmConnectorConfig* cfg, const std::string& name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+
+    if ( fd < 0 )
+    {
+        ErrorMessage("shm_open(%s) failure: %s\n", name.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    struct stat st;
+
+    if ( fstat(fd, &st) < 0 or (size_t)st.st_size < SHM_HDR_SIZE )
+    {
+        ErrorMessage("shm_connector: %s is not ready\n", name.c_str());
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = st.st_size;
+    uint8_t* region = map_region(fd, size);
+
+    if ( !region )
+        return nullptr;
+
+    ShmRegionHdr* hdr = (ShmRegionHdr*)region;
+
+    if ( hdr->magic.load(std::memory_order_acquire) != SHM_MAGIC or
+        hdr->version != SHM_FORMAT_VERSION or
+        ShmConnector::get_region_size(hdr->ring_size) != size )
+    {
+        ErrorMessage("shm_connector: %s has an invalid header\n", name.c_str());
+        munmap(region, size);
+        return nullptr;
+    }
+
+    return new ShmConnector(cfg, name, region, size, false);
+}
+
+// Create a per-thread object
+static Connector* shm_connector_tinit(ConnectorConfig* config)
+{
+    ShmConnectorConfig* cfg = (ShmConnectorConfig*)config;
+    std::string name = "/snort_shm_" + cfg->name + "_" + std::to_string(get_instance_id());
+
+    if ( cfg->setup == ShmConnectorConfig::Setup::CREATE )
+        return shm_connector_tinit_create(cfg, name);
+
+    return shm_connector_tinit_attach(cfg, name);
+}
+
+static void shm_connector_tterm(Connector* connector)
+{
+    ShmConnector* shm_connector = (ShmConnector*)connector;
+
+    delete shm_connector;
+}
+
+static ConnectorCommon* shm_connector_ctor(Module* m)
+{
+    ShmConnectorModule* mod = (ShmConnectorModule*)m;
+    ShmConnectorCommon* shm_connector_common = new ShmConnectorCommon(
+        mod->get_and_clear_config());
+
+    return shm_connector_common;
+}
+
+static void shm_connector_dtor(ConnectorCommon* c)
+{
+    ShmConnectorCommon* sc = (ShmConnectorCommon*)c;
+    delete sc;
+}
+
+const ConnectorApi shm_connector_api =
+{
+    {
+        PT_CONNECTOR,
+        sizeof(ConnectorApi),
+        CONNECTOR_API_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        SHM_CONNECTOR_NAME,
+        SHM_CONNECTOR_HELP,
+        mod_ctor,
+        mod_dtor
+    },
+    0,
+    nullptr,
+    nullptr,
+    shm_connector_tinit,
+    shm_connector_tterm,
+    shm_connector_ctor,
+    shm_connector_dtor
+};
+
+#ifdef BUILDING_SO
+SO_PUBLIC const BaseApi* snort_plugins[] =
+#else
+const BaseApi* shm_connector[] =
+#endif
+{
+    &shm_connector_api.base,
+    nullptr
+};
+
@@ -0,0 +1,100 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// shm_connector.h
+
+#ifndef SHM_CONNECTOR_H
+#define SHM_CONNECTOR_H
+
+// ShmConnector is a duplex connector for partners on the same host.  One
+// side creates a shared memory object holding two single producer, single
+// consumer byte rings, one per direction, and the other side attaches to it.
+// Messages are copied into the ring as a 32 bit length followed by the data.
+// A blocking receive sleeps on a futex that the producer only wakes when
+// someone is waiting.
+
+#include <atomic>
+#include <string>
+
+#include "framework/connector.h"
+
+#include "shm_connector_config.h"
+
+#define SHM_FORMAT_VERSION (1)
+
+// lives in shared memory; the indices are free running byte counts
+struct ShmRing
+{
+    alignas(64) std::atomic<uint32_t> head;  // written by the producer
+    alignas(64) std::atomic<uint32_t> tail;  // written by the consumer
+    alignas(64) std::atomic<uint32_t> seq;   // futex word, bumped on every write
+    std::atomic<uint32_t> waiters;
+};
+
+class ShmConnectorMsgHandle : public snort::ConnectorMsgHandle
+{
+public:
+    ShmConnectorMsgHandle(const uint32_t length);
+    ~ShmConnectorMsgHandle();
+    snort::ConnectorMsg connector_msg;
+};
+
+class ShmConnectorCommon : public snort::ConnectorCommon
+{
+public:
+    ShmConnectorCommon(ShmConnectorConfig::ShmConnectorConfigSet*);
+    ~ShmConnectorCommon();
+};
+
+class ShmConnector : public snort::Connector
+{
+public:
+    ShmConnector(ShmConnectorConfig*, const std::string& shm_name, uint8_t* region,
+        size_t region_size, bool owner);
+    ~ShmConnector() override;
+
+    snort::ConnectorMsgHandle* alloc_message(const uint32_t, const uint8_t**) override;
+    void discard_message(snort::ConnectorMsgHandle*) override;
+    bool transmit_message(snort::ConnectorMsgHandle*) override;
+    snort::ConnectorMsgHandle* receive_message(bool) override;
+
+    snort::ConnectorMsg* get_connector_msg(snort::ConnectorMsgHandle* handle) override
+    { return( &((ShmConnectorMsgHandle*)handle)->connector_msg ); }
+    Direction get_connector_direction() override
+    { return Connector::CONN_DUPLEX; }
+
+    bool write(const uint8_t*, uint32_t);
+    ShmConnectorMsgHandle* read();
+
+    static size_t get_region_size(uint32_t ring_size);
+
+private:
+    std::string shm_name;
+    uint8_t* region;
+    size_t region_size;
+    bool owner;
+
+    uint32_t ring_size;
+    ShmRing* tx;
+    uint8_t* tx_data;
+    ShmRing* rx;
+    uint8_t* rx_data;
+};
+
+#endif
+
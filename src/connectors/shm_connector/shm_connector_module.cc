@@ -0,0 +1,133 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// shm_connector_module.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "shm_connector_module.h"
+
+using namespace snort;
+
+static const Parameter shm_connector_params[] =
+{
+    { "connector", Parameter::PT_STRING, nullptr, nullptr,
+      "connector name" },
+
+    { "name", Parameter::PT_STRING, nullptr, nullptr,
+      "used to construct the shared memory object name" },
+
+    { "setup", Parameter::PT_ENUM, "create | attach", "create",
+      "create the shared memory object or attach to one created by the partner" },
+
+    { "ring_size", Parameter::PT_INT, "4096:1073741824", "1048576",
+      "bytes per direction, rounded up to a power of 2" },
+
+    { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
+};
+
+static const PegInfo shm_connector_pegs[] =
+{
+    { CountType::SUM, "transmits", "messages written to the ring" },
+    { CountType::SUM, "receives", "messages read from the ring" },
+    { CountType::SUM, "overruns", "messages dropped because the ring was full" },
+    { CountType::SUM, "waits", "times a blocking receive slept on an empty ring" },
+    { CountType::END, nullptr, nullptr }
+};
+
+extern THREAD_LOCAL ShmConnectorStats shm_connector_stats;
+extern THREAD_LOCAL ProfileStats shm_connector_perfstats;
+
+//-------------------------------------------------------------------------
+// shm_connector module
+//-------------------------------------------------------------------------
+
+ShmConnectorModule::ShmConnectorModule() :
+    Module(SHM_CONNECTOR_NAME, SHM_CONNECTOR_HELP, shm_connector_params)
+{
+    config = nullptr;
+    config_set = new ShmConnectorConfig::ShmConnectorConfigSet;
+}
+
+ShmConnectorModule::~ShmConnectorModule()
+{
+    if ( config )
+        delete config;
+    if ( config_set )
+        delete config_set;
+}
+
+ProfileStats* ShmConnectorModule::get_profile() const
+{ return &shm_connector_perfstats; }
+
+bool ShmConnectorModule::set(const char*, Value& v, SnortConfig*)
+{
+    if ( v.is("connector") )
+        config->connector_name = v.get_string();
+
+    else if ( v.is("name") )
+        config->name = v.get_string();
+
+    else if ( v.is("setup") )
+        config->setup = v.get_long() ? ShmConnectorConfig::ATTACH : ShmConnectorConfig::CREATE;
+
+    else if ( v.is("ring_size") )
+        config->ring_size = v.get_long();
+
+    else
+        return false;
+
+    return true;
+}
+
+// clear my working config and hand-over the compiled list to the caller
+ShmConnectorConfig::ShmConnectorConfigSet* ShmConnectorModule::get_and_clear_config()
+{
+    ShmConnectorConfig::ShmConnectorConfigSet* temp_config = config_set;
+    config = nullptr;
+    config_set = nullptr;
+    return temp_config;
+}
+
+bool ShmConnectorModule::begin(const char*, int, SnortConfig*)
+{
+    if ( !config )
+        config = new ShmConnectorConfig;
+
+    return true;
+}
+
+bool ShmConnectorModule::end(const char*, int idx, SnortConfig*)
+{
+    if (idx != 0)
+    {
+        config_set->push_back(config);
+        config = nullptr;
+    }
+
+    return true;
+}
+
+const PegInfo* ShmConnectorModule::get_pegs() const
+{ return shm_connector_pegs; }
+
+PegCount* ShmConnectorModule::get_counts() const
+{ return (PegCount*)&shm_connector_stats; }
+
@@ -0,0 +1,142 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// shm_connector_module_test.cc
+// unit test main
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "connectors/shm_connector/shm_connector_module.h"
+#include "profiler/profiler.h"
+
+#include "main/snort_debug.h"
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+using namespace snort;
+
+THREAD_LOCAL ShmConnectorStats shm_connector_stats;
+THREAD_LOCAL ProfileStats shm_connector_perfstats;
+
+void show_stats(PegCount*, const PegInfo*, unsigned, const char*) { }
+void show_stats(PegCount*, const PegInfo*, IndexVec&, const char*) { }
+void show_stats(PegCount*, const PegInfo*, IndexVec&, const char*, FILE*) { }
+
+namespace snort
+{
+char* snort_strdup(const char* s)
+{ return strdup(s); }
+}
+
+TEST_GROUP(shm_connector_module)
+{
+    void setup() override
+    {
+        MemoryLeakWarningPlugin::turnOffNewDeleteOverloads();
+    }
+
+    void teardown() override
+    {
+        MemoryLeakWarningPlugin::turnOnNewDeleteOverloads();
+    }
+};
+
+TEST(shm_connector_module, test_attach)
+{
+    Value connector_val("shm-a");
+    Value name_val("ha");
+    Value setup_val("attach");
+    Value ring_size_val((double)65536);
+    Parameter connector_param =
+        {"connector", Parameter::PT_STRING, nullptr, nullptr, "connector"};
+    Parameter name_param =
+        {"name", Parameter::PT_STRING, nullptr, nullptr, "name"};
+    Parameter setup_param =
+        {"setup", Parameter::PT_ENUM, "create | attach", nullptr, "setup"};
+    Parameter ring_size_param =
+        {"ring_size", Parameter::PT_INT, "4096:1073741824", nullptr, "ring_size"};
+
+    ShmConnectorModule module;
+
+    connector_val.set(&connector_param);
+    name_val.set(&name_param);
+    setup_val.set(&setup_param);
+    CHECK( setup_param.validate(setup_val) == true );
+    ring_size_val.set(&ring_size_param);
+    CHECK( ring_size_param.validate(ring_size_val) == true );
+
+    module.begin("shm_connector", 0, nullptr);
+    module.begin("shm_connector", 1, nullptr);
+    module.set("shm_connector.connector", connector_val, nullptr);
+    module.set("shm_connector.name", name_val, nullptr);
+    module.set("shm_connector.setup", setup_val, nullptr);
+    module.set("shm_connector.ring_size", ring_size_val, nullptr);
+    module.end("shm_connector", 1, nullptr);
+    module.end("shm_connector", 0, nullptr);
+
+    ShmConnectorConfig::ShmConnectorConfigSet* config_set = module.get_and_clear_config();
+
+    CHECK(config_set != nullptr);
+    CHECK(config_set->size() == 1);
+
+    ShmConnectorConfig config = *(config_set->front());
+    CHECK(config.connector_name == "shm-a");
+    CHECK(config.name == "ha");
+    CHECK(config.setup == ShmConnectorConfig::Setup::ATTACH);
+    CHECK(config.ring_size == 65536);
+    CHECK(config.direction == Connector::CONN_DUPLEX);
+
+    CHECK(module.get_pegs() != nullptr );
+    CHECK(module.get_counts() != nullptr );
+    CHECK(module.get_profile() != nullptr );
+
+    for ( auto conf : *config_set )
+        delete conf;
+
+    config_set->clear();
+    delete config_set;
+}
+
+TEST(shm_connector_module, test_defaults)
+{
+    ShmConnectorModule module;
+
+    module.begin("shm_connector", 0, nullptr);
+    module.begin("shm_connector", 1, nullptr);
+    module.end("shm_connector", 1, nullptr);
+    module.end("shm_connector", 0, nullptr);
+
+    ShmConnectorConfig::ShmConnectorConfigSet* config_set = module.get_and_clear_config();
+    CHECK(config_set->size() == 1);
+
+    ShmConnectorConfig* config = config_set->front();
+    CHECK(config->setup == ShmConnectorConfig::Setup::CREATE);
+    CHECK(config->ring_size == 1024 * 1024);
+
+    delete config;
+    delete config_set;
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
+
@@ -0,0 +1,358 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// shm_connector_test.cc
+// unit test main
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "connectors/shm_connector/shm_connector.h"
+#include "connectors/shm_connector/shm_connector_module.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "main/snort_debug.h"
+#include "main/thread.h"
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+using namespace snort;
+
+extern const BaseApi* shm_connector;
+extern THREAD_LOCAL ShmConnectorStats shm_connector_stats;
+
+static ConnectorApi* shmc_api = nullptr;
+static unsigned s_instance = 0;
+
+void show_stats(PegCount*, const PegInfo*, unsigned, const char*) { }
+void show_stats(PegCount*, const PegInfo*, IndexVec&, const char*) { }
+void show_stats(PegCount*, const PegInfo*, IndexVec&, const char*, FILE*) { }
+
+namespace snort
+{
+unsigned get_instance_id()
+{ return s_instance; }
+
+void ErrorMessage(const char*, ...) { }
+void LogMessage(const char*, ...) { }
+}
+
+ShmConnectorModule::ShmConnectorModule() :
+    Module("SHMC", "SHMC Help", nullptr)
+{ }
+
+ShmConnectorConfig::ShmConnectorConfigSet* ShmConnectorModule::get_and_clear_config()
+{
+    return new ShmConnectorConfig::ShmConnectorConfigSet;
+}
+
+ShmConnectorModule::~ShmConnectorModule() = default;
+
+ProfileStats* ShmConnectorModule::get_profile() const { return nullptr; }
+
+bool ShmConnectorModule::set(const char*, Value&, SnortConfig*) { return true; }
+bool ShmConnectorModule::begin(const char*, int, SnortConfig*) { return true; }
+bool ShmConnectorModule::end(const char*, int, SnortConfig*) { return true; }
+
+const PegInfo* ShmConnectorModule::get_pegs() const { return nullptr; }
+PegCount* ShmConnectorModule::get_counts() const { return nullptr; }
+
+static ShmConnectorConfig create_config;
+static ShmConnectorConfig attach_config;
+
+static Module* mod;
+static ConnectorCommon* connector_common;
+static Connector* creator;
+static Connector* partner;
+
+static bool send_msg(Connector* c, uint32_t len, uint8_t fill)
+{
+    const uint8_t* data;
+    ConnectorMsgHandle* h = c->alloc_message(len, &data);
+    memset((uint8_t*)data, fill, len);
+    return c->transmit_message(h);
+}
+
+static bool check_msg(Connector* c, uint32_t len, uint8_t fill, bool block = false)
+{
+    ConnectorMsgHandle* h = c->receive_message(block);
+
+    if ( !h )
+        return false;
+
+    ConnectorMsg* msg = c->get_connector_msg(h);
+    bool ok = (msg->length == len);
+
+    for ( uint32_t i = 0; ok and i < len; i++ )
+        ok = (msg->data[i] == fill);
+
+    c->discard_message(h);
+    return ok;
+}
+
+TEST_GROUP(shm_connector)
+{
+    void setup() override
+    {
+        shmc_api = (ConnectorApi*)shm_connector;
+        s_instance = getpid() & 0x7fff;
+        memset(&shm_connector_stats, 0, sizeof(shm_connector_stats));
+
+        create_config.connector_name = "shm-c";
+        create_config.name = "test";
+        create_config.setup = ShmConnectorConfig::Setup::CREATE;
+        create_config.ring_size = 4000;  // rounded up to 4096
+
+        attach_config.connector_name = "shm-a";
+        attach_config.name = "test";
+        attach_config.setup = ShmConnectorConfig::Setup::ATTACH;
+
+        mod = shm_connector->mod_ctor();
+        connector_common = shmc_api->ctor(mod);
+        creator = shmc_api->tinit(&create_config);
+        CHECK(creator != nullptr);
+        partner = shmc_api->tinit(&attach_config);
+        CHECK(partner != nullptr);
+        CHECK(partner->get_connector_direction() == Connector::CONN_DUPLEX);
+    }
+
+    void teardown() override
+    {
+        shmc_api->tterm(partner);
+        shmc_api->tterm(creator);
+        shmc_api->dtor(connector_common);
+        shm_connector->mod_dtor(mod);
+    }
+};
+
+TEST(shm_connector, duplex)
+{
+    CHECK(creator->receive_message(false) == nullptr);
+    CHECK(partner->receive_message(false) == nullptr);
+
+    CHECK(send_msg(creator, 40, 'c'));
+    CHECK(send_msg(partner, 30, 'p'));
+
+    CHECK(check_msg(partner, 40, 'c'));
+    CHECK(check_msg(creator, 30, 'p'));
+
+    CHECK(creator->receive_message(false) == nullptr);
+    CHECK(partner->receive_message(false) == nullptr);
+
+    CHECK(shm_connector_stats.transmits == 2);
+    CHECK(shm_connector_stats.receives == 2);
+}
+
+TEST(shm_connector, wrap)
+{
+    // odd sizes walk the length prefix across the end of the ring
+    for ( unsigned i = 0; i < 1000; i++ )
+    {
+        uint32_t len = 1 + (i * 37) % 700;
+        CHECK(send_msg(creator, len, (uint8_t)i));
+        CHECK(check_msg(partner, len, (uint8_t)i));
+    }
+    CHECK(send_msg(creator, 0, 0));
+    CHECK(check_msg(partner, 0, 0));
+}
+
+TEST(shm_connector, overrun)
+{
+    unsigned n = 0;
+
+    while ( send_msg(creator, 100, 'x') )
+        n++;
+
+    CHECK(n == 4096 / 104);
+    CHECK(shm_connector_stats.overruns == 1);
+    CHECK(!send_msg(creator, 4096, 'y'));
+
+    for ( unsigned i = 0; i < n; i++ )
+        CHECK(check_msg(partner, 100, 'x'));
+
+    CHECK(send_msg(creator, 100, 'z'));
+    CHECK(check_msg(partner, 100, 'z'));
+}
+
+TEST(shm_connector, attach_before_create)
+{
+    s_instance++;
+    CHECK(shmc_api->tinit(&attach_config) == nullptr);
+}
+
+TEST(shm_connector, blocking_receive)
+{
+    std::thread producer([]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        send_msg(partner, 16, 'b');
+    });
+
+    bool ok = check_msg(creator, 16, 'b', true);
+    producer.join();
+
+    // a late producer may leave the message for one more try
+    CHECK(ok or check_msg(creator, 16, 'b', true));
+}
+
+//-------------------------------------------------------------------------
+// loopback comparison against a tcp stream with tcp_connector framing
+// run with -ri to include ignored tests
+//-------------------------------------------------------------------------
+
+#define BENCH_MSGS 100000
+#define BENCH_SIZE 256
+
+static bool read_all(int fd, void* buf, size_t len)
+{
+    uint8_t* p = (uint8_t*)buf;
+
+    while ( len )
+    {
+        ssize_t n = recv(fd, p, len, 0);
+
+        if ( n <= 0 )
+            return false;
+
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool tcp_echo(int fd, uint8_t* buf)
+{
+    uint8_t hdr[3];
+
+    if ( !read_all(fd, hdr, sizeof(hdr)) or !read_all(fd, buf, BENCH_SIZE) )
+        return false;
+
+    return send(fd, hdr, sizeof(hdr), 0) == sizeof(hdr) and
+        send(fd, buf, BENCH_SIZE, 0) == BENCH_SIZE;
+}
+
+static double tcp_round_trips()
+{
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sin;
+    socklen_t slen = sizeof(sin);
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    bind(lfd, (struct sockaddr*)&sin, sizeof(sin));
+    listen(lfd, 1);
+    getsockname(lfd, (struct sockaddr*)&sin, &slen);
+
+    std::thread echo([lfd]()
+    {
+        int fd = accept(lfd, nullptr, nullptr);
+        uint8_t buf[BENCH_SIZE];
+
+        while ( tcp_echo(fd, buf) );
+        close(fd);
+    });
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    connect(fd, (struct sockaddr*)&sin, sizeof(sin));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    uint8_t hdr[3] = { 1, BENCH_SIZE & 0xff, BENCH_SIZE >> 8 };
+    uint8_t buf[BENCH_SIZE] = { };
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < BENCH_MSGS; i++ )
+    {
+        send(fd, hdr, sizeof(hdr), 0);
+        send(fd, buf, BENCH_SIZE, 0);
+        read_all(fd, hdr, sizeof(hdr));
+        read_all(fd, buf, BENCH_SIZE);
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+
+    close(fd);
+    echo.join();
+    close(lfd);
+
+    return t.count();
+}
+
+static double shm_round_trips()
+{
+    std::atomic<bool> done(false);
+
+    std::thread echo([&done]()
+    {
+        while ( !done )
+        {
+            ConnectorMsgHandle* h = partner->receive_message(true);
+
+            if ( !h )
+                continue;
+
+            ConnectorMsg* m = partner->get_connector_msg(h);
+            send_msg(partner, m->length, m->data[0]);
+            partner->discard_message(h);
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < BENCH_MSGS; i++ )
+    {
+        send_msg(creator, BENCH_SIZE, (uint8_t)i);
+        while ( !check_msg(creator, BENCH_SIZE, (uint8_t)i, true) );
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+
+    done = true;
+    send_msg(creator, 1, 0);
+    echo.join();
+
+    return t.count();
+}
+
+IGNORE_TEST(shm_connector, loopback_vs_tcp)
+{
+    double tcp = tcp_round_trips();
+    double shm = shm_round_trips();
+
+    printf("\n%u round trips of %u bytes\n", BENCH_MSGS, BENCH_SIZE);
+    printf("tcp: %.2f usec/rtt  %.0f msgs/sec\n", tcp * 1e6 / BENCH_MSGS, 2 * BENCH_MSGS / tcp);
+    printf("shm: %.2f usec/rtt  %.0f msgs/sec\n", shm * 1e6 / BENCH_MSGS, 2 * BENCH_MSGS / shm);
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
+
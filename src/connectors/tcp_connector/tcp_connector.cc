@@ -27,8 +27,11 @@
 #include <netdb.h>
 #include <poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "log/messages.h"
 #include "main/thread.h"
 #include "profiler/profiler_defs.h"
@@ -39,9 +42,13 @@ using namespace snort;
 
 /* Globals ****************************************************************/
 
-THREAD_LOCAL SimpleStats tcp_connector_stats;
+THREAD_LOCAL TcpConnectorStats tcp_connector_stats;
 THREAD_LOCAL ProfileStats tcp_connector_perfstats;
 
+#define TRANSMIT_RING_SIZE 1024
+// wakeups are signaled; this only bounds a missed one
+#define TRANSMIT_IDLE_SEC 1
+
 TcpConnectorMsgHandle::TcpConnectorMsgHandle(const uint32_t length)
 {
     connector_msg.length = length;
@@ -208,20 +215,180 @@ void TcpConnector::stop_receive_thread()
     }
 }
 
-TcpConnector::TcpConnector(TcpConnectorConfig* tcp_connector_config, int sfd)
+static void update_max(std::atomic<uint64_t>& max, uint64_t val)
+{
+    uint64_t cur = max.load(std::memory_order_relaxed);
+
+    while ( val > cur and !max.compare_exchange_weak(cur, val, std::memory_order_relaxed) );
+}
+
+bool TcpConnector::write_batch(TcpConnectorMsgHandle** batch, unsigned count)
+{
+    TcpConnectorMsgHdr* hdrs = tx_hdrs;
+    struct iovec* iov = tx_iov;
+    size_t total = 0;
+
+    for ( unsigned i = 0; i < count; i++ )
+    {
+        hdrs[i] = TcpConnectorMsgHdr(batch[i]->connector_msg.length);
+        iov[2*i].iov_base = &hdrs[i];
+        iov[2*i].iov_len = sizeof(hdrs[i]);
+        iov[2*i+1].iov_base = batch[i]->connector_msg.data;
+        iov[2*i+1].iov_len = batch[i]->connector_msg.length;
+        total += sizeof(hdrs[i]) + batch[i]->connector_msg.length;
+    }
+
+    auto lag = std::chrono::steady_clock::now() - batch[0]->queued;
+    update_max(tx_max_lag, std::chrono::duration_cast<std::chrono::microseconds>(lag).count());
+
+    struct iovec* v = iov;
+    int n = 2 * count;
+
+    while ( n > 0 )
+    {
+        ssize_t rval = writev(sock_fd, v, n);
+
+        if ( rval < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+
+            ErrorMessage("TcpC Output Thread: failed to transmit %u messages: %s\n",
+                count, strerror(errno));
+            return false;
+        }
+
+        // skip what went out and resume mid-vector on a short write
+        while ( n > 0 and (size_t)rval >= v->iov_len )
+        {
+            rval -= v->iov_len;
+            v++;
+            n--;
+        }
+        if ( n > 0 )
+        {
+            v->iov_base = (uint8_t*)v->iov_base + rval;
+            v->iov_len -= rval;
+        }
+    }
+
+    tx_frames++;
+    update_max(tx_max_messages, count);
+    update_max(tx_max_bytes, total);
+    return true;
+}
+
+void TcpConnector::transmit_processing_thread()
+{
+    TcpConnectorMsgHandle** batch = new TcpConnectorMsgHandle*[max_batch];
+    bool ok = true;
+
+    while ( true )
+    {
+        // sample before draining so the last pass empties the ring
+        bool running = run_transmit;
+        unsigned count = 0;
+
+        while ( count < max_batch and (batch[count] = transmit_ring->get(nullptr)) )
+            count++;
+
+        if ( count )
+        {
+            // after a write error the stream is out of sync; just drain
+            if ( ok )
+                ok = write_batch(batch, count);
+
+            for ( unsigned i = 0; i < count; i++ )
+                delete batch[i];
+
+            continue;
+        }
+
+        if ( !running )
+            break;
+
+        std::unique_lock<std::mutex> lock(tx_mutex);
+        tx_idle = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // a put after this check sees tx_idle and notifies
+        if ( transmit_ring->empty() and run_transmit )
+            tx_cond.wait_for(lock, std::chrono::seconds(TRANSMIT_IDLE_SEC));
+
+        tx_idle = false;
+    }
+    delete[] batch;
+}
+
+void TcpConnector::start_transmit_thread()
+{
+    tx_hdrs = new TcpConnectorMsgHdr[max_batch];
+    tx_iov = new struct iovec[2 * max_batch];
+    run_transmit = true;
+    transmit_thread = new std::thread(&TcpConnector::transmit_processing_thread, this);
+}
+
+void TcpConnector::stop_transmit_thread()
+{
+    if ( transmit_thread != nullptr )
+    {
+        {
+            std::lock_guard<std::mutex> lock(tx_mutex);
+            run_transmit = false;
+        }
+        tx_cond.notify_one();
+        transmit_thread->join();
+        delete transmit_thread;
+        transmit_thread = nullptr;
+        delete[] tx_hdrs;
+        delete[] tx_iov;
+    }
+}
+
+void TcpConnector::update_stats()
+{
+    tcp_connector_stats.frames += tx_frames.exchange(0);
+
+    tcp_connector_stats.max_frame_messages =
+        std::max(tcp_connector_stats.max_frame_messages, (PegCount)tx_max_messages.load());
+
+    tcp_connector_stats.max_frame_bytes =
+        std::max(tcp_connector_stats.max_frame_bytes, (PegCount)tx_max_bytes.load());
+
+    tcp_connector_stats.max_sync_lag =
+        std::max(tcp_connector_stats.max_sync_lag, (PegCount)tx_max_lag.load());
+}
+
+TcpConnector::TcpConnector(TcpConnectorConfig* tcp_connector_config, int sfd) :
+    tx_idle(false), tx_frames(0), tx_max_messages(0), tx_max_bytes(0), tx_max_lag(0)
 {
     receive_thread = nullptr;
+    transmit_thread = nullptr;
+    transmit_ring = nullptr;
+    tx_hdrs = nullptr;
+    tx_iov = nullptr;
     config = tcp_connector_config;
     receive_ring = new ReceiveRing(50);
     sock_fd = sfd;
+    max_batch = tcp_connector_config->max_batch ? tcp_connector_config->max_batch : 1;
+
     if ( tcp_connector_config->async_receive )
         start_receive_thread();
+
+    if ( tcp_connector_config->async_transmit )
+    {
+        transmit_ring = new TransmitRing(TRANSMIT_RING_SIZE);
+        start_transmit_thread();
+    }
 }
 
 TcpConnector::~TcpConnector()
 {
     stop_receive_thread();
+    stop_transmit_thread();
+    update_stats();
     delete receive_ring;
+    delete transmit_ring;
     close(sock_fd);
 }
 
@@ -251,6 +418,28 @@ bool TcpConnector::transmit_message(ConnectorMsgHandle* msg)
         return false;
     }
 
+    if ( transmit_ring )
+    {
+        update_stats();
+        tmsg->queued = std::chrono::steady_clock::now();
+
+        if ( !transmit_ring->put(tmsg) )
+        {
+            tcp_connector_stats.queue_overruns++;
+            delete tmsg;
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if ( tx_idle )
+        {
+            std::lock_guard<std::mutex> lock(tx_mutex);
+            tx_cond.notify_one();
+        }
+        tcp_connector_stats.messages++;
+        return true;
+    }
+
     TcpConnectorMsgHdr tcpc_hdr(tmsg->connector_msg.length);
 
     if ( send( sock_fd, (const char*)&tcpc_hdr, sizeof(tcpc_hdr), 0 ) != sizeof(tcpc_hdr) )
@@ -268,6 +457,7 @@ bool TcpConnector::transmit_message(ConnectorMsgHandle* msg)
     }
 
     delete tmsg;
+    tcp_connector_stats.messages++;
 
     return true;
 }
@@ -21,6 +21,10 @@
 #ifndef TCP_CONNECTOR_H
 #define TCP_CONNECTOR_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 #include "framework/connector.h"
@@ -30,6 +34,8 @@
 
 #define TCP_FORMAT_VERSION (1)
 
+struct iovec;
+
 //-------------------------------------------------------------------------
 // class stuff
 //-------------------------------------------------------------------------
@@ -51,6 +57,7 @@ public:
     TcpConnectorMsgHandle(const uint32_t length);
     ~TcpConnectorMsgHandle();
     snort::ConnectorMsg connector_msg;
+    std::chrono::steady_clock::time_point queued;
 };
 
 class TcpConnectorCommon : public snort::ConnectorCommon
@@ -64,6 +71,7 @@ class TcpConnector : public snort::Connector
 {
 public:
     typedef Ring<TcpConnectorMsgHandle*> ReceiveRing;
+    typedef Ring<TcpConnectorMsgHandle*> TransmitRing;
 
     TcpConnector(TcpConnectorConfig*, int sock_fd);
     ~TcpConnector() override;
@@ -87,6 +95,33 @@ private:
     void stop_receive_thread();
     void receive_processing_thread();
     ReceiveRing* receive_ring;
+
+    // with async_transmit the packet thread only queues messages; the
+    // transmit thread coalesces whatever is queued into one writev()
+    std::atomic<bool> run_transmit;
+    std::thread* transmit_thread;
+    void start_transmit_thread();
+    void stop_transmit_thread();
+    void transmit_processing_thread();
+    bool write_batch(TcpConnectorMsgHandle**, unsigned);
+    void update_stats();
+    TransmitRing* transmit_ring;
+
+    // the transmit thread sleeps while the ring is empty; tx_idle tells
+    // the packet thread it must be woken after a put
+    std::mutex tx_mutex;
+    std::condition_variable tx_cond;
+    std::atomic<bool> tx_idle;
+
+    TcpConnectorMsgHdr* tx_hdrs;
+    struct iovec* tx_iov;
+    unsigned max_batch;
+
+    // written by the transmit thread, folded into the pegs by the packet thread
+    std::atomic<uint64_t> tx_frames;
+    std::atomic<uint64_t> tx_max_messages;
+    std::atomic<uint64_t> tx_max_bytes;
+    std::atomic<uint64_t> tx_max_lag;
 };
 
 #endif
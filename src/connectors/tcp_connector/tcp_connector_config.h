@@ -30,12 +30,19 @@ class TcpConnectorConfig : public snort::ConnectorConfig
 public:
     enum Setup { CALL, ANSWER };
     TcpConnectorConfig()
-    { direction = snort::Connector::CONN_DUPLEX; async_receive = true; }
+    {
+        direction = snort::Connector::CONN_DUPLEX;
+        async_receive = true;
+        async_transmit = false;
+        max_batch = 32;
+    }
 
     uint16_t base_port;
     std::string address;
     Setup setup;
     bool async_receive;
+    bool async_transmit;
+    uint16_t max_batch;
 
     typedef std::vector<TcpConnectorConfig*> TcpConnectorConfigSet;
 };
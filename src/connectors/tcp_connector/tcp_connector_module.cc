@@ -40,16 +40,27 @@ static const Parameter tcp_connector_params[] =
     { "setup", Parameter::PT_ENUM, "call | answer", nullptr,
       "stream establishment" },
 
+    { "async_transmit", Parameter::PT_BOOL, nullptr, "false",
+      "queue messages and write them in batches from a separate thread" },
+
+    { "max_batch", Parameter::PT_INT, "1:512", "32",
+      "maximum number of queued messages coalesced into one write" },
+
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
 static const PegInfo tcp_connector_pegs[] =
 {
     { CountType::SUM, "messages", "total messages" },
+    { CountType::SUM, "frames", "writes issued by the transmit thread" },
+    { CountType::SUM, "queue_overruns", "messages dropped because the transmit queue was full" },
+    { CountType::MAX, "max_frame_messages", "most messages coalesced into one write" },
+    { CountType::MAX, "max_frame_bytes", "largest write issued by the transmit thread" },
+    { CountType::MAX, "max_sync_lag", "longest time in usecs a message waited to be written" },
     { CountType::END, nullptr, nullptr }
 };
 
-extern THREAD_LOCAL SimpleStats tcp_connector_stats;
+extern THREAD_LOCAL TcpConnectorStats tcp_connector_stats;
 extern THREAD_LOCAL ProfileStats tcp_connector_perfstats;
 
 //-------------------------------------------------------------------------
@@ -85,6 +96,12 @@ bool TcpConnectorModule::set(const char*, Value& v, SnortConfig*)
     else if ( v.is("base_port") )
         config->base_port = v.get_long();
 
+    else if ( v.is("async_transmit") )
+        config->async_transmit = v.get_bool();
+
+    else if ( v.is("max_batch") )
+        config->max_batch = v.get_long();
+
     else if ( v.is("setup") )
         switch ( v.get_long() )
         {
@@ -28,6 +28,16 @@
 #define TCP_CONNECTOR_NAME "tcp_connector"
 #define TCP_CONNECTOR_HELP "implement the tcp stream connector"
 
+struct TcpConnectorStats
+{
+    PegCount messages;
+    PegCount frames;
+    PegCount queue_overruns;
+    PegCount max_frame_messages;
+    PegCount max_frame_bytes;
+    PegCount max_sync_lag;
+};
+
 class TcpConnectorModule : public snort::Module
 {
 public:
@@ -33,7 +33,7 @@
 
 using namespace snort;
 
-THREAD_LOCAL SimpleStats tcp_connector_stats;
+THREAD_LOCAL TcpConnectorStats tcp_connector_stats;
 THREAD_LOCAL ProfileStats tcp_connector_perfstats;
 
 void show_stats(PegCount*, const PegInfo*, unsigned, const char*) { }
@@ -29,9 +29,11 @@
 #include <netdb.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "main/snort_debug.h"
+#include "main/thread.h"
 
 #include <CppUTest/CommandLineTestRunner.h>
 #include <CppUTest/TestHarness.h>
@@ -58,6 +60,8 @@ static bool s_rec_return_zero = false;
 
 static int s_send_ret_header = sizeof(TcpConnectorMsgHdr);
 static int s_send_ret_other = 0;
+static unsigned s_writev_messages = 0;
+static unsigned s_writev_calls = 0;
 
 TcpConnectorConfig connector_config;
 
@@ -89,6 +93,18 @@ ssize_t send (int, const void*, size_t n, int)
         return s_send_ret_other;
 }
 
+ssize_t writev (int, const struct iovec* iov, int cnt)
+{
+    ssize_t n = 0;
+
+    for ( int i = 0; i < cnt; i++ )
+        n += iov[i].iov_len;
+
+    s_writev_messages += cnt / 2;
+    s_writev_calls++;
+    return n;
+}
+
 int poll (struct pollfd* fds, nfds_t nfds, int)
 {
     if ( s_poll_error )
@@ -168,6 +184,8 @@ static void set_normal_status()
     s_rec_error = 0;
     s_rec_error_size = -1;
     s_rec_return_zero = false;
+    s_writev_messages = 0;
+    s_writev_calls = 0;
 }
 
 TcpConnectorModule::TcpConnectorModule() :
@@ -783,6 +801,86 @@ TEST(tcp_connector_no_tinit_tterm_call, receive_recv_body_closed)
     delete[] message;
 }
 
+TEST_GROUP(tcp_connector_async_transmit)
+{
+    void setup() override
+    {
+        tcpc_api = (ConnectorApi*)tcp_connector;
+        s_instance = 0;
+        set_normal_status();
+        connector_config.direction = Connector::CONN_DUPLEX;
+        connector_config.connector_name = "tcp";
+        connector_config.address = "127.0.0.1";
+        connector_config.base_port = 10000;
+        connector_config.setup = TcpConnectorConfig::Setup::CALL;
+        connector_config.async_receive = false;
+        connector_config.async_transmit = true;
+        connector_config.max_batch = 4;
+        mod = tcp_connector->mod_ctor();
+        connector_common = tcpc_api->ctor(mod);
+        connector = tcpc_api->tinit(&connector_config);
+        CHECK(connector != nullptr);
+    }
+
+    void teardown() override
+    {
+        tcpc_api->dtor(connector_common);
+        tcp_connector->mod_dtor(mod);
+        connector_config.async_transmit = false;
+        connector_config.max_batch = 32;
+    }
+};
+
+TEST(tcp_connector_async_transmit, batch)
+{
+    extern THREAD_LOCAL TcpConnectorStats tcp_connector_stats;
+    memset(&tcp_connector_stats, 0, sizeof(tcp_connector_stats));
+
+    TcpConnector* tcpc = (TcpConnector*)connector;
+    const uint8_t* data;
+
+    for ( unsigned i = 0; i < 10; i++ )
+    {
+        ConnectorMsgHandle* handle = tcpc->alloc_message(40, &data);
+        CHECK(tcpc->transmit_message(handle) == true);
+    }
+
+    // tterm drains the queue before the thread exits
+    tcpc_api->tterm(connector);
+
+    CHECK(s_writev_messages == 10);
+    CHECK(s_writev_calls >= 3);
+    CHECK(tcp_connector_stats.messages == 10);
+    CHECK(tcp_connector_stats.frames == s_writev_calls);
+    CHECK(tcp_connector_stats.max_frame_messages <= 4);
+    CHECK(tcp_connector_stats.max_frame_bytes <= 4 * (40 + sizeof(TcpConnectorMsgHdr)));
+}
+
+TEST(tcp_connector_async_transmit, wake)
+{
+    TcpConnector* tcpc = (TcpConnector*)connector;
+    const uint8_t* data;
+
+    // let the transmit thread go idle
+    usleep(10000);
+
+    ConnectorMsgHandle* handle = tcpc->alloc_message(40, &data);
+    CHECK(tcpc->transmit_message(handle) == true);
+
+    // the put wakes the thread well before its idle timeout
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < 500 and !s_writev_messages; i++ )
+        usleep(1000);
+
+    CHECK(s_writev_messages == 1);
+
+    // and so does shutdown
+    tcpc_api->tterm(connector);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(elapsed < std::chrono::milliseconds(500));
+}
+
 TEST_GROUP(tcp_connector_msg_handle)
 {
     void setup() override
@@ -53,6 +53,7 @@ using namespace snort;
 THREAD_LOCAL ProfileStats detectPerfStats;
 THREAD_LOCAL ProfileStats eventqPerfStats;
 THREAD_LOCAL ProfileStats rebuiltPacketPerfStats;
+THREAD_LOCAL ProfileStats contextPerfStats;
 
 void snort_ignore(Packet*) { }
 
@@ -37,6 +37,7 @@ struct RuleTreeNode;
 extern THREAD_LOCAL snort::ProfileStats eventqPerfStats;
 extern THREAD_LOCAL snort::ProfileStats detectPerfStats;
 extern THREAD_LOCAL snort::ProfileStats rebuiltPacketPerfStats;
+extern THREAD_LOCAL snort::ProfileStats contextPerfStats;
 
 // main loop hooks
 void snort_ignore(snort::Packet*);
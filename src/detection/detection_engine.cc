@@ -112,6 +112,7 @@ Packet* DetectionEngine::get_encode_packet()
 // however, rebuild is always in the next context, not current.
 Packet* DetectionEngine::set_next_packet(Packet* parent)
 {
+    Profile profile(contextPerfStats);
     IpsContext* c = Snort::get_switcher()->get_next();
     if ( parent )
     {
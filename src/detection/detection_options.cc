@@ -32,6 +32,7 @@
 
 #include "detection_options.h"
 
+#include <cstdlib>
 #include <string>
 
 #include "filters/detection_filter.h"
@@ -71,6 +72,8 @@ using namespace snort;
 #define HASH_EQUAL        0
 #define HASH_NOT_EQUAL    1
 
+#define STATE_ALIGN       64  // cache line
+
 struct detection_option_key_t
 {
     option_type_t option_type;
@@ -325,6 +328,132 @@ void print_option_tree(detection_option_tree_node_t* node, int level)
 #endif
 }
 
+static void count_tree_nodes(const detection_option_tree_node_t* node, unsigned& n)
+{
+    ++n;
+
+    for ( int i = 0; i < node->num_children; ++i )
+        count_tree_nodes(node->children[i], n);
+}
+
+// node is in its final place; move its children and their subtrees into
+// the next slots of nodes and links in walk order
+static void flatten_children(
+    detection_option_tree_node_t* node, detection_option_tree_node_t* nodes, unsigned& num_nodes,
+    detection_option_tree_node_t** links, unsigned& num_links)
+{
+    if ( !node->num_children )
+        return;
+
+    detection_option_tree_node_t** kids = links + num_links;
+    num_links += node->num_children;
+
+    for ( int i = 0; i < node->num_children; ++i )
+    {
+        detection_option_tree_node_t* old = node->children[i];
+        detection_option_tree_node_t* dst = nodes + num_nodes++;
+
+        *dst = *old;
+        snort_free(old);
+
+        kids[i] = dst;
+        flatten_children(dst, nodes, num_nodes, links, num_links);
+    }
+    snort_free(node->children);
+    node->children = kids;
+}
+
+// the top stays put since the caller holds it; everything below it ends up
+// in one node array and one children array.  the first node is top's first
+// child and the first children block is top's so the top can free both.
+static void flatten_tree(detection_option_tree_node_t* top)
+{
+    if ( !top->num_children )
+        return;
+
+    unsigned n = 0;
+    count_tree_nodes(top, n);
+    --n;
+
+    auto* nodes = (detection_option_tree_node_t*)
+        snort_calloc(n, sizeof(detection_option_tree_node_t));
+    auto* links = (detection_option_tree_node_t**)
+        snort_calloc(n, sizeof(detection_option_tree_node_t*));
+
+    unsigned num_nodes = 0;
+    unsigned num_links = 0;
+
+    flatten_children(top, nodes, num_nodes, links, num_links);
+    assert(num_nodes == n and num_links == n);
+}
+
+static bool sets_vars(const detection_option_tree_node_t* node)
+{
+    if ( node->option_type == RULE_OPTION_TYPE_LEAF_NODE )
+        return false;
+
+    const char* s = ((IpsOption*)node->option_data)->get_name();
+    return !strcmp(s, "byte_extract") or !strcmp(s, "byte_math");
+}
+
+// returns true if this node or any below it sets vars
+static bool set_tree_state(
+    detection_option_tree_node_t* node, dot_node_check_t* check, dot_node_state_t* state,
+    unsigned stride, unsigned& idx)
+{
+    node->check = check + idx;
+    node->state = state + idx;
+    node->state_stride = stride;
+    ++idx;
+
+    if ( node->option_type != RULE_OPTION_TYPE_LEAF_NODE )
+    {
+        IpsOption* opt = (IpsOption*)node->option_data;
+        PatternMatchData* pmd = opt->get_pattern(0, RULE_WO_DIR);
+
+        node->content_last = pmd ? pmd->last_check : nullptr;
+        node->unbounded = pmd and pmd->is_unbounded();
+        node->ips_eval = (node->evaluate == (eval_func_t)IpsOption::eval);
+    }
+
+    bool below = false;
+
+    for ( int i = 0; i < node->num_children; ++i )
+        below = set_tree_state(node->children[i], check, state, stride, idx) or below;
+
+    node->skip_vars = !below;
+    return below or sets_vars(node);
+}
+
+// each packet thread gets its own cache line aligned block with the eval
+// checks for every node of the subtree in walk order followed by the
+// profiler counters in the same order
+static void compile_tree(detection_option_tree_node_t* top)
+{
+    flatten_tree(top);
+
+    unsigned nodes = 0;
+    count_tree_nodes(top, nodes);
+
+    const size_t align = alignof(dot_node_state_t);
+    size_t checks = (nodes * sizeof(dot_node_check_t) + align - 1) & ~(align - 1);
+
+    size_t stride = checks + nodes * sizeof(dot_node_state_t);
+    stride = (stride + STATE_ALIGN - 1) & ~(size_t)(STATE_ALIGN - 1);
+
+    unsigned instances = ThreadConfig::get_instance_max();
+    void* block = nullptr;
+
+    if ( posix_memalign(&block, STATE_ALIGN, stride * instances) )
+        FatalError("Failed to allocate rule option tree state\n");
+
+    memset(block, 0, stride * instances);
+
+    unsigned idx = 0;
+    set_tree_state(top, (dot_node_check_t*)block,
+        (dot_node_state_t*)((uint8_t*)block + checks), stride, idx);
+}
+
 void* add_detection_option_tree(SnortConfig* sc, detection_option_tree_node_t* option_tree)
 {
     if ( !sc->detection_option_tree_hash_table )
@@ -337,10 +466,21 @@ void* add_detection_option_tree(SnortConfig* sc, detection_option_tree_node_t* o
     if ( void* p = xhash_find(sc->detection_option_tree_hash_table, &key) )
         return p;
 
+    compile_tree(option_tree);
     xhash_add(sc->detection_option_tree_hash_table, &key, option_tree);
     return nullptr;
 }
 
+// most options are IpsOptions so call them directly instead of through
+// the static trampoline
+static inline int eval_option(detection_option_tree_node_t* node, Cursor& c, Packet* p)
+{
+    if ( node->ips_eval )
+        return ((IpsOption*)node->option_data)->eval(c, p);
+
+    return node->evaluate(node->option_data, c, p);
+}
+
 int detection_option_node_evaluate(
     detection_option_tree_node_t* node, detection_option_eval_data_t* eval_data,
     Cursor& orig_cursor)
@@ -349,7 +489,9 @@ int detection_option_node_evaluate(
     if ( !node )
         return 0;
 
-    auto& state = node->state[get_instance_id()];
+    const unsigned instance = get_instance_id();
+    auto& check = node->get_check(instance);
+    auto& state = node->get_state(instance);
     RuleContext profile(state);
 
     int result = 0;
@@ -373,7 +515,7 @@ int detection_option_node_evaluate(
     // see if evaluated it before ...
     if ( !node->is_relative )
     {
-        auto last_check = state.last_check;
+        auto last_check = check.last_check;
 
         if ( last_check.ts == p->pkth->ts &&
             last_check.run_num == get_run_num() &&
@@ -392,23 +534,17 @@ int detection_option_node_evaluate(
         }
     }
 
-    state.last_check.ts = eval_data->p->pkth->ts;
-    state.last_check.run_num = get_run_num();
-    state.last_check.context_num = cur_eval_context_num;
-    state.last_check.flowbit_failed = 0;
-    state.last_check.rebuild_flag = p->packet_flags & PKT_REBUILT_STREAM;
+    check.last_check.ts = eval_data->p->pkth->ts;
+    check.last_check.run_num = get_run_num();
+    check.last_check.context_num = cur_eval_context_num;
+    check.last_check.flowbit_failed = 0;
+    check.last_check.rebuild_flag = p->packet_flags & PKT_REBUILT_STREAM;
 
     // Save some stuff off for repeated pattern tests
     PmdLastCheck* content_last = nullptr;
 
-    if ( node->option_type != RULE_OPTION_TYPE_LEAF_NODE )
-    {
-        IpsOption* opt = (IpsOption*)node->option_data;
-        PatternMatchData* pmd = opt->get_pattern(0, RULE_WO_DIR);
-
-        if ( pmd and pmd->last_check )
-            content_last = pmd->last_check + get_instance_id();
-    }
+    if ( node->content_last )
+        content_last = node->content_last + instance;
 
     // No, haven't evaluated this one before... Check it.
     do
@@ -468,7 +604,7 @@ int detection_option_node_evaluate(
 
                 if ( f_result )
                 {
-                    otn->state[get_instance_id()].matches++;
+                    otn->state[instance].matches++;
 
                     if ( !eval_data->flowbit_noalert )
                     {
@@ -513,7 +649,7 @@ int detection_option_node_evaluate(
                         break;
                     }
                 }
-                rval = node->evaluate(node->option_data, cursor, p);
+                rval = eval_option(node, cursor, p);
             }
             break;
 
@@ -527,20 +663,20 @@ int detection_option_node_evaluate(
                     rval = (int)IpsOption::MATCH;
 
                 else
-                    rval = node->evaluate(node->option_data, cursor, eval_data->p);
+                    rval = eval_option(node, cursor, eval_data->p);
             }
             break;
 
         default:
             if ( node->evaluate )
-                rval = node->evaluate(node->option_data, cursor, p);
+                rval = eval_option(node, cursor, p);
             break;
         }
 
         if ( rval == (int)IpsOption::NO_MATCH )
         {
             trace_log(detection, TRACE_RULE_EVAL, "no match\n");
-            state.last_check.result = result;
+            check.last_check.result = result;
             return result;
         }
         else if ( rval == (int)IpsOption::FAILED_BIT )
@@ -548,8 +684,8 @@ int detection_option_node_evaluate(
             trace_log(detection, TRACE_RULE_EVAL, "failed bit\n");
             eval_data->flowbit_failed = 1;
             // clear the timestamp so failed flowbit gets eval'd again
-            state.last_check.flowbit_failed = 1;
-            state.last_check.result = result;
+            check.last_check.flowbit_failed = 1;
+            check.last_check.result = result;
             return 0;
         }
         else if ( rval == (int)IpsOption::NO_ALERT )
@@ -562,19 +698,22 @@ int detection_option_node_evaluate(
         }
 
         // Back up byte_extract vars so they don't get overwritten between rules
-        trace_log(detection, TRACE_RULE_VARS, "Rule options variables: \n");
-        for ( int i = 0; i < NUM_IPS_OPTIONS_VARS; ++i )
+        if ( !node->skip_vars )
         {
-            GetVarValueByIndex(&(tmp_byte_extract_vars[i]), (int8_t)i);
-            trace_logf_wo_name(detection, TRACE_RULE_VARS, "var[%d]=%d ", i,
-                tmp_byte_extract_vars[i]);
+            trace_log(detection, TRACE_RULE_VARS, "Rule options variables: \n");
+            for ( int i = 0; i < NUM_IPS_OPTIONS_VARS; ++i )
+            {
+                GetVarValueByIndex(&(tmp_byte_extract_vars[i]), (int8_t)i);
+                trace_logf_wo_name(detection, TRACE_RULE_VARS, "var[%d]=%d ", i,
+                    tmp_byte_extract_vars[i]);
+            }
+            trace_log_wo_name(detection, TRACE_RULE_VARS, "\n");
         }
-        trace_log_wo_name(detection, TRACE_RULE_VARS, "\n");
 
         if ( PacketLatency::fastpath() )
         {
             profile.stop(result != (int)IpsOption::NO_MATCH);
-            state.last_check.result = result;
+            check.last_check.result = result;
             return result;
         }
 
@@ -586,14 +725,17 @@ int detection_option_node_evaluate(
                 for ( int i = 0; i < node->num_children; ++i )
                 {
                     detection_option_tree_node_t* child_node = node->children[i];
-                    dot_node_state_t* child_state = child_node->state + get_instance_id();
+                    dot_node_check_t* child_check = &child_node->get_check(instance);
 
-                    for ( int j = 0; j < NUM_IPS_OPTIONS_VARS; ++j )
-                        SetVarValueByIndex(tmp_byte_extract_vars[j], (int8_t)j);
+                    if ( !node->skip_vars )
+                    {
+                        for ( int j = 0; j < NUM_IPS_OPTIONS_VARS; ++j )
+                            SetVarValueByIndex(tmp_byte_extract_vars[j], (int8_t)j);
+                    }
 
                     if ( loop_count > 0 )
                     {
-                        if ( child_state->result == (int)IpsOption::NO_MATCH )
+                        if ( child_check->result == (int)IpsOption::NO_MATCH )
                         {
                             if ( child_node->option_type == RULE_OPTION_TYPE_CONTENT )
                             {
@@ -612,10 +754,7 @@ int detection_option_node_evaluate(
                                     // Check for an unbounded relative search.  If this
                                     // failed before, it's going to fail again so don't
                                     // go down this path again
-                                    IpsOption* opt = (IpsOption*)child_node->option_data;
-                                    PatternMatchData* pmd = opt->get_pattern(0, RULE_WO_DIR);
-
-                                    if ( pmd and pmd->is_unbounded() )
+                                    if ( child_node->unbounded )
                                     {
                                         // Only increment result once. Should hit this
                                         // condition on first loop iteration
@@ -631,28 +770,28 @@ int detection_option_node_evaluate(
                             // Leaf node matched, don't eval again
                             continue;
 
-                        else if ( child_state->result == child_node->num_children )
+                        else if ( child_check->result == child_node->num_children )
                             // This branch of the tree matched or has options that
                             // don't need to be evaluated again, so don't need to
                             // evaluate this option again
                             continue;
                     }
 
-                    child_state->result = detection_option_node_evaluate(
+                    child_check->result = detection_option_node_evaluate(
                         node->children[i], eval_data, cursor);
 
                     if ( child_node->option_type == RULE_OPTION_TYPE_LEAF_NODE )
                         // Leaf node won't have any children but will return success
                         // or failure
-                        result += child_state->result;
+                        result += child_check->result;
 
-                    else if (child_state->result == child_node->num_children)
+                    else if (child_check->result == child_node->num_children)
                         // Indicate that the child's tree branches are done
                         ++result;
 
                     if ( PacketLatency::fastpath() )
                     {
-                        state.last_check.result = result;
+                        check.last_check.result = result;
                         return result;
                     }
                 }
@@ -701,7 +840,7 @@ int detection_option_node_evaluate(
     {
         // Do any setting/clearing/resetting/toggling of flowbits here
         // given that other rule options matched
-        rval = node->evaluate(node->option_data, cursor, p);
+        rval = eval_option(node, cursor, p);
         if ( rval != (int)IpsOption::MATCH )
             result = rval;
     }
@@ -710,10 +849,10 @@ int detection_option_node_evaluate(
     {
         // something deeper in the tree failed a flowbit test, we may need to
         // reeval this node
-        state.last_check.flowbit_failed = 1;
+        check.last_check.flowbit_failed = 1;
     }
 
-    state.last_check.result = result;
+    check.last_check.result = result;
     profile.stop(result != (int)IpsOption::NO_MATCH);
 
     return result;
@@ -741,10 +880,10 @@ static void detection_option_node_update_otn_stats(detection_option_tree_node_t*
 
     for ( unsigned i = 0; i < ThreadConfig::get_instance_max(); ++i )
     {
-        node_stats.elapsed += node->state[i].elapsed;
-        node_stats.elapsed_match += node->state[i].elapsed_match;
-        node_stats.elapsed_no_match += node->state[i].elapsed_no_match;
-        node_stats.checks += node->state[i].checks;
+        node_stats.elapsed += node->get_state(i).elapsed;
+        node_stats.elapsed_match += node->get_state(i).elapsed_match;
+        node_stats.elapsed_no_match += node->get_state(i).elapsed_no_match;
+        node_stats.checks += node->get_state(i).checks;
     }
 
     if ( stats )
@@ -815,9 +954,9 @@ void detection_option_tree_update_otn_stats(XHash* doth)
 
         for ( unsigned i = 0; i < ThreadConfig::get_instance_max(); ++i )
         {
-            checks += node->state[i].checks;
-            timeouts += node->state[i].latency_timeouts;
-            suspends += node->state[i].latency_suspends;
+            checks += node->get_state(i).checks;
+            timeouts += node->get_state(i).latency_timeouts;
+            suspends += node->get_state(i).latency_suspends;
         }
 
         if ( checks )
@@ -859,21 +998,194 @@ detection_option_tree_node_t* new_node(option_type_t type, void* data)
     p->option_type = type;
     p->option_data = data;
 
-    p->state = (dot_node_state_t*)
-        snort_calloc(ThreadConfig::get_instance_max(), sizeof(*p->state));
-
     return p;
 }
 
-void free_detection_option_tree(detection_option_tree_node_t* node)
+static void free_detection_option_nodes(detection_option_tree_node_t* node)
 {
     int i;
     for (i=0; i<node->num_children; i++)
     {
-        free_detection_option_tree(node->children[i]);
+        free_detection_option_nodes(node->children[i]);
     }
     snort_free(node->children);
-    snort_free(node->state);
     snort_free(node);
 }
 
+// a compiled top owns the state block and the flattened nodes beneath it
+void free_detection_option_tree(detection_option_tree_node_t* node)
+{
+    if ( !node->check )
+    {
+        free_detection_option_nodes(node);
+        return;
+    }
+    if ( node->num_children )
+    {
+        snort_free(node->children[0]);
+        snort_free(node->children);
+    }
+    free(node->check);
+    snort_free(node);
+}
+
+
+#ifdef UNIT_TEST
+
+#include <thread>
+#include <vector>
+
+#include "catch/snort_catch.h"
+
+#define BENCH_NODES 64
+#define BENCH_WALKS 100000
+
+// one node with 63 children, like a popular fast pattern; only the shape
+// matters here so leaves stand in for the options
+static detection_option_tree_node_t* bench_tree()
+{
+    auto* top = new_node(RULE_OPTION_TYPE_LEAF_NODE, nullptr);
+
+    top->num_children = BENCH_NODES - 1;
+    top->children = (detection_option_tree_node_t**)
+        snort_calloc(top->num_children, sizeof(*top->children));
+
+    for ( int i = 0; i < top->num_children; ++i )
+        top->children[i] = new_node(RULE_OPTION_TYPE_LEAF_NODE, nullptr);
+
+    return top;
+}
+
+// the node major layout used before, each node with its own array of
+// per thread state
+struct BenchNodeState
+{
+    dot_node_check_t check;
+    dot_node_state_t state;
+};
+
+static void set_node_major(detection_option_tree_node_t* node, std::vector<BenchNodeState*>& v)
+{
+    auto* s = (BenchNodeState*)
+        snort_calloc(ThreadConfig::get_instance_max(), sizeof(BenchNodeState));
+    v.push_back(s);
+
+    node->check = &s->check;
+    node->state = &s->state;
+    node->state_stride = sizeof(*s);
+
+    for ( int i = 0; i < node->num_children; ++i )
+        set_node_major(node->children[i], v);
+}
+
+// the writes an eval makes; volatile so they aren't sunk out of the loop
+static void bench_walk(detection_option_tree_node_t* top, unsigned instance)
+{
+    for ( unsigned n = 0; n < BENCH_WALKS; ++n )
+    {
+        int result = 0;
+
+        for ( int i = 0; i < top->num_children; ++i )
+        {
+            auto* child = top->children[i];
+            volatile int& r = child->get_check(instance).result;
+            volatile uint64_t& c = child->get_state(instance).checks;
+
+            r = n & 1;
+            c = c + 1;
+            result += r;
+        }
+        volatile int& r = top->get_check(instance).result;
+        r = result;
+    }
+}
+
+static void bench_run(detection_option_tree_node_t* top, unsigned threads)
+{
+    std::vector<std::thread> v;
+
+    for ( unsigned i = 0; i < threads; ++i )
+        v.emplace_back(bench_walk, top, i);
+
+    for ( auto& t : v )
+        t.join();
+}
+
+TEST_CASE("option tree state layout", "[detection_options]")
+{
+    unsigned save = ThreadConfig::get_instance_max();
+    ThreadConfig::set_instance_max(4);
+
+    auto* top = bench_tree();
+    compile_tree(top);
+
+    CHECK(((uintptr_t)top->check % STATE_ALIGN) == 0);
+    CHECK((top->state_stride % STATE_ALIGN) == 0);
+
+    // walk order within a thread's block and in the node array
+    for ( int i = 0; i < top->num_children; ++i )
+    {
+        CHECK(top->children[i] == top->children[0] + i);
+        CHECK(top->children[i]->check == top->check + i + 1);
+        CHECK(top->children[i]->state == top->state + i + 1);
+    }
+
+    // no two threads share a line
+    for ( unsigned i = 1; i < 4; ++i )
+    {
+        auto* prev_end = (uint8_t*)&top->children[BENCH_NODES - 2]->get_state(i - 1) +
+            sizeof(dot_node_state_t);
+        auto* start = (uint8_t*)&top->get_check(i);
+
+        CHECK(((uintptr_t)start % STATE_ALIGN) == 0);
+        CHECK(start >= prev_end);
+    }
+
+    free_detection_option_tree(top);
+    ThreadConfig::set_instance_max(save);
+}
+
+TEST_CASE("option tree state scaling", "[.][detection_options][benchmark]")
+{
+    unsigned save = ThreadConfig::get_instance_max();
+    unsigned max = std::thread::hardware_concurrency();
+
+    if ( max > 32 )
+        max = 32;
+    else if ( !max )
+        max = 1;
+
+    ThreadConfig::set_instance_max(max);
+
+    auto* thread_major = bench_tree();
+    compile_tree(thread_major);
+
+    auto* node_major = bench_tree();
+    std::vector<BenchNodeState*> node_states;
+    set_node_major(node_major, node_states);
+
+    for ( unsigned n = 1; n <= max; n *= 2 )
+    {
+        std::string nm = "node major " + std::to_string(n) + " threads";
+        std::string tm = "thread major " + std::to_string(n) + " threads";
+
+        BENCHMARK(nm)
+        {
+            bench_run(node_major, n);
+        }
+        BENCHMARK(tm)
+        {
+            bench_run(thread_major, n);
+        }
+    }
+
+    for ( auto* s : node_states )
+        snort_free(s);
+
+    free_detection_option_nodes(node_major);
+    free_detection_option_tree(thread_major);
+
+    ThreadConfig::set_instance_max(save);
+}
+
+#endif
@@ -28,8 +28,8 @@
 // detection options only once per pattern match.
 //
 // These trees are instantiated at parse time, one per MPSE match state.
-// Eval, profiling, and latency data are attached in an array sized per max
-// packet threads.
+// Eval, profiling, and latency data are attached per max packet threads in
+// thread major blocks, one per top level subtree.
 
 #include <sys/time.h>
 
@@ -45,12 +45,15 @@ struct Packet;
 struct SnortConfig;
 struct XHash;
 }
+struct PmdLastCheck;
 struct RuleLatencyState;
 
 typedef int (* eval_func_t)(void* option_data, class Cursor&, snort::Packet*);
 
-// this is per packet thread
-struct dot_node_state_t
+// this is per packet thread and checked on every eval, kept apart from
+// the profiler counters below so a tree walk touches as few lines as
+// possible
+struct dot_node_check_t
 {
     int result;
     struct
@@ -62,7 +65,11 @@ struct dot_node_state_t
         char result;
         char flowbit_failed;
     } last_check;
+};
 
+// this is per packet thread
+struct dot_node_state_t
+{
     // FIXIT-L perf profiler stuff should be factored of the node state struct
     hr_duration elapsed;
     hr_duration elapsed_match;
@@ -87,6 +94,11 @@ struct dot_node_state_t
     }
 };
 
+// check and state point at packet thread 0; the other threads' copies
+// follow every state_stride bytes.  each top level subtree lays out its
+// nodes in walk order in one block per thread (see add_detection_option_tree)
+// so packet threads never share a cache line.  the nodes below the top are
+// also moved into a single array in walk order when the subtree is compiled.
 struct detection_option_tree_node_t
 {
     eval_func_t evaluate;
@@ -96,7 +108,21 @@ struct detection_option_tree_node_t
     void* option_data;
     option_type_t option_type;
     detection_option_tree_node_t** children;
+    dot_node_check_t* check;
     dot_node_state_t* state;
+    unsigned state_stride;
+
+    // set when the subtree is compiled, see add_detection_option_tree()
+    PmdLastCheck* content_last;  // per thread, for negated contents
+    bool ips_eval;               // evaluate is IpsOption::eval
+    bool unbounded;              // relative content without depth or within
+    bool skip_vars;              // nothing below sets byte_extract vars
+
+    dot_node_check_t& get_check(unsigned instance)
+    { return *(dot_node_check_t*)((uint8_t*)check + instance * state_stride); }
+
+    dot_node_state_t& get_state(unsigned instance)
+    { return *(dot_node_state_t*)((uint8_t*)state + instance * state_stride); }
 };
 
 struct detection_option_tree_root_t
@@ -25,6 +25,10 @@
 #ifndef FP_CONFIG_H
 #define FP_CONFIG_H
 
+#include <string>
+
+#include "detection/fp_profile.h"
+
 namespace snort
 {
     struct MpseApi;
@@ -127,6 +131,46 @@ public:
 
     void set_max_pattern_len(unsigned);
 
+    void set_compile_threads(unsigned n)
+    { compile_threads = n; }
+
+    unsigned get_compile_threads()
+    { return compile_threads; }
+
+    void set_search_streams(bool enable)
+    { search_streams = enable; }
+
+    bool get_search_streams()
+    { return search_streams; }
+
+    void set_stream_memcap(unsigned bytes)
+    { stream_memcap = bytes; }
+
+    unsigned get_stream_memcap()
+    { return stream_memcap; }
+
+    void set_stream_gen(unsigned gen)
+    { stream_gen = gen; }
+
+    unsigned get_stream_gen()
+    { return stream_gen; }
+
+    bool set_fp_profile(const char* file)
+    { fp_profile_in = true; return fp_profile.load(file); }
+
+    void set_fp_profile_out(const char* file)
+    { fp_profile_out = file; }
+
+    const std::string& get_fp_profile_out()
+    { return fp_profile_out; }
+
+    void set_fp_profile_threshold(unsigned n)
+    { fp_profile.set_threshold(n); }
+
+    // null unless reading or writing a profile
+    FpProfile* get_fp_profile()
+    { return (fp_profile_in or !fp_profile_out.empty()) ? &fp_profile : nullptr; }
+
     const snort::MpseApi* get_search_api()
     { return search_api; }
 
@@ -155,15 +199,23 @@ private:
     bool split_any_any = false;
     bool debug_print_fast_pattern = false;
     bool debug = false;
+    bool search_streams = false;
+    bool fp_profile_in = false;
 
     unsigned max_queue_events = 5;
     unsigned bleedover_port_limit = 1024;
+    unsigned compile_threads = 0;    // 0 means hardware concurrency
+    unsigned stream_memcap = 2048;   // per flow
+    unsigned stream_gen = 0;         // distinguishes mpse across reloads
 
     int search_opt = 0;
     int portlists_flags = 0;
     int max_pattern_len = 0;
     int num_patterns_truncated = 0;  // due to max_pattern_len
     int num_patterns_trimmed = 0;    // due to zero byte prefix
+
+    FpProfile fp_profile;
+    std::string fp_profile_out;
 };
 
 #endif
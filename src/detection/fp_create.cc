@@ -34,6 +34,13 @@
 
 #include "fp_create.h"
 
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 #include "framework/mpse.h"
 #include "hash/ghash.h"
 #include "log/messages.h"
@@ -43,12 +50,15 @@
 #include "parser/parser.h"
 #include "ports/port_table.h"
 #include "ports/rule_port_tables.h"
+#include "time/clock_defs.h"
+#include "time/stopwatch.h"
 #include "utils/stats.h"
 #include "utils/util.h"
 
 #include "detection_options.h"
 #include "detect_trace.h"
 #include "fp_config.h"
+#include "fp_stream.h"
 #include "fp_utils.h"
 #include "pattern_match_data.h"
 #include "pcrm.h"
@@ -58,9 +68,47 @@
 using namespace snort;
 using namespace std;
 
+// unique search engines queued for compilation
 static unsigned mpse_count = 0;
 static const char* s_group = "";
 
+// search engines are queued as their groups are finished and compiled
+// together once all groups are built; see fpCompileSearchEngines()
+static vector<Mpse*> s_pending;
+
+// groups that end up with the same fast patterns for the same rules share
+// one search engine instance.  each instance's pattern set is recorded as
+// it is built and sorted into a canonical key when its group is finished.
+struct FpPatternKey
+{
+    const OptTreeNode* otn;
+    const PatternMatchData* pmd;
+    string pattern;
+
+    FpPatternKey(const OptTreeNode* o, const PatternMatchData* p, string&& s) :
+        otn(o), pmd(p), pattern(move(s)) { }
+
+    bool operator<(const FpPatternKey& rhs) const
+    {
+        if ( otn != rhs.otn )
+            return less<const OptTreeNode*>()(otn, rhs.otn);
+
+        if ( pmd != rhs.pmd )
+            return less<const PatternMatchData*>()(pmd, rhs.pmd);
+
+        return pattern < rhs.pattern;
+    }
+
+    bool operator==(const FpPatternKey& rhs) const
+    { return otn == rhs.otn and pmd == rhs.pmd and pattern == rhs.pattern; }
+};
+
+typedef vector<FpPatternKey> FpPatternSet;
+
+static unordered_map<Mpse*, FpPatternSet> s_pattern_sets;
+static unordered_multimap<size_t, Mpse*> s_unique_mpse;
+static unsigned mpse_shared = 0;
+
 static void fpDeletePMX(void* data);
 
 static int fpGetFinalPattern(
@@ -366,6 +414,25 @@ static int pmx_create_tree(SnortConfig* sc, void* id, void** existing_tree)
     return otn_create_tree(otn, existing_tree);
 }
 
+static void fpAddPattern(
+    SnortConfig* sc, PortGroup* pg, OptTreeNode* otn, PatternMatchData* pmd,
+    const char* pattern, int pattern_length)
+{
+    PMX* pmx = (PMX*)snort_calloc(sizeof(PMX));
+    pmx->rule_node.rnRuleData = otn;
+    pmx->pmd = pmd;
+
+    Mpse::PatternDescriptor desc(
+        pmd->is_no_case(), pmd->is_negated(), pmd->is_literal(), pmd->mpse_flags);
+
+    Mpse* mpse = pg->mpse[pmd->pm_type];
+    mpse->add_pattern(sc, (const uint8_t*)pattern, pattern_length, desc, pmx);
+
+    // the descriptor is derived from pmd so pmd, otn, and the final
+    // pattern identify both what is matched and what is reported
+    s_pattern_sets[mpse].emplace_back(otn, pmd, string(pattern, pattern_length));
+}
+
 static int fpFinishPortGroupRule(
     SnortConfig* sc, PortGroup* pg,
     OptTreeNode* otn, PatternMatchData* pmd, FastPatternConfig* fp)
@@ -392,10 +459,14 @@ static int fpFinishPortGroupRule(
             ParseError("Failed to create pattern matcher for %d", pmd->pm_type);
             return -1;
         }
-        mpse_count++;
 
         if ( fp->get_search_opt() )
             pg->mpse[pmd->pm_type]->set_opt(1);
+
+        // only raw and file data are searched as streams
+        if ( fp->get_search_streams() and
+            (pmd->pm_type == PM_TYPE_PKT or pmd->pm_type == PM_TYPE_FILE) )
+            pg->mpse[pmd->pm_type]->enable_stream();
     }
     if (pmd->is_negated())
         pg->add_nfp_rule(otn);
@@ -412,16 +483,151 @@ static int fpFinishPortGroupRule(
     if ( fp->get_debug_print_fast_patterns() )
         print_fp_info(s_group, otn, pmd, pattern, pattern_length);
 
-    PMX* pmx = (PMX*)snort_calloc(sizeof(PMX));
-    pmx->rule_node.rnRuleData = otn;
-    pmx->pmd = pmd;
+    fpAddPattern(sc, pg, otn, pmd, pattern, pattern_length);
+    return 0;
+}
 
-    Mpse::PatternDescriptor desc(
-        pmd->is_no_case(), pmd->is_negated(), pmd->is_literal(), pmd->mpse_flags);
+static void fpBuildSearchEngines(atomic<unsigned>* next, vector<int>* status)
+{
+    unsigned i;
 
-    pg->mpse[pmd->pm_type]->add_pattern(sc, (const uint8_t*)pattern, pattern_length, desc, pmx);
+    while ( (i = (*next)++) < s_pending.size() )
+    {
+        Mpse* mpse = s_pending[i];
 
-    return 0;
+        if ( mpse->can_build_concurrently() )
+            (*status)[i] = mpse->build();
+    }
+}
+
+static unsigned fpGetCompileThreads(FastPatternConfig* fp)
+{
+    unsigned n = fp->get_compile_threads();
+
+    if ( !n )
+        n = thread::hardware_concurrency();
+
+    if ( n > s_pending.size() )
+        n = s_pending.size();
+
+    return n ? n : 1;
+}
+
+// the state machines are independent of each other so they are built by a
+// pool of threads, each taking the next instance from the queue.  anything
+// that touches shared detection state (the rule trees built via the agent,
+// engines that can't build concurrently, debug output) is then done on this
+// thread in queue order so the result does not depend on scheduling.
+static void fpCompileSearchEngines(
+    SnortConfig* sc, FastPatternConfig* fp, unsigned& threads,
+    uint64_t& build_usecs, uint64_t& finish_usecs)
+{
+    threads = 0;
+    build_usecs = finish_usecs = 0;
+
+    if ( s_pending.empty() )
+        return;
+
+    if ( sc->test_mode() and !sc->mem_check() )
+    {
+        if ( fp->get_debug_mode() )
+        {
+            for ( auto mpse : s_pending )
+                mpse->print_info();
+        }
+        s_pending.clear();
+        return;
+    }
+
+    vector<int> status(s_pending.size(), 0);
+    atomic<unsigned> next(0);
+
+    threads = fpGetCompileThreads(fp);
+
+    Stopwatch<SnortClock> sw;
+    sw.start();
+
+    vector<thread> workers;
+
+    for ( unsigned i = 1; i < threads; ++i )
+        workers.emplace_back(fpBuildSearchEngines, &next, &status);
+
+    fpBuildSearchEngines(&next, &status);
+
+    for ( auto& t : workers )
+        t.join();
+
+    sw.stop();
+    build_usecs = clock_usecs(TO_USECS(sw.get()));
+
+    sw.reset();
+    sw.start();
+
+    for ( unsigned i = 0; i < s_pending.size(); ++i )
+    {
+        Mpse* mpse = s_pending[i];
+        int rval = status[i];
+
+        if ( !mpse->can_build_concurrently() )
+            rval = mpse->prep_patterns(sc);
+
+        else if ( !rval )
+            rval = mpse->finish(sc);
+
+        if ( rval )
+            FatalError("Failed to compile port group patterns.\n");
+
+        if ( fp->get_debug_mode() )
+            mpse->print_info();
+    }
+
+    sw.stop();
+    finish_usecs = clock_usecs(TO_USECS(sw.get()));
+
+    s_pending.clear();
+}
+
+static size_t fpHashPatternSet(FastPatternConfig* fp, const FpPatternSet& set)
+{
+    size_t h = hash<const void*>()(fp->get_search_api());
+    h = h * 31 + fp->get_search_opt();
+
+    for ( const auto& k : set )
+    {
+        h = h * 31 + hash<const void*>()(k.otn);
+        h = h * 31 + hash<const void*>()(k.pmd);
+        h = h * 31 + hash<string>()(k.pattern);
+    }
+    return h;
+}
+
+// returns the instance to use for this group; a duplicate of an instance
+// already queued for compilation is deleted and the original is shared
+static Mpse* fpShareSearchEngine(FastPatternConfig* fp, Mpse* mpse)
+{
+    FpPatternSet& set = s_pattern_sets[mpse];
+    sort(set.begin(), set.end());
+
+    size_t h = fpHashPatternSet(fp, set);
+    auto range = s_unique_mpse.equal_range(h);
+
+    for ( auto it = range.first; it != range.second; ++it )
+    {
+        if ( s_pattern_sets[it->second] == set )
+        {
+            s_pattern_sets.erase(mpse);
+            MpseManager::delete_search_engine(mpse);
+
+            it->second->add_ref();
+            mpse_shared++;
+            return it->second;
+        }
+    }
+
+    s_unique_mpse.emplace(h, mpse);
+    s_pending.push_back(mpse);
+    mpse_count++;
+    return mpse;
 }
 
 static int fpFinishPortGroup(
@@ -439,18 +645,12 @@ static int fpFinishPortGroup(
         {
             if (pg->mpse[i]->get_pattern_count() != 0)
             {
-                if ( !sc->test_mode() or sc->mem_check() )
-                {
-                    if ( pg->mpse[i]->prep_patterns(sc) != 0 )
-                        FatalError("Failed to compile port group patterns.\n");
-                }
-
-                if (fp->get_debug_mode())
-                    pg->mpse[i]->print_info();
+                pg->mpse[i] = fpShareSearchEngine(fp, pg->mpse[i]);
                 rules = 1;
             }
             else
             {
+                s_pattern_sets.erase(pg->mpse[i]);
                 MpseManager::delete_search_engine(pg->mpse[i]);
                 pg->mpse[i] = nullptr;
             }
@@ -489,15 +689,7 @@ static void fpAddAlternatePatterns(SnortConfig* sc, PortGroup* pg,
     if ( fp->get_debug_print_fast_patterns() )
         print_fp_info(s_group, otn, pmd, pmd->pattern_buf, pmd->pattern_size);
 
-    PMX* pmx = (PMX*)snort_calloc(sizeof(PMX));
-    pmx->rule_node.rnRuleData = otn;
-    pmx->pmd = pmd;
-
-    Mpse::PatternDescriptor desc(
-        pmd->is_no_case(), pmd->is_negated(), pmd->is_literal(), pmd->mpse_flags);
-
-    pg->mpse[pmd->pm_type]->add_pattern(
-        sc, (const uint8_t*)pmd->pattern_buf, pmd->pattern_size, desc, pmx);
+    fpAddPattern(sc, pg, otn, pmd, pmd->pattern_buf, pmd->pattern_size);
 }
 
 static int fpAddPortGroupRule(
@@ -517,7 +709,7 @@ static int fpAddPortGroupRule(
     bool only_literal = !MpseManager::is_regex_capable(fp->get_search_api());
     bool exclude;
 
-    pmv = get_fp_content(otn, next, srvc, only_literal, exclude);
+    pmv = get_fp_content(otn, next, srvc, only_literal, exclude, fp->get_fp_profile());
 
     if ( !pmv.empty() )
     {
@@ -1532,10 +1724,17 @@ int fpCreateFastPacketDetection(SnortConfig* sc)
         return 0;
     }
 
-    mpse_count = 0;
+    mpse_count = mpse_shared = 0;
+    s_pending.clear();
 
     MpseManager::start_search_engine(fp->get_search_api());
 
+    if ( fp->get_search_streams() )
+        fp_stream_init(fp);
+
+    Stopwatch<SnortClock> sw;
+    sw.start();
+
     /* Use PortObjects to create PortGroups */
     if (fp->get_debug_print_rule_group_build_details())
         LogMessage("Creating Port Groups....\n");
@@ -1546,6 +1745,11 @@ int fpCreateFastPacketDetection(SnortConfig* sc)
     if (fp->get_debug_print_rule_group_build_details())
         LogMessage("Port Groups Done....\n");
 
+    sw.stop();
+    uint64_t port_group_usecs = clock_usecs(TO_USECS(sw.get()));
+    sw.reset();
+    sw.start();
+
     /* Create rule_maps */
     if (fp->get_debug_print_rule_group_build_details())
         LogMessage("Creating Rule Maps....\n");
@@ -1556,6 +1760,11 @@ int fpCreateFastPacketDetection(SnortConfig* sc)
     if (fp->get_debug_print_rule_group_build_details())
         LogMessage("Rule Maps Done....\n");
 
+    sw.stop();
+    uint64_t rule_map_usecs = clock_usecs(TO_USECS(sw.get()));
+    sw.reset();
+    sw.start();
+
     if (fp->get_debug_print_rule_group_build_details())
         LogMessage("Creating Service Based Rule Maps....\n");
 
@@ -1570,15 +1779,41 @@ int fpCreateFastPacketDetection(SnortConfig* sc)
     if (fp->get_debug_print_rule_group_build_details())
         LogMessage("Service Based Rule Maps Done....\n");
 
+    sw.stop();
+    uint64_t service_group_usecs = clock_usecs(TO_USECS(sw.get()));
+
+    s_pattern_sets.clear();
+    s_unique_mpse.clear();
+
+    unsigned threads;
+    uint64_t build_usecs, finish_usecs;
+    fpCompileSearchEngines(sc, fp, threads, build_usecs, finish_usecs);
+
     fp_print_port_groups(port_tables);
     fp_print_service_groups(sc->spgmmTable);
 
+    LogLabel("fast pattern compile");
+    LogCount("threads", threads);
+    LogCount("port groups usecs", port_group_usecs);
+    LogCount("rule maps usecs", rule_map_usecs);
+    LogCount("service groups usecs", service_group_usecs);
+    LogCount("mpse build usecs", build_usecs);
+    LogCount("mpse finish usecs", finish_usecs);
+
     if ( mpse_count )
     {
         LogLabel("search engine");
         MpseManager::print_mpse_summary(fp->get_search_api());
     }
 
+    if ( mpse_shared )
+    {
+        LogLabel("search engine sharing");
+        LogCount("unique instances", mpse_count);
+        LogCount("shared instances", mpse_shared);
+        LogStat("dedup ratio", (double)(mpse_count + mpse_shared) / mpse_count);
+    }
+
     if ( fp->get_num_patterns_truncated() )
         LogMessage("%25.25s: %-12u\n", "truncated patterns", fp->get_num_patterns_truncated());
 
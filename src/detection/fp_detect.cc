@@ -39,6 +39,8 @@
 
 #include "fp_detect.h"
 
+#include <algorithm>
+
 #include "events/event.h"
 #include "filters/rate_filter.h"
 #include "filters/sfthreshold.h"
@@ -53,6 +55,7 @@
 #include "main/snort_debug.h"
 #include "managers/action_manager.h"
 #include "packet_tracer/packet_tracer.h"
+#include "parser/parse_rule.h"
 #include "parser/parser.h"
 #include "profiler/profiler_defs.h"
 #include "protocols/icmp4.h"
@@ -71,6 +74,7 @@
 #include "detection_options.h"
 #include "fp_config.h"
 #include "fp_create.h"
+#include "fp_stream.h"
 #include "ips_context.h"
 #include "pattern_match_data.h"
 #include "pcrm.h"
@@ -92,8 +96,17 @@ THREAD_LOCAL ProfileStats ruleNFPEvalPerfStats;
 
 static inline void init_match_info(OtnxMatchData* o, bool do_fp)
 {
-    for ( int i = 0; i < o->iMatchInfoArraySize; i++ )
-        o->matchInfo[i].iMatchCount = 0;
+    for ( int i = 0; i < o->iMatchInfoUsedCount; i++ )
+        o->matchInfo[o->matchInfoUsed[i]].iMatchCount = 0;
+
+    o->iMatchInfoUsedCount = 0;
+
+    // a new generation forgets the otns seen on the previous packet
+    if ( !++o->gen )
+    {
+        memset(o->seen, 0, o->seen_size * sizeof(*o->seen));
+        o->gen = 1;
+    }
 
     o->have_match = false;
     o->do_fp = do_fp;
@@ -225,6 +238,118 @@ int fpLogEvent(const RuleTreeNode* rtn, const OptTreeNode* otn, Packet* p)
     return 0;
 }
 
+static int sortOrderByPriority(const void* e1, const void* e2)
+{
+    const OptTreeNode* otn1;
+    const OptTreeNode* otn2;
+
+    if (!e1 || !e2)
+        return 0;
+
+    otn1 = *(OptTreeNode* const*)e1;
+    otn2 = *(OptTreeNode* const*)e2;
+
+    if ( otn1->sigInfo.priority < otn2->sigInfo.priority )
+        return -1;
+
+    if ( otn1->sigInfo.priority > otn2->sigInfo.priority )
+        return +1;
+
+    /* This improves stability of repeated tests */
+    if ( otn1->sigInfo.sid < otn2->sigInfo.sid )
+        return -1;
+
+    if ( otn1->sigInfo.sid > otn2->sigInfo.sid )
+        return +1;
+
+    return 0;
+}
+
+// FIXIT-L pattern length is not a valid event sort criterion for
+// non-literals
+static int sortOrderByContentLength(const void* e1, const void* e2)
+{
+    const OptTreeNode* otn1;
+    const OptTreeNode* otn2;
+
+    if (!e1 || !e2)
+        return 0;
+
+    otn1 = *(OptTreeNode* const*)e1;
+    otn2 = *(OptTreeNode* const*)e2;
+
+    if (otn1->longestPatternLen < otn2->longestPatternLen)
+        return +1;
+
+    if (otn1->longestPatternLen > otn2->longestPatternLen)
+        return -1;
+
+    /* This improves stability of repeated tests */
+    if ( otn1->sigInfo.sid < otn2->sigInfo.sid )
+        return +1;
+
+    if ( otn1->sigInfo.sid > otn2->sigInfo.sid )
+        return -1;
+
+    return 0;
+}
+
+// heap and sort order for the event queue; a before b if a is the better event
+struct EventOrder
+{
+    EventOrder(int o) : order(o) { }
+
+    bool operator()(const OptTreeNode* a, const OptTreeNode* b) const
+    {
+        if ( order == SNORT_EVENTQ_CONTENT_LEN )
+            return sortOrderByContentLength(&a, &b) < 0;
+
+        return sortOrderByPriority(&a, &b) < 0;
+    }
+
+    int order;
+};
+
+static bool already_seen(OtnxMatchData* o, const OptTreeNode* otn)
+{
+    unsigned idx = otn->ruleIndex;
+
+    // rules added by reload can be past the end
+    if ( idx >= o->seen_size )
+    {
+        unsigned size = idx + 1024;
+        MatchSeen* seen = (MatchSeen*)snort_calloc(size, sizeof(*seen));
+
+        memcpy(seen, o->seen, o->seen_size * sizeof(*seen));
+        snort_free(o->seen);
+
+        o->seen = seen;
+        o->seen_size = size;
+    }
+
+    MatchSeen& s = o->seen[idx];
+
+    if ( s.gen == o->gen )
+    {
+        if ( s.otn == otn )
+            return true;
+
+        // the same gid:sid from another policy; rare so just search
+        for ( int i = 0; i < o->iMatchInfoArraySize; i++ )
+        {
+            const MatchInfo& mi = o->matchInfo[i];
+
+            for ( int j = 0; j < mi.iMatchCount; j++ )
+                if ( mi.MatchArray[j] == otn )
+                    return true;
+        }
+        return false;
+    }
+    s.otn = otn;
+    s.gen = o->gen;
+    return false;
+}
+
 /*
 **  DESCRIPTION
 **    Add and Event to the appropriate Match Queue: Alert, Pass, or Log.
@@ -261,30 +386,45 @@ int fpAddMatch(OtnxMatchData* omd_local, int /*pLen*/, const OptTreeNode* otn)
     }
     MatchInfo* pmi = &omd_local->matchInfo[evalIndex];
 
+    // don't store the same otn again
+    if ( already_seen(omd_local, otn) )
+        return 0;
+
+    const SnortConfig* sc = SnortConfig::get_conf();
+    int max = sc->fast_pattern_config->get_max_queue_events();
+
+    if ( max > MAX_EVENT_MATCH )
+        max = MAX_EVENT_MATCH;
+
+    EventOrder order(sc->event_queue_config->order);
+    const OptTreeNode** heap = pmi->MatchArray;
+
+    //  add the event to the appropriate list
+    if ( pmi->iMatchCount < max )
+    {
+        if ( !pmi->iMatchCount )
+            omd_local->matchInfoUsed[omd_local->iMatchInfoUsedCount++] = evalIndex;
+
+        heap[pmi->iMatchCount++] = otn;
+        std::push_heap(heap, heap + pmi->iMatchCount, order);
+        omd_local->have_match = true;
+        return 0;
+    }
+
     /*
     **  If we hit the max number of unique events for any rule type alert,
-    **  log or pass, then we don't add it to the list.
+    **  log or pass, then something is dropped: this one, or the worst one
+    **  we have if this one is better.
     */
-    if ( pmi->iMatchCount >= (int)SnortConfig::get_conf()->fast_pattern_config->get_max_queue_events() ||
-        pmi->iMatchCount >= MAX_EVENT_MATCH)
-    {
-        pc.match_limit++;
-        return 1;
-    }
+    pc.match_limit++;
 
-    // don't store the same otn again
-    for ( int i=0; i< pmi->iMatchCount; i++ )
+    if ( pmi->iMatchCount and order(otn, heap[0]) )
     {
-        if ( pmi->MatchArray[ i  ] == otn )
-            return 0;
+        std::pop_heap(heap, heap + pmi->iMatchCount, order);
+        heap[pmi->iMatchCount - 1] = otn;
+        std::push_heap(heap, heap + pmi->iMatchCount, order);
     }
-
-    //  add the event to the appropriate list
-    pmi->MatchArray[ pmi->iMatchCount ] = otn;
-
-    pmi->iMatchCount++;
-    omd_local->have_match = true;
-    return 0;
+    return 1;
 }
 
 /*
@@ -446,62 +586,6 @@ static int rule_tree_match(
     return 0;
 }
 
-static int sortOrderByPriority(const void* e1, const void* e2)
-{
-    const OptTreeNode* otn1;
-    const OptTreeNode* otn2;
-
-    if (!e1 || !e2)
-        return 0;
-
-    otn1 = *(OptTreeNode* const*)e1;
-    otn2 = *(OptTreeNode* const*)e2;
-
-    if ( otn1->sigInfo.priority < otn2->sigInfo.priority )
-        return -1;
-
-    if ( otn1->sigInfo.priority > otn2->sigInfo.priority )
-        return +1;
-
-    /* This improves stability of repeated tests */
-    if ( otn1->sigInfo.sid < otn2->sigInfo.sid )
-        return -1;
-
-    if ( otn1->sigInfo.sid > otn2->sigInfo.sid )
-        return +1;
-
-    return 0;
-}
-
-// FIXIT-L pattern length is not a valid event sort criterion for
-// non-literals
-static int sortOrderByContentLength(const void* e1, const void* e2)
-{
-    const OptTreeNode* otn1;
-    const OptTreeNode* otn2;
-
-    if (!e1 || !e2)
-        return 0;
-
-    otn1 = *(OptTreeNode* const*)e1;
-    otn2 = *(OptTreeNode* const*)e2;
-
-    if (otn1->longestPatternLen < otn2->longestPatternLen)
-        return +1;
-
-    if (otn1->longestPatternLen > otn2->longestPatternLen)
-        return -1;
-
-    /* This improves stability of repeated tests */
-    if ( otn1->sigInfo.sid < otn2->sigInfo.sid )
-        return +1;
-
-    if ( otn1->sigInfo.sid > otn2->sigInfo.sid )
-        return -1;
-
-    return 0;
-}
-
 /*
 **  DESCRIPTION
 **    This function flags an alert per session.
@@ -623,7 +707,6 @@ static inline int fpFinalSelectEvent(OtnxMatchData* o, Packet* p)
 
     int i;
     int j;
-    int k;
     const OptTreeNode* otn;
     int tcnt = 0;
     EventQueueConfig* eq = SnortConfig::get_conf()->event_queue_config;
@@ -650,21 +733,15 @@ static inline int fpFinalSelectEvent(OtnxMatchData* o, Packet* p)
              * part of the natural ordering....Jan '06..
              */
             /* Sort the rules in this action group */
-            if (eq->order == SNORT_EVENTQ_PRIORITY)
-            {
-                qsort(o->matchInfo[i].MatchArray, o->matchInfo[i].iMatchCount,
-                    sizeof(void*), sortOrderByPriority);
-            }
-            else if (eq->order == SNORT_EVENTQ_CONTENT_LEN)
-            {
-                qsort(o->matchInfo[i].MatchArray, o->matchInfo[i].iMatchCount,
-                    sizeof(void*), sortOrderByContentLength);
-            }
-            else
+            if (eq->order != SNORT_EVENTQ_PRIORITY && eq->order != SNORT_EVENTQ_CONTENT_LEN)
             {
                 FatalError("fpdetect: Order function for event queue is invalid.\n");
             }
 
+            // fpAddMatch kept the best max_queue in a heap so this is short
+            std::sort_heap(o->matchInfo[i].MatchArray,
+                o->matchInfo[i].MatchArray + o->matchInfo[i].iMatchCount, EventOrder(eq->order));
+
             /* Process each event in the action (alert,drop,log,...) groups */
             for (j=0; j < o->matchInfo[i].iMatchCount; j++)
             {
@@ -678,16 +755,7 @@ static inline int fpFinalSelectEvent(OtnxMatchData* o, Packet* p)
                         return 1;
                 }
 
-                //  Loop here so we don't log the same event multiple times.
-                for (k = 0; k < j; k++)
-                {
-                    if (o->matchInfo[i].MatchArray[k] == otn)
-                    {
-                        otn = nullptr;
-                        break;
-                    }
-                }
-
+                // fpAddMatch doesn't add the same event twice
                 if ( otn && !fpSessionAlerted(p, otn) )
                 {
                     if ( DetectionEngine::queue_event(otn) )
@@ -838,6 +906,13 @@ void fp_set_context(IpsContext& c)
     c.otnx->matchInfo = (MatchInfo*)snort_calloc(
         SnortConfig::get_conf()->num_rule_types, sizeof(MatchInfo));
 
+    c.otnx->matchInfoUsed = (int*)snort_calloc(
+        SnortConfig::get_conf()->num_rule_types, sizeof(int));
+
+    c.otnx->seen_size = get_rule_count() + 1;
+    c.otnx->seen = (MatchSeen*)snort_calloc(c.otnx->seen_size, sizeof(MatchSeen));
+    c.otnx->gen = 1;
+
     c.context_num = 0;
 }
 
@@ -845,6 +920,8 @@ void fp_clear_context(IpsContext& c)
 {
     delete c.stash;
     snort_free(c.otnx->matchInfo);
+    snort_free(c.otnx->matchInfoUsed);
+    snort_free(c.otnx->seen);
     snort_free(c.otnx);
 }
 
@@ -864,7 +941,8 @@ static int rule_tree_queue(
 }
 
 static inline int search_data(
-    Mpse* so, OtnxMatchData* omd, const uint8_t* buf, unsigned len, PegCount& cnt)
+    Mpse* so, OtnxMatchData* omd, const uint8_t* buf, unsigned len, PegCount& cnt,
+    bool stream = false)
 {
     assert(so->get_pattern_count() > 0);
     int start_state = 0;
@@ -873,7 +951,10 @@ static inline int search_data(
     MpseStash* stash = omd->p->context->stash;
     stash->init();
     dump_buffer(buf, len, omd->p);
-    so->search(buf, len, rule_tree_queue, omd, &start_state);
+
+    if ( !stream or fp_stream_search(so, omd->p, buf, len, rule_tree_queue, omd) < 0 )
+        so->search(buf, len, rule_tree_queue, omd, &start_state);
+
     stash->process(rule_tree_match, omd);
     if ( PacketLatency::fastpath() )
         return 1;
@@ -909,6 +990,7 @@ static int fp_search(
     omd->check_ports = check_ports;
 
     bool user_mode = SnortConfig::get_conf()->sopgTable->user_mode;
+    bool streams = SnortConfig::get_conf()->fast_pattern_config->get_search_streams();
 
     trace_log(detection, TRACE_RULE_EVAL, "Fast pattern search\n");
 
@@ -922,7 +1004,14 @@ static int fp_search(
                 trace_logf(detection, TRACE_FP_SEARCH, "%" PRIu64 " fp %s[%u]\n",
                     p->context->packet_number, pm_type_strings[PM_TYPE_PKT], pattern_match_size);
 
-                search_data(so, omd, p->data, pattern_match_size, pc.pkt_searches);
+                // a truncated search would leave a gap in the stream
+                bool whole = pattern_match_size == p->dsize;
+
+                search_data(so, omd, p->data, pattern_match_size, pc.pkt_searches,
+                    streams and whole);
+
+                if ( streams and !whole )
+                    fp_stream_skip(so, p);
                 p->is_cooked() ?  pc.cooked_searches++ : pc.raw_searches++;
             }
         }
@@ -961,7 +1050,15 @@ static int fp_search(
                 trace_logf(detection, TRACE_FP_SEARCH, "%" PRIu64 " fp search %s[%d]\n",
                     p->context->packet_number, pm_type_strings[PM_TYPE_FILE], file_data.len);
 
-                search_data(so, omd, file_data.data, file_data.len, pc.file_searches);
+                // only file data that is the reassembled payload itself
+                // (ftp-data) is continuous; decoded file data is not
+                bool payload = file_data.data == p->data and file_data.len == p->dsize;
+
+                search_data(so, omd, file_data.data, file_data.len, pc.file_searches,
+                    streams and payload);
+
+                if ( streams and !payload )
+                    fp_stream_skip(so, p);
             }
         }
     }
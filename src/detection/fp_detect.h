@@ -29,6 +29,8 @@
 // rule groups are selected based on traffic and any fast pattern
 // matches trigger rule tree evaluation.
 
+#include <cstdint>
+
 #include "main/thread.h"
 
 #define REBUILD_FLAGS (PKT_REBUILT_FRAG | PKT_REBUILT_STREAM)
@@ -59,9 +61,9 @@ int fpEvalRTN(RuleTreeNode*, snort::Packet*, int check_ports);
 #define MAX_EVENT_MATCH 100
 
 /*
-**  The events that are matched get held in this structure,
-**  and iMatchIndex gets set to the event that holds the
-**  highest priority.
+**  The events that are matched get held in this structure.  MatchArray
+**  is a heap bounded by max_queue with the worst event per the event
+**  queue order on top so each group keeps its best events as they come.
 */
 struct MatchInfo
 {
@@ -71,6 +73,16 @@ struct MatchInfo
     int iMatchMaxLen;
 };
 
+/*
+**  Per OTN ruleIndex, the packet generation in which the OTN was last
+**  added so fpAddMatch can skip duplicates without searching.
+*/
+struct MatchSeen
+{
+    const OptTreeNode* otn;
+    uint32_t gen;
+};
+
 /*
 **  This structure holds information that is
 **  referenced during setwise pattern matches.
@@ -93,6 +105,15 @@ struct OtnxMatchData
 
     MatchInfo* matchInfo;
     int iMatchInfoArraySize;
+
+    // matchInfo indices with events queued on this packet; only these
+    // are reset for the next one
+    int* matchInfoUsed;
+    int iMatchInfoUsedCount;
+
+    MatchSeen* seen;
+    unsigned seen_size;
+    uint32_t gen;
 };
 
 int fpAddMatch(OtnxMatchData*, int pLen, const OptTreeNode*);
@@ -0,0 +1,297 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// fp_profile.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "fp_profile.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "log/messages.h"
+#include "ports/port_group.h"
+
+#include "pattern_match_data.h"
+#include "treenodes.h"
+
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#endif
+
+using namespace snort;
+
+// the key is the buffer, case and pattern bytes, all of which change what
+// the fast pattern matches:  "packet i 666f6f"
+
+std::string FpProfile::get_key(const PatternMatchData* pmd)
+{
+    static const char* hex = "0123456789abcdef";
+
+    std::string key = (pmd->pm_type < PM_TYPE_MAX) ? pm_type_strings[pmd->pm_type] : "?";
+    key += pmd->is_no_case() ? " i " : " c ";
+
+    for ( unsigned i = 0; i < pmd->pattern_size; ++i )
+    {
+        uint8_t b = pmd->pattern_buf[i];
+        key += hex[b >> 4];
+        key += hex[b & 0xF];
+    }
+    return key;
+}
+
+const FpProfile::Counts* FpProfile::find(const OptTreeNode* otn, const PatternMatchData* pmd) const
+{
+    auto r = rules.find(get_id(otn->sigInfo.gid, otn->sigInfo.sid));
+
+    if ( r == rules.end() )
+        return nullptr;
+
+    auto c = r->second.counts.find(get_key(pmd));
+    return (c != r->second.counts.end()) ? &c->second : nullptr;
+}
+
+uint64_t FpProfile::get_false_triggers(const OptTreeNode* otn, const PatternMatchData* pmd) const
+{
+    const Counts* c = find(otn, pmd);
+    return c ? c->false_triggers() : 0;
+}
+
+uint64_t FpProfile::get_noise(const OptTreeNode* otn, const PatternMatchData* pmd) const
+{
+    uint64_t n = get_false_triggers(otn, pmd);
+    return (n >= threshold) ? n : 0;
+}
+
+// a rule in several groups is selected once per group with the same result
+void FpProfile::set_fp(
+    const OptTreeNode* otn, const PatternMatchData* fp, const PatternMatchData* was)
+{
+    Rule& r = rules[get_id(otn->sigInfo.gid, otn->sigInfo.sid)];
+    r.fp = get_key(fp);
+
+    if ( was and was != fp )
+    {
+        r.reselected = true;
+        r.before = get_false_triggers(otn, was);
+    }
+}
+
+void FpProfile::set_counts(uint32_t gid, uint32_t sid, uint64_t checks, uint64_t matches)
+{
+    auto r = rules.find(get_id(gid, sid));
+
+    if ( r == rules.end() or r->second.fp.empty() )
+        return;
+
+    r->second.run.checks = checks;
+    r->second.run.matches = matches;
+}
+
+unsigned FpProfile::get_reselected(uint64_t& before, uint64_t& after) const
+{
+    unsigned num = 0;
+    before = after = 0;
+
+    for ( const auto& r : rules )
+    {
+        if ( !r.second.reselected )
+            continue;
+
+        before += r.second.before;
+        after += r.second.run.false_triggers();
+        ++num;
+    }
+    return num;
+}
+
+//-------------------------------------------------------------------------
+// file format, one content per line:
+// gid sid buffer case pattern checks matches
+//-------------------------------------------------------------------------
+
+bool FpProfile::load(const char* file)
+{
+    std::ifstream in(file);
+
+    if ( !in )
+        return false;
+
+    std::string line;
+    unsigned num = 0;
+
+    while ( std::getline(in, line) )
+    {
+        ++num;
+
+        if ( line.empty() or line[0] == '#' )
+            continue;
+
+        std::istringstream ss(line);
+        uint32_t gid, sid;
+        std::string buf, cs, pat;
+        Counts c;
+
+        if ( !(ss >> gid >> sid >> buf >> cs >> pat >> c.checks >> c.matches) )
+        {
+            ParseWarning(WARN_CONF, "%s:%u: invalid fast pattern profile entry", file, num);
+            continue;
+        }
+        rules[get_id(gid, sid)].counts[buf + " " + cs + " " + pat] = c;
+    }
+    return true;
+}
+
+bool FpProfile::save(const char* file) const
+{
+    std::ofstream out(file);
+
+    if ( !out )
+        return false;
+
+    out << "# gid sid buffer case pattern checks matches\n";
+
+    for ( const auto& r : rules )
+    {
+        uint32_t gid = r.first >> 32;
+        uint32_t sid = r.first & 0xFFFFFFFF;
+
+        // this run adds to what was loaded for the current fast pattern
+        // so a short run doesn't replace a longer measurement
+        if ( !r.second.fp.empty() )
+        {
+            Counts c = r.second.run;
+            auto prior = r.second.counts.find(r.second.fp);
+
+            if ( prior != r.second.counts.end() )
+            {
+                c.checks += prior->second.checks;
+                c.matches += prior->second.matches;
+            }
+            out << gid << ' ' << sid << ' ' << r.second.fp << ' '
+                << c.checks << ' ' << c.matches << '\n';
+        }
+
+        for ( const auto& c : r.second.counts )
+        {
+            if ( c.first == r.second.fp )
+                continue;
+
+            out << gid << ' ' << sid << ' ' << c.first << ' '
+                << c.second.checks << ' ' << c.second.matches << '\n';
+        }
+    }
+    return (bool)out;
+}
+
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+static void set_pmd(PatternMatchData& pmd, const char* s, bool no_case)
+{
+    memset(&pmd, 0, sizeof(pmd));
+    pmd.pattern_buf = s;
+    pmd.pattern_size = strlen(s);
+    pmd.pm_type = PM_TYPE_BODY;
+
+    if ( no_case )
+        pmd.set_no_case();
+}
+
+TEST_CASE("fp profile key", "[FpProfile]")
+{
+    PatternMatchData pmd;
+    set_pmd(pmd, "Ab", true);
+    CHECK(FpProfile::get_key(&pmd) == "body i 4162");
+
+    set_pmd(pmd, "Ab", false);
+    CHECK(FpProfile::get_key(&pmd) == "body c 4162");
+}
+
+TEST_CASE("fp profile round trip", "[FpProfile]")
+{
+    OptTreeNode otn;
+    memset(&otn, 0, sizeof(otn));
+    otn.sigInfo.gid = 1;
+    otn.sigInfo.sid = 2;
+
+    PatternMatchData common, rare;
+    set_pmd(common, "GET", false);
+    set_pmd(rare, "evil", true);
+
+    char file[] = "/tmp/fp_profile_XXXXXX";
+    int fd = mkstemp(file);
+    REQUIRE(fd >= 0);
+    close(fd);
+
+    FpProfile out;
+    out.set_fp(&otn, &common, nullptr);
+    out.set_counts(1, 2, 1000, 10);
+    out.set_counts(1, 3, 5, 5);  // no fast pattern
+    REQUIRE(out.save(file));
+
+    FpProfile in;
+    REQUIRE(in.load(file));
+    CHECK(in.get_false_triggers(&otn, &common) == 990);
+    CHECK(in.get_false_triggers(&otn, &rare) == 0);
+
+    in.set_threshold(1000);
+    CHECK(in.get_noise(&otn, &common) == 0);
+    in.set_threshold(990);
+    CHECK(in.get_noise(&otn, &common) == 990);
+
+    // a second run with the other content carries the first one forward
+    in.set_fp(&otn, &rare, &common);
+    in.set_counts(1, 2, 20, 10);
+
+    uint64_t before, after;
+    CHECK(in.get_reselected(before, after) == 1);
+    CHECK(before == 990);
+    CHECK(after == 10);
+
+    REQUIRE(in.save(file));
+
+    FpProfile again;
+    REQUIRE(again.load(file));
+    CHECK(again.get_false_triggers(&otn, &common) == 990);
+    CHECK(again.get_false_triggers(&otn, &rare) == 10);
+
+    // a run without checks adds nothing to the measurement
+    again.set_fp(&otn, &rare, &rare);
+    again.set_counts(1, 2, 0, 0);
+    REQUIRE(again.save(file));
+
+    FpProfile last;
+    REQUIRE(last.load(file));
+    CHECK(last.get_false_triggers(&otn, &rare) == 10);
+    CHECK(last.get_false_triggers(&otn, &common) == 990);
+
+    remove(file);
+}
+#endif
+
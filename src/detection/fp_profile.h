@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// fp_profile.h
+
+#ifndef FP_PROFILE_H
+#define FP_PROFILE_H
+
+// FpProfile holds per rule fast pattern trigger counts measured on traffic
+// so that later compiles can avoid fast patterns that often start rule
+// evaluation without the rule matching (false triggers).
+//
+// a run with search_engine.fp_profile_out writes the checks and matches of
+// each rule's fast pattern, as gathered by the rule profiler, at exit.  a
+// run with search_engine.fp_profile reads them and fast pattern selection
+// ranks contents with at least fp_profile_threshold false triggers below
+// other positive contents.  each run adds its counts to those loaded and
+// counts for contents no longer selected are carried forward so repeated
+// runs learn about several contents of a rule.
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+struct OptTreeNode;
+struct PatternMatchData;
+
+class FpProfile
+{
+public:
+    bool load(const char* file);
+    bool save(const char* file) const;
+
+    void set_threshold(uint64_t n)
+    { threshold = n; }
+
+    uint64_t get_threshold() const
+    { return threshold; }
+
+    // measured false triggers of this content as the rule's fast pattern;
+    // 0 if none were measured
+    uint64_t get_false_triggers(const OptTreeNode*, const PatternMatchData*) const;
+
+    // get_false_triggers() if at least the threshold, else 0
+    uint64_t get_noise(const OptTreeNode*, const PatternMatchData*) const;
+
+    // called at compile with the rule's fast pattern and, if the counts
+    // changed the choice, the pattern picked without them
+    void set_fp(const OptTreeNode*, const PatternMatchData* fp, const PatternMatchData* was);
+
+    // called at exit with the rule profiler counts of the rule
+    void set_counts(uint32_t gid, uint32_t sid, uint64_t checks, uint64_t matches);
+
+    // false triggers of the reselected rules as loaded and as measured by
+    // this run
+    unsigned get_reselected(uint64_t& before, uint64_t& after) const;
+
+    static std::string get_key(const PatternMatchData*);
+
+private:
+    struct Counts
+    {
+        uint64_t checks = 0;
+        uint64_t matches = 0;
+
+        uint64_t false_triggers() const
+        { return checks > matches ? checks - matches : 0; }
+    };
+
+    struct Rule
+    {
+        std::unordered_map<std::string, Counts> counts;  // by content key
+        std::string fp;        // this compile's fast pattern
+        Counts run;            // of fp in this run
+        bool reselected = false;
+        uint64_t before = 0;   // false triggers of the pattern replaced
+    };
+
+    static uint64_t get_id(uint32_t gid, uint32_t sid)
+    { return ((uint64_t)gid << 32) | sid; }
+
+    const Counts* find(const OptTreeNode*, const PatternMatchData*) const;
+
+    std::unordered_map<uint64_t, Rule> rules;
+    uint64_t threshold = 100;
+};
+
+#endif
+
@@ -0,0 +1,299 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// fp_stream.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "fp_stream.h"
+
+#include <vector>
+
+#include "flow/flow.h"
+#include "main/snort_config.h"
+#include "protocols/packet.h"
+#include "search_engines/pat_stats.h"
+
+#include "fp_config.h"
+
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#endif
+
+using namespace snort;
+
+//-------------------------------------------------------------------------
+// flow data
+//-------------------------------------------------------------------------
+
+// there are at most a few entries per flow (pkt and file mpse in each
+// direction) so a vector is searched rather than a map
+
+class FpStreamData : public FlowData
+{
+public:
+    struct Entry
+    {
+        Entry(const Mpse* m, bool c) : mpse(m), to_server(c) { }
+
+        const Mpse* mpse;
+        bool to_server;
+        bool block = false;
+        Mpse::StreamState state;
+    };
+
+    FpStreamData(unsigned g) : FlowData(flow_data_id)
+    { gen = g; }
+
+    Entry& get_entry(const Mpse*, bool to_server);
+    unsigned get_mem(const Entry* except) const;
+
+    int search(Mpse*, bool to_server, unsigned cap,
+        const uint8_t* buf, unsigned len, MpseMatch, void*);
+
+    void skip(const Mpse*, bool to_server);
+
+    static void block(Entry&);
+
+public:
+    std::vector<Entry> entries;
+    unsigned gen;
+
+    static unsigned flow_data_id;
+};
+
+unsigned FpStreamData::flow_data_id = 0;
+
+FpStreamData::Entry& FpStreamData::get_entry(const Mpse* mpse, bool to_server)
+{
+    for ( auto& e : entries )
+    {
+        if ( e.mpse == mpse and e.to_server == to_server )
+            return e;
+    }
+    entries.emplace_back(mpse, to_server);
+    return entries.back();
+}
+
+unsigned FpStreamData::get_mem(const Entry* except) const
+{
+    unsigned mem = 0;
+
+    for ( const auto& e : entries )
+    {
+        if ( &e != except )
+            mem += e.state.data.capacity();
+    }
+    return mem;
+}
+
+// the rest of this direction is searched in block mode
+void FpStreamData::block(Entry& e)
+{
+    e.block = true;
+    std::vector<uint8_t>().swap(e.state.data);
+    pmqs.stream_fallbacks++;
+}
+
+int FpStreamData::search(
+    Mpse* so, bool to_server, unsigned cap,
+    const uint8_t* buf, unsigned len, MpseMatch mf, void* pv)
+{
+    Entry& e = get_entry(so, to_server);
+
+    if ( e.block )
+        return -1;
+
+    unsigned mem = get_mem(&e);
+
+    int found = so->search_stream(e.state, (mem < cap) ? cap - mem : 0, buf, len, mf, pv);
+
+    if ( found < 0 )
+    {
+        block(e);
+        return -1;
+    }
+
+    pmqs.stream_searches++;
+
+    // this PDU was searched; the next one can't continue from it
+    if ( e.state.full )
+        block(e);
+
+    return found;
+}
+
+// a PDU that was block searched or only partly searched leaves a gap so
+// the next one starts a new engine stream
+void FpStreamData::skip(const Mpse* so, bool to_server)
+{
+    for ( auto& e : entries )
+    {
+        if ( e.mpse == so and e.to_server == to_server )
+        {
+            std::vector<uint8_t>().swap(e.state.data);
+            e.state.offset = 0;
+            return;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// api
+//-------------------------------------------------------------------------
+
+// mpse pointers may be reused by a reload so flow data saved with the
+// engines of a prior config is recognized by generation and dropped
+static unsigned s_gen = 0;
+
+void fp_stream_init(FastPatternConfig* fp)
+{
+    if ( !FpStreamData::flow_data_id )
+        FpStreamData::flow_data_id = FlowData::create_flow_data_id();
+
+    fp->set_stream_gen(++s_gen);
+}
+
+int fp_stream_search(
+    Mpse* so, Packet* p, const uint8_t* buf, unsigned len, MpseMatch mf, void* pv)
+{
+    Flow* flow = p->flow;
+
+    // only reassembled payload continues where the prior PDU left off
+    if ( !flow or !(p->packet_flags & PKT_REBUILT_STREAM) or !so->can_stream() )
+        return -1;
+
+    FastPatternConfig* fp = SnortConfig::get_conf()->fast_pattern_config;
+    FpStreamData* fd = (FpStreamData*)flow->get_flow_data(FpStreamData::flow_data_id);
+
+    // once reassembly gives up on order the saved states can't be trusted
+    if ( flow->get_session_flags() & SSNFLAG_STREAM_ORDER_BAD )
+    {
+        if ( fd )
+        {
+            pmqs.stream_fallbacks += fd->entries.size();
+            flow->free_flow_data(fd);
+        }
+        return -1;
+    }
+
+    if ( !fd )
+    {
+        fd = new FpStreamData(fp->get_stream_gen());
+        flow->set_flow_data(fd);
+    }
+    else if ( fd->gen != fp->get_stream_gen() )
+    {
+        fd->entries.clear();
+        fd->gen = fp->get_stream_gen();
+    }
+
+    return fd->search(so, p->is_from_client(), fp->get_stream_memcap(), buf, len, mf, pv);
+}
+
+void fp_stream_skip(Mpse* so, Packet* p)
+{
+    Flow* flow = p->flow;
+
+    if ( !flow or !(p->packet_flags & PKT_REBUILT_STREAM) or !so->can_stream() )
+        return;
+
+    if ( FpStreamData* fd = (FpStreamData*)flow->get_flow_data(FpStreamData::flow_data_id) )
+        fd->skip(so, p->is_from_client());
+}
+
+
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+
+// finds "ab" and carries the last byte of each buffer as its state
+class StubStreamMpse : public Mpse
+{
+public:
+    StubStreamMpse() : Mpse("stub") { }
+
+    int add_pattern(SnortConfig*, const uint8_t*, unsigned, const PatternDescriptor&, void*)
+        override { return 0; }
+
+    int prep_patterns(SnortConfig*) override
+    { return 0; }
+
+    bool can_stream() override
+    { return true; }
+
+    int _search(const uint8_t*, int, MpseMatch, void*, int*) override
+    { return 0; }
+
+    int _search_stream(
+        StreamState& ss, unsigned, const uint8_t* buf, int n, MpseMatch, void*) override
+    {
+        int found = 0;
+        uint8_t prev = ss.data.empty() ? 0 : ss.data[0];
+
+        for ( int i = 0; i < n; ++i )
+        {
+            if ( prev == 'a' and buf[i] == 'b' )
+                ++found;
+            prev = buf[i];
+        }
+        ss.data.assign(1, prev);
+        ss.offset += n;
+        return found;
+    }
+};
+
+TEST_CASE("fp stream continues", "[FpStream]")
+{
+    StubStreamMpse mpse;
+    FpStreamData fd(1);
+
+    CHECK(fd.search(&mpse, true, 1024, (const uint8_t*)"xa", 2, nullptr, nullptr) == 0);
+    CHECK(fd.search(&mpse, true, 1024, (const uint8_t*)"bx", 2, nullptr, nullptr) == 1);
+    CHECK(fd.entries.size() == 1);
+    CHECK(fd.entries[0].state.offset == 4);
+
+    // directions are independent
+    CHECK(fd.search(&mpse, false, 1024, (const uint8_t*)"bx", 2, nullptr, nullptr) == 0);
+    CHECK(fd.entries.size() == 2);
+}
+
+TEST_CASE("fp stream skip", "[FpStream]")
+{
+    StubStreamMpse mpse;
+    FpStreamData fd(1);
+
+    CHECK(fd.search(&mpse, true, 1024, (const uint8_t*)"xa", 2, nullptr, nullptr) == 0);
+
+    // a truncated PDU was block searched so the next one can't continue
+    // from the one before it
+    fd.skip(&mpse, true);
+    CHECK(fd.entries[0].state.data.empty());
+    CHECK(fd.entries[0].state.offset == 0);
+    CHECK(!fd.entries[0].block);
+
+    CHECK(fd.search(&mpse, true, 1024, (const uint8_t*)"bxa", 3, nullptr, nullptr) == 0);
+    CHECK(fd.entries[0].state.offset == 3);
+    CHECK(fd.search(&mpse, true, 1024, (const uint8_t*)"b", 1, nullptr, nullptr) == 1);
+}
+
+#endif
@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// fp_stream.h
+
+#ifndef FP_STREAM_H
+#define FP_STREAM_H
+
+// stream searches let engines that support it (hyperscan) carry their
+// state from one reassembled PDU to the next instead of searching each PDU
+// from scratch, so patterns spanning PDUs are found.  the engine state is
+// saved compressed in flow data, one entry per mpse and direction, and is
+// bounded by search_engine.stream_memcap per flow.  anything that can't be
+// searched as a continuation of the prior PDU falls back to block mode.
+
+#include "framework/mpse.h"
+
+namespace snort
+{
+struct Packet;
+}
+class FastPatternConfig;
+
+// called on the main thread when building fast pattern detection
+void fp_stream_init(FastPatternConfig*);
+
+// returns -1 if the buffer must be searched with Mpse::search() instead
+int fp_stream_search(
+    snort::Mpse*, snort::Packet*, const uint8_t* buf, unsigned len, MpseMatch, void*);
+
+// called instead when a reassembled PDU isn't stream searched, eg because
+// it is truncated, so the next one doesn't continue across the gap
+void fp_stream_skip(snort::Mpse*, snort::Packet*);
+
+#endif
+
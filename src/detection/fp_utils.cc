@@ -36,6 +36,7 @@
 #include "catch/snort_catch.h"
 #endif
 
+#include "fp_profile.h"
 #include "pattern_match_data.h"
 #include "treenodes.h"
 
@@ -223,19 +224,21 @@ struct FpSelector
     CursorActionType cat;
     PatternMatchData* pmd;
     int size;
+    uint64_t noise;  // measured false triggers, see FpProfile::get_noise()
 
-    FpSelector(CursorActionType, PatternMatchData*);
+    FpSelector(CursorActionType, PatternMatchData*, uint64_t noise = 0);
 
     FpSelector()
-    { cat = CAT_NONE; pmd = nullptr; size = 0; }
+    { cat = CAT_NONE; pmd = nullptr; size = 0; noise = 0; }
 
     bool is_better_than(FpSelector&, bool srvc, RuleDirection, bool only_literals = false);
 };
 
-FpSelector::FpSelector(CursorActionType c, PatternMatchData* p)
+FpSelector::FpSelector(CursorActionType c, PatternMatchData* p, uint64_t n)
 {
     cat = c;
     pmd = p;
+    noise = n;
 
     // FIXIT-H unconditional trim is bad mkay? see fpGetFinalPattern
     size = flp_trim(pmd->pattern_buf, pmd->pattern_size, nullptr);
@@ -274,6 +277,13 @@ bool FpSelector::is_better_than(
     if ( !pmd->is_negated() && rhs.pmd->is_negated() )
         return true;
 
+    // a positive content measured to trigger the rule often without a
+    // match loses to any other positive content; between two such the
+    // quieter one wins.  a negated content is never preferred for this
+    // since it would put the rule on the negated list.
+    if ( noise != rhs.noise and !pmd->is_negated() and !rhs.pmd->is_negated() )
+        return noise < rhs.noise;
+
     if ( size > rhs.size )
         return true;
 
@@ -285,10 +295,12 @@ bool FpSelector::is_better_than(
 //--------------------------------------------------------------------------
 
 PatternMatchVector get_fp_content(
-    OptTreeNode* otn, OptFpList*& next, bool srvc, bool only_literals, bool& exclude)
+    OptTreeNode* otn, OptFpList*& next, bool srvc, bool only_literals, bool& exclude,
+    FpProfile* prof)
 {
     CursorActionType curr_cat = CAT_SET_RAW;
     FpSelector best;
+    FpSelector plain;  // best without the profile
     bool content = false;
     bool fp_only = true;
     PatternMatchVector pmds;
@@ -319,7 +331,15 @@ PatternMatchVector get_fp_content(
 
         tmp->pm_type = get_pm_type(curr_cat);
 
-        FpSelector curr(curr_cat, tmp);
+        FpSelector curr(curr_cat, tmp, prof ? prof->get_noise(otn, tmp) : 0);
+
+        if ( prof )
+        {
+            FpSelector curr_plain(curr_cat, tmp);
+
+            if ( curr_plain.is_better_than(plain, srvc, dir, only_literals) )
+                plain = curr_plain;
+        }
 
         if ( curr.is_better_than(best, srvc, dir, only_literals) )
         {
@@ -335,6 +355,9 @@ PatternMatchVector get_fp_content(
         }
     }
 
+    if ( prof and best.pmd )
+        prof->set_fp(otn, best.pmd, plain.pmd);
+
     if ( best.pmd and best.cat != CAT_SET_RAW and !srvc and otn->sigInfo.num_services > 0 )
     {
         pmds.clear();  // just include in service group
@@ -505,6 +528,43 @@ TEST_CASE("fp_cat3", "[FastPatternSelect]")
     CHECK(!s0.is_better_than(s1, true, RULE_WO_DIR));
 }
 
+TEST_CASE("fp_noise", "[FastPatternSelect]")
+{
+    PatternMatchData p0;
+    set_pmd(p0, 0x0, "longer");
+    FpSelector s0(CAT_SET_HEADER, &p0, 500);
+
+    PatternMatchData p1;
+    set_pmd(p1, 0x0, "short");
+    FpSelector s1(CAT_SET_HEADER, &p1);
+
+    CHECK(s1.is_better_than(s0, false, RULE_WO_DIR));
+    CHECK(!s0.is_better_than(s1, false, RULE_WO_DIR));
+
+    s1.noise = 1000;
+    CHECK(s0.is_better_than(s1, false, RULE_WO_DIR));
+
+    // explicit fast_pattern still wins
+    p0.set_fast_pattern();
+    s0.noise = 2000;
+    CHECK(s0.is_better_than(s1, false, RULE_WO_DIR));
+}
+
+TEST_CASE("fp_noise_negated", "[FastPatternSelect]")
+{
+    PatternMatchData p0;
+    set_pmd(p0, 0x0, "noisy");
+    FpSelector s0(CAT_SET_HEADER, &p0, 500);
+
+    PatternMatchData p1;
+    set_pmd(p1, 0x1, "short");
+    FpSelector s1(CAT_SET_HEADER, &p1);
+
+    // a noisy positive content is still better than a negated one
+    CHECK(s0.is_better_than(s1, false, RULE_WO_DIR));
+    CHECK(!s1.is_better_than(s0, false, RULE_WO_DIR));
+}
+
 TEST_CASE("fp_size", "[FastPatternSelect]")
 {
     PatternMatchData p0;
@@ -25,6 +25,7 @@
 #include <vector>
 #include "framework/ips_option.h"
 
+class FpProfile;
 struct OptFpList;
 struct OptTreeNode;
 
@@ -35,8 +36,11 @@ void validate_fast_pattern(OptTreeNode*);
 int flp_trim(const char* p, int plen, const char** buff);
 bool set_fp_content(OptTreeNode*);
 
+// with a profile, contents measured to be noisy are avoided and the
+// selection is recorded in the profile
 std::vector <PatternMatchData*> get_fp_content(
-    OptTreeNode*, OptFpList*&, bool srvc, bool only_literals, bool& exclude);
+    OptTreeNode*, OptFpList*&, bool srvc, bool only_literals, bool& exclude,
+    FpProfile* = nullptr);
 
 #endif
 
@@ -24,11 +24,15 @@
 
 #include "ips_context.h"
 
+#include <algorithm>
 #include <cassert>
+
 #include "events/event_queue.h"
 #include "events/sfeventq.h"
 #include "main/snort_config.h"
+#include "profiler/profiler_defs.h"
 
+#include "detect.h"
 #include "fp_detect.h"
 
 #ifdef UNIT_TEST
@@ -56,8 +60,11 @@ unsigned IpsContextData::get_max_id()
 //--------------------------------------------------------------------------
 
 IpsContext::IpsContext(unsigned size) :
-    data(size ? size : IpsContextData::get_max_id() + 1, nullptr)
+    data(size ? size : IpsContextData::get_max_id() + 1, nullptr),
+    data_use(data.size(), 0)
 {
+    touched.reserve(data.size());
+
     packet = new Packet(false);
     encode_packet = nullptr;
 
@@ -93,24 +100,50 @@ IpsContext::~IpsContext()
     delete packet;
 }
 
+void IpsContext::touch(unsigned id) const
+{
+    if ( data_use[id] != use )
+    {
+        data_use[id] = use;
+        touched.push_back(id);
+    }
+}
+
 void IpsContext::set_context_data(unsigned id, IpsContextData* cd)
 {
     assert(id < data.size());
     data[id] = cd;
+
+    if ( cd )
+        touch(id);
 }
 
 IpsContextData* IpsContext::get_context_data(unsigned id) const
 {
     assert(id < data.size());
+
+    if ( data[id] )
+        touch(id);
+
     return data[id];
 }
 
+// data left alone since the last clear is still clear
 void IpsContext::clear_context_data()
 {
-    for ( auto* p : data )
+    Profile profile(contextPerfStats);
+
+    for ( auto id : touched )
     {
-        if ( p )
-            p->clear();
+        if ( data[id] )
+            data[id]->clear();
+    }
+    touched.clear();
+
+    if ( !++use )
+    {
+        std::fill(data_use.begin(), data_use.end(), 0);
+        use = 1;
     }
 }
 
@@ -134,6 +167,10 @@ public:
     ~TestData() override
     { --count; }
 
+    void clear() override
+    { ++clears; }
+
+    unsigned clears = 0;
     static int count;
 };
 
@@ -187,5 +224,39 @@ TEST_CASE("IpsContext basic", "[IpsContext]")
     }
     CHECK(TestData::count == num_data);
 }
+
+TEST_CASE("IpsContext clear", "[IpsContext]")
+{
+    ips_id = 0;
+    IpsContext ctx(4);
+
+    auto id1 = IpsContextData::get_ips_id();
+    auto* d1 = new TestData;
+    ctx.set_context_data(id1, d1);
+
+    auto id2 = IpsContextData::get_ips_id();
+    auto* d2 = new TestData;
+    ctx.set_context_data(id2, d2);
+
+    // both were set in the first use
+    ctx.clear_context_data();
+    CHECK(d1->clears == 1);
+    CHECK(d2->clears == 1);
+
+    SECTION("untouched")
+    {
+        ctx.clear_context_data();
+        CHECK(d1->clears == 1);
+        CHECK(d2->clears == 1);
+    }
+    SECTION("touched once")
+    {
+        CHECK(ctx.get_context_data(id2) == d2);
+        CHECK(ctx.get_context_data(id2) == d2);
+        ctx.clear_context_data();
+        CHECK(d1->clears == 1);
+        CHECK(d2->clears == 2);
+    }
+}
 #endif
 
@@ -23,7 +23,9 @@
 
 // IpsContext provides access to all the state required for detection of a
 // single packet.  the state is stored in IpsContextData instances, which
-// are accessed by id.
+// are accessed by id.  contexts are pooled per packet thread by the
+// ContextSwitcher and reset lazily between uses: only the data gotten or
+// set during a use is cleared when it completes.
 
 #include "main/snort_types.h"
 #include "framework/codec.h"
@@ -76,6 +78,8 @@ public:
 
     void set_context_data(unsigned id, IpsContextData*);
     IpsContextData* get_context_data(unsigned id) const;
+
+    // clears the data used since the last clear
     void clear_context_data();
 
     void set_slot(unsigned s)
@@ -118,9 +122,20 @@ public:
 
     static const unsigned buf_size = Codec::PKT_MAX;
 
+private:
+    void touch(unsigned id) const;
+
 private:
     FlowSnapshot flow;
     std::vector<IpsContextData*> data;
+
+    // ids of the data used since the last clear.  an id is listed once
+    // per use by tagging it with the use number; starting a new use just
+    // bumps the number.
+    mutable std::vector<unsigned> touched;
+    mutable std::vector<unsigned> data_use;
+    unsigned use = 1;
+
     unsigned slot;
 };
 }
@@ -81,6 +81,7 @@ void Flow::term()
         delete session;
 
     free_flow_data();
+    free_flow_data_slots();
 
     if ( mpls_client.length )
         delete[] mpls_client.start;
@@ -211,13 +212,40 @@ void Flow::clear(bool dump_flow_data)
         clear_gadget();
 }
 
+// grows the overflow array as needed; ids are normally all assigned at
+// startup so this allocates at most once per flow
+FlowData** Flow::get_flow_data_slot(unsigned id)
+{
+    if ( id < FLOW_DATA_INLINE )
+        return fd_inline + id;
+
+    id -= FLOW_DATA_INLINE;
+
+    if ( id >= num_fd_slots )
+    {
+        unsigned max = FlowData::get_max_id() + 1 - FLOW_DATA_INLINE;
+        unsigned n = (id < max) ? max : id + 1;
+
+        FlowData** slots = (FlowData**)snort_calloc(n, sizeof(*slots));
+
+        if ( fd_slots )
+        {
+            memcpy(slots, fd_slots, num_fd_slots * sizeof(*slots));
+            snort_free(fd_slots);
+        }
+        fd_slots = slots;
+        num_fd_slots = n;
+    }
+    return fd_slots + id;
+}
+
 int Flow::set_flow_data(FlowData* fd)
 {
-    FlowData* old = get_flow_data(fd->get_id());
-    assert(old != fd);
+    FlowData** slot = get_flow_data_slot(fd->get_id());
+    assert(*slot != fd);
 
-    if (old)
-        free_flow_data(old);
+    if ( *slot )
+        free_flow_data(*slot);
 
     fd->prev = nullptr;
     fd->next = flow_data;
@@ -226,26 +254,24 @@ int Flow::set_flow_data(FlowData* fd)
         flow_data->prev = fd;
 
     flow_data = fd;
+    *slot = fd;
     return 0;
 }
 
 FlowData* Flow::get_flow_data(unsigned id) const
 {
-    FlowData* fd = flow_data;
+    if ( id < FLOW_DATA_INLINE )
+        return fd_inline[id];
 
-    while (fd)
-    {
-        if (fd->get_id() == id)
-            return fd;
-
-        fd = fd->next;
-    }
-    return nullptr;
+    id -= FLOW_DATA_INLINE;
+    return (id < num_fd_slots) ? fd_slots[id] : nullptr;
 }
 
 // FIXIT-L: implement doubly linked list with STL to cut down on code we maintain
 void Flow::free_flow_data(FlowData* fd)
 {
+    *get_flow_data_slot(fd->get_id()) = nullptr;
+
     if ( fd == flow_data )
     {
         flow_data = fd->next;
@@ -280,11 +306,22 @@ void Flow::free_flow_data()
     {
         FlowData* tmp = fd;
         fd = fd->next;
+        *get_flow_data_slot(tmp->get_id()) = nullptr;
         delete tmp;
     }
     flow_data = nullptr;
 }
 
+void Flow::free_flow_data_slots()
+{
+    if ( fd_slots )
+    {
+        snort_free(fd_slots);
+        fd_slots = nullptr;
+        num_fd_slots = 0;
+    }
+}
+
 void Flow::call_handlers(Packet* p, bool eof)
 {
     FlowData* fd = flow_data;
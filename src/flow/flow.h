@@ -91,6 +91,10 @@
 #define STREAM_STATE_NO_PICKUP         0x2000
 #define STREAM_STATE_BLOCK_PENDING     0x4000
 
+// FlowData ids are assigned densely at startup; the first few are looked up
+// directly in the flow and the rest in a per flow array sized on first use
+#define FLOW_DATA_INLINE 8
+
 #define FLOW_IS_OFFLOADED              0x01
 #define FLOW_WAS_OFFLOADED             0x02  // FIXIT-L debug only
 
@@ -117,6 +121,9 @@ public:
     static unsigned create_flow_data_id()
     { return ++flow_data_id; }
 
+    static unsigned get_max_id()
+    { return flow_data_id; }
+
     virtual void handle_expected(Packet*) { }
     virtual void handle_retransmit(Packet*) { }
     virtual void handle_eof(Packet*) { }
@@ -171,6 +178,7 @@ public:
     void free_flow_data(uint32_t proto);
     void free_flow_data(FlowData*);
     void free_flow_data();
+    void free_flow_data_slots();
 
     void call_handlers(Packet* p, bool eof = false);
     void markup_packet_flags(Packet*);
@@ -313,14 +321,22 @@ public:  // FIXIT-M privatize if possible
     // these fields are always set; not zeroed
     uint64_t flow_flags;  // FIXIT-H required to ensure atomic?
     Flow* prev, * next;
+    Flow* wheel_prev, * wheel_next;  // FlowCache timeout wheel
     Inspector* ssn_client;
     Inspector* ssn_server;
 
     long last_data_seen;
+    time_t wheel_due;
+    uint16_t wheel_slot;
     Layer mpls_client, mpls_server;
 
+    // FlowData with ids past the inline slots; kept across reuse
+    FlowData** fd_slots;
+    unsigned num_fd_slots;
+
     // everything from here down is zeroed
-    FlowData* flow_data;
+    FlowData* flow_data;  // list of all FlowData for iteration and cleanup
+    FlowData* fd_inline[FLOW_DATA_INLINE];  // indexed by id
     Inspector* clouseau;  // service identifier
     Inspector* gadget;    // service handler
     Inspector* data;
@@ -352,6 +368,7 @@ public:  // FIXIT-M privatize if possible
 
 private:
     void clean();
+    FlowData** get_flow_data_slot(unsigned id);
 };
 
 inline void Flow::set_to_client_detection(bool enable)
@@ -144,6 +144,9 @@ Flow* FlowCache::get(const FlowKey* key)
 
     flow->last_data_seen = timestamp;
 
+    wheel.advance(timestamp);
+    wheel.arm(flow, timestamp + get_timeout(flow));
+
     return flow;
 }
 
@@ -159,6 +162,8 @@ int FlowCache::remove(Flow* flow)
     if ( flow->next )
         unlink_uni(flow);
 
+    wheel.disarm(flow);
+
     return hash_table->remove(flow->key);
 }
 
@@ -292,36 +297,78 @@ bool FlowCache::prune_one(PruneReason reason, bool do_cleanup)
     return true;
 }
 
+unsigned FlowCache::get_timeout(Flow* flow) const
+{
+    if ( config.closed_timeout and ((flow->session_state & STREAM_STATE_CLOSED) or
+        (flow->ssn_state.session_flags & SSNFLAG_RESET)) )
+        return config.closed_timeout;
+
+    if ( config.half_open_timeout and !flow->two_way_traffic() )
+        return config.half_open_timeout;
+
+    return config.nominal_timeout;
+}
+
+// deadlines only move later on the packet path (last_data_seen) so armed
+// times are a lower bound and are fixed up lazily when they come due.
+// here we only need to catch a state change that shortens the timeout.
+void FlowCache::update_timeout(Flow* flow)
+{
+    if ( !FlowWheel::is_armed(flow) )
+        return;
+
+    time_t due = flow->last_data_seen + get_timeout(flow);
+
+    if ( due < flow->wheel_due )
+        wheel.arm(flow, due);
+}
+
 unsigned FlowCache::timeout(unsigned num_flows, time_t thetime)
 {
     // FIXIT-H should Active be suspended here too?
     unsigned retired = 0;
+    unsigned checked = 0;
 
-    auto flow = static_cast<Flow*>(hash_table->current());
+    wheel.advance(thetime);
+    ++timeout_stats.ticks;
 
-    if ( !flow )
-        flow = static_cast<Flow*>(hash_table->first());
-
-    while ( flow and (retired < num_flows) )
+    // anything left on the due list is picked up next time
+    while ( retired < num_flows and checked < max_timeout_checks )
     {
-        if ( flow->last_data_seen + config.nominal_timeout > thetime )
+        Flow* flow = wheel.pop_due();
+
+        if ( !flow )
             break;
 
+        time_t due = flow->last_data_seen + get_timeout(flow);
+
+        // rearming a flow that saw traffic since it was armed is cheap and
+        // doesn't count toward the limit or a full due list would starve
+        // the flows that actually expired
+        if ( due > thetime )
+        {
+            wheel.arm(flow, due);
+            continue;
+        }
+
+        ++checked;
+
         if ( HighAvailabilityManager::in_standby(flow) or
             flow->is_offloaded() )
         {
-            flow = static_cast<Flow*>(hash_table->next());
+            wheel.arm(flow, thetime + get_timeout(flow));
             continue;
         }
 
+        timeout_stats.lag += thetime - due;
+
         flow->ssn_state.session_flags |= SSNFLAG_TIMEDOUT;
         release(flow, PruneReason::IDLE);
 
         ++retired;
-
-        flow = static_cast<Flow*>(hash_table->current());
     }
 
+    timeout_stats.checks += checked;
     return retired;
 }
 
@@ -29,6 +29,7 @@
 #include <type_traits>
 
 #include "flow_config.h"
+#include "flow_wheel.h"
 #include "prune_stats.h"
 
 namespace snort
@@ -59,6 +60,9 @@ public:
     bool prune_one(PruneReason, bool do_cleanup);
     unsigned timeout(unsigned num_flows, time_t cur_time);
 
+    // call after each packet so a shorter state timeout takes effect
+    void update_timeout(snort::Flow*);
+
     unsigned purge();
     unsigned get_count();
 
@@ -71,17 +75,38 @@ public:
     PegCount get_prunes(PruneReason reason) const
     { return prune_stats.get(reason); }
 
+    PegCount get_timeout_ticks() const
+    { return timeout_stats.ticks; }
+
+    PegCount get_timeout_checks() const
+    { return timeout_stats.checks; }
+
+    PegCount get_timeout_lag() const
+    { return timeout_stats.lag; }
+
     void reset_stats()
-    { prune_stats = PruneStats(); }
+    {
+        prune_stats = PruneStats();
+        timeout_stats = TimeoutStats();
+    }
 
     void unlink_uni(snort::Flow*);
 
 private:
     void link_uni(snort::Flow*);
     int remove(snort::Flow*);
+    unsigned get_timeout(snort::Flow*) const;
 
 private:
+    struct TimeoutStats
+    {
+        PegCount ticks = 0;   // calls to timeout()
+        PegCount checks = 0;  // flows found due and checked for expiry
+        PegCount lag = 0;     // seconds past deadline when retired
+    };
+
     static const unsigned cleanup_flows = 1;
+    static const unsigned max_timeout_checks = 64;
     const FlowConfig config;
     unsigned uni_count;
     uint32_t flags;
@@ -89,6 +114,8 @@ private:
     class ZHash* hash_table;
     snort::Flow* uni_head, * uni_tail;
     PruneStats prune_stats;
+    TimeoutStats timeout_stats;
+    FlowWheel wheel;
 };
 
 #endif
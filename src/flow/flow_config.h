@@ -28,6 +28,10 @@ struct FlowConfig
     unsigned max_sessions = 0;
     unsigned pruning_timeout = 0;
     unsigned nominal_timeout = 0;
+
+    // 0 means use nominal_timeout
+    unsigned half_open_timeout = 0;
+    unsigned closed_timeout = 0;
 };
 
 #endif
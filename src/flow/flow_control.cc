@@ -25,6 +25,7 @@
 #include "detection/detection_engine.h"
 #include "main/snort_config.h"
 #include "managers/inspector_manager.h"
+#include "memory/huge_arena.h"
 #include "memory/memory_cap.h"
 #include "packet_io/active.h"
 #include "protocols/icmp4.h"
@@ -48,8 +49,14 @@ FlowControl::~FlowControl()
 
     for ( int i = 0; i < to_utype(PktType::MAX); ++i )
     {
+        unsigned n = proto[i].cache ? proto[i].cache->get_max_flows() : 0;
         delete proto[i].cache;
-        snort_free(proto[i].mem);
+
+        // released flows keep their FlowData slots for reuse
+        for ( unsigned j = 0; j < n; ++j )
+            proto[i].mem[j].free_flow_data_slots();
+
+        memory::HugeArena::deallocate(proto[i].mem);
     }
     delete exp_cache;
 }
@@ -70,6 +77,24 @@ PegCount FlowControl::get_prunes(PktType type, PruneReason reason) const
     return cache ? cache->get_prunes(reason) : 0;
 }
 
+PegCount FlowControl::get_timeout_ticks(PktType type) const
+{
+    auto cache = get_cache(type);
+    return cache ? cache->get_timeout_ticks() : 0;
+}
+
+PegCount FlowControl::get_timeout_checks(PktType type) const
+{
+    auto cache = get_cache(type);
+    return cache ? cache->get_timeout_checks() : 0;
+}
+
+PegCount FlowControl::get_timeout_lag(PktType type) const
+{
+    auto cache = get_cache(type);
+    return cache ? cache->get_timeout_lag() : 0;
+}
+
 void FlowControl::clear_counts()
 {
     for ( int i = 0; i < to_utype(PktType::MAX); ++i )
@@ -325,7 +350,7 @@ void FlowControl::init_proto(
     auto& con = proto[to_utype(type)];
 
     con.cache = new FlowCache(fc);
-    con.mem = (Flow*)snort_calloc(fc.max_sessions, sizeof(Flow));
+    con.mem = (Flow*)memory::HugeArena::allocate(fc.max_sessions * sizeof(Flow));
 
     for ( unsigned i = 0; i < fc.max_sessions; ++i )
         con.cache->push(con.mem + i);
@@ -382,6 +407,7 @@ bool FlowControl::process(PktType type, Packet* p)
     }
 
     con.num_flows += process(flow, p);
+    con.cache->update_timeout(flow);
 
     // FIXIT-M refactor to unlink_uni immediately after session
     // is processed by inspector manager (all flows)
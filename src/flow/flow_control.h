@@ -88,6 +88,10 @@ public:
     PegCount get_total_prunes(PktType) const;
     PegCount get_prunes(PktType, PruneReason) const;
 
+    PegCount get_timeout_ticks(PktType) const;
+    PegCount get_timeout_checks(PktType) const;
+    PegCount get_timeout_lag(PktType) const;
+
     void clear_counts();
 
 private:
@@ -0,0 +1,189 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+
+// flow_wheel.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "flow_wheel.h"
+
+#include <cassert>
+
+#include "flow.h"
+
+using namespace snort;
+
+FlowWheel::FlowWheel()
+{
+    for ( auto& h : heads )
+        h = nullptr;
+
+    wheel_time = 0;
+    count = 0;
+}
+
+bool FlowWheel::is_armed(const Flow* flow)
+{ return flow->wheel_slot != 0; }
+
+// slots are stored off by one so that zeroed flows are not armed
+void FlowWheel::link(Flow* flow, unsigned slot)
+{
+    flow->wheel_prev = nullptr;
+    flow->wheel_next = heads[slot];
+
+    if ( heads[slot] )
+        heads[slot]->wheel_prev = flow;
+
+    heads[slot] = flow;
+    flow->wheel_slot = slot + 1;
+    ++count;
+}
+
+void FlowWheel::unlink(Flow* flow)
+{
+    if ( flow->wheel_prev )
+        flow->wheel_prev->wheel_next = flow->wheel_next;
+    else
+        heads[flow->wheel_slot - 1] = flow->wheel_next;
+
+    if ( flow->wheel_next )
+        flow->wheel_next->wheel_prev = flow->wheel_prev;
+
+    flow->wheel_prev = flow->wheel_next = nullptr;
+    flow->wheel_slot = 0;
+    --count;
+}
+
+unsigned FlowWheel::get_slot(time_t due) const
+{
+    if ( due <= wheel_time )
+        due = wheel_time + 1;
+
+    // beyond the top level; park it where it will be looked at again
+    if ( due - wheel_time >= span )
+        due = wheel_time + span - 1;
+
+    time_t delta = due - wheel_time;
+    unsigned level = 0;
+
+    while ( level < levels - 1 and delta >= ((time_t)1 << (bits * (level + 1))) )
+        ++level;
+
+    return level * slots + ((due >> (bits * level)) & mask);
+}
+
+void FlowWheel::arm(Flow* flow, time_t due)
+{
+    if ( is_armed(flow) )
+        unlink(flow);
+
+    flow->wheel_due = due;
+    link(flow, get_slot(due));
+}
+
+void FlowWheel::disarm(Flow* flow)
+{
+    if ( is_armed(flow) )
+        unlink(flow);
+}
+
+// redistribute one upper level bucket against the current wheel time
+void FlowWheel::cascade(unsigned slot)
+{
+    Flow* flow = heads[slot];
+
+    while ( flow )
+    {
+        Flow* next = flow->wheel_next;
+        unlink(flow);
+        link(flow, get_slot(flow->wheel_due));
+        flow = next;
+    }
+}
+
+// everything comes due; the cache recomputes the real deadlines
+void FlowWheel::flush()
+{
+    for ( unsigned slot = 0; slot < due_slot; ++slot )
+    {
+        while ( Flow* flow = heads[slot] )
+        {
+            unlink(flow);
+            link(flow, due_slot);
+        }
+    }
+}
+
+void FlowWheel::advance(time_t now)
+{
+    if ( now <= wheel_time )
+    {
+        if ( wheel_time - now <= max_skew )
+            return;
+
+        flush();
+        wheel_time = now;
+        return;
+    }
+
+    if ( !wheel_time or now - wheel_time >= span )
+    {
+        flush();
+        wheel_time = now;
+        return;
+    }
+
+    while ( wheel_time < now )
+    {
+        time_t t = ++wheel_time;
+
+        if ( !count )
+        {
+            wheel_time = now;
+            break;
+        }
+
+        for ( unsigned level = levels - 1; level > 0; --level )
+        {
+            if ( !(t & (((time_t)1 << (bits * level)) - 1)) )
+                cascade(level * slots + ((t >> (bits * level)) & mask));
+        }
+
+        unsigned slot = t & mask;
+
+        while ( Flow* flow = heads[slot] )
+        {
+            unlink(flow);
+            link(flow, due_slot);
+        }
+    }
+}
+
+Flow* FlowWheel::pop_due()
+{
+    Flow* flow = heads[due_slot];
+
+    if ( flow )
+        unlink(flow);
+
+    return flow;
+}
+
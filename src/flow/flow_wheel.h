@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// flow_wheel.h
+
+#ifndef FLOW_WHEEL_H
+#define FLOW_WHEEL_H
+
+// hierarchical timer wheel used by FlowCache to find idle flows without
+// walking the whole cache.  each level has 64 buckets; level 0 buckets are
+// 1 second wide, level 1 are 64 seconds and level 2 are 4096 seconds.
+// flows are linked through their wheel_* fields so arming and disarming
+// are O(1) and no memory is allocated.  when a level 0 bucket comes due its
+// flows move to the due list where the cache decides whether they really
+// expired (deadlines are only a lower bound; see FlowCache::timeout).
+
+#include <cstdint>
+#include <ctime>
+
+namespace snort
+{
+class Flow;
+}
+
+class FlowWheel
+{
+public:
+    FlowWheel();
+
+    FlowWheel(const FlowWheel&) = delete;
+    FlowWheel& operator=(const FlowWheel&) = delete;
+
+    // (re)arm flow to come due at the given time; times at or before the
+    // current wheel time come due on the next tick
+    void arm(snort::Flow*, time_t due);
+    void disarm(snort::Flow*);
+
+    static bool is_armed(const snort::Flow*);
+
+    // move the wheel forward to now, putting expired buckets on the due list
+    void advance(time_t now);
+
+    // take the next flow off the due list; nullptr when there is none
+    snort::Flow* pop_due();
+
+    time_t get_time() const
+    { return wheel_time; }
+
+    unsigned get_count() const
+    { return count; }
+
+private:
+    static const unsigned bits = 6;
+    static const unsigned slots = 1 << bits;
+    static const unsigned mask = slots - 1;
+    static const unsigned levels = 3;
+    static const unsigned due_slot = levels * slots;
+    static const time_t span = (time_t)1 << (bits * levels);
+
+    // larger backward steps (eg packet time vs wall clock) restart the wheel
+    static const time_t max_skew = 60;
+
+    void link(snort::Flow*, unsigned slot);
+    void unlink(snort::Flow*);
+    void cascade(unsigned slot);
+    void flush();
+    unsigned get_slot(time_t due) const;
+
+private:
+    snort::Flow* heads[due_slot + 1];
+    time_t wheel_time;
+    unsigned count;
+};
+
+#endif
+
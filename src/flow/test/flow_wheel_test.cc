@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+
+// flow_wheel_test.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "flow/flow.h"
+#include "flow/flow_wheel.h"
+
+#include <cstdlib>
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+using namespace snort;
+
+// flows are preallocated zeroed memory, as in FlowControl
+static const unsigned num_flows = 8;
+
+TEST_GROUP(flow_wheel)
+{
+    Flow* flows = nullptr;
+    FlowWheel* wheel = nullptr;
+
+    void setup() override
+    {
+        flows = (Flow*)calloc(num_flows, sizeof(Flow));
+        wheel = new FlowWheel;
+        wheel->advance(100000);
+    }
+
+    void teardown() override
+    {
+        delete wheel;
+        free(flows);
+    }
+
+    unsigned drain()
+    {
+        unsigned n = 0;
+
+        while ( wheel->pop_due() )
+            ++n;
+
+        return n;
+    }
+};
+
+TEST(flow_wheel, unarmed)
+{
+    CHECK(!FlowWheel::is_armed(flows));
+    CHECK(wheel->pop_due() == nullptr);
+}
+
+TEST(flow_wheel, due_on_time)
+{
+    time_t now = wheel->get_time();
+
+    wheel->arm(flows, now + 30);
+    wheel->arm(flows + 1, now + 3600);
+    wheel->arm(flows + 2, now + 90000);
+
+    CHECK(FlowWheel::is_armed(flows));
+    CHECK(wheel->get_count() == 3);
+
+    wheel->advance(now + 29);
+    CHECK(wheel->pop_due() == nullptr);
+
+    wheel->advance(now + 30);
+    CHECK(wheel->pop_due() == flows);
+    CHECK(!FlowWheel::is_armed(flows));
+
+    wheel->advance(now + 3599);
+    CHECK(wheel->pop_due() == nullptr);
+
+    wheel->advance(now + 3600);
+    CHECK(wheel->pop_due() == flows + 1);
+
+    wheel->advance(now + 89999);
+    CHECK(wheel->pop_due() == nullptr);
+
+    wheel->advance(now + 90000);
+    CHECK(wheel->pop_due() == flows + 2);
+    CHECK(wheel->get_count() == 0);
+}
+
+TEST(flow_wheel, disarm_and_rearm)
+{
+    time_t now = wheel->get_time();
+
+    wheel->arm(flows, now + 10);
+    wheel->arm(flows + 1, now + 10);
+    wheel->arm(flows + 2, now + 10);
+
+    wheel->disarm(flows + 1);
+    wheel->arm(flows + 2, now + 5);
+
+    wheel->advance(now + 5);
+    CHECK(wheel->pop_due() == flows + 2);
+    CHECK(wheel->pop_due() == nullptr);
+
+    wheel->advance(now + 10);
+    CHECK(wheel->pop_due() == flows);
+    CHECK(wheel->pop_due() == nullptr);
+}
+
+TEST(flow_wheel, past_due)
+{
+    time_t now = wheel->get_time();
+
+    wheel->arm(flows, now - 10);
+    CHECK(wheel->pop_due() == nullptr);
+
+    wheel->advance(now + 1);
+    CHECK(wheel->pop_due() == flows);
+}
+
+TEST(flow_wheel, beyond_span)
+{
+    time_t now = wheel->get_time();
+    time_t due = now + 1000000;
+
+    // parked in the top level and cascaded again until in range
+    wheel->arm(flows, due);
+
+    for ( time_t t = now + 1000; t < due; t += 1000 )
+    {
+        wheel->advance(t);
+        CHECK(wheel->pop_due() == nullptr);
+    }
+    wheel->advance(due);
+    CHECK(wheel->pop_due() == flows);
+}
+
+TEST(flow_wheel, clock_jumps)
+{
+    time_t now = wheel->get_time();
+
+    for ( unsigned i = 0; i < num_flows; ++i )
+        wheel->arm(flows + i, now + 100 + i);
+
+    // small skew is ignored
+    wheel->advance(now - 1);
+    CHECK(drain() == 0);
+
+    // large jumps in either direction make everything due
+    wheel->advance(now - 1000);
+    CHECK(drain() == num_flows);
+
+    for ( unsigned i = 0; i < num_flows; ++i )
+        wheel->arm(flows + i, wheel->get_time() + 100 + i);
+
+    wheel->advance(wheel->get_time() + 1000000);
+    CHECK(drain() == num_flows);
+    CHECK(wheel->get_count() == 0);
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
+
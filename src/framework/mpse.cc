@@ -41,6 +41,7 @@ Mpse::Mpse(const char* m)
 {
     method = m;
     verbose = 0;
+    ref_count = 1;
     api = nullptr;
 }
 
@@ -57,6 +58,19 @@ int Mpse::search(
     return ret;
 }
 
+int Mpse::search_stream(
+    StreamState& ss, unsigned max, const uint8_t* T, int n, MpseMatch match, void* context)
+{
+    Profile profile(mpsePerfStats);
+
+    int ret = _search_stream(ss, max, T, n, match, context);
+
+    if ( ret >= 0 )
+        pmqs.matched_bytes += n;
+
+    return ret;
+}
+
 int Mpse::search_all(
     const unsigned char* T, int n, MpseMatch match,
     void* context, int* current_state)
@@ -25,6 +25,7 @@
 // machine from the patterns, and search a buffer for patterns.
 
 #include <string>
+#include <vector>
 
 #include "framework/base_api.h"
 #include "main/snort_types.h"
@@ -34,7 +35,7 @@
 namespace snort
 {
 // this is the current version of the api
-#define SEAPI_VERSION ((BASE_API_VERSION << 16) | 0)
+#define SEAPI_VERSION ((BASE_API_VERSION << 16) | 3)
 
 struct SnortConfig;
 struct MpseApi;
@@ -63,12 +64,45 @@ public:
 
     virtual int prep_patterns(SnortConfig*) = 0;
 
+    // engines that can compile off the main thread split prep_patterns()
+    // into build(), which may run concurrently with other instances and
+    // must not touch shared detection state, and finish(), which always
+    // runs on the main thread and builds the rule trees via the agent.
+    virtual bool can_build_concurrently() { return false; }
+    virtual int build() { return -1; }
+    virtual int finish(SnortConfig*) { return -1; }
+
     int search(
         const uint8_t* T, int n, MpseMatch, void* context, int* current_state);
 
     virtual int search_all(
         const uint8_t* T, int n, MpseMatch, void* context, int* current_state);
 
+    // stream search carries engine state from one buffer to the next so
+    // that each byte is searched once and matches spanning buffers are
+    // found.  the state is saved between calls by the caller, typically in
+    // flow data; offset counts the bytes searched since the engine stream
+    // started and full is set when the state can't be saved, because it
+    // needed more than the allowed bytes or the match callback stopped the
+    // search, in which case the state is dropped.
+    struct StreamState
+    {
+        std::vector<uint8_t> data;
+        uint64_t offset = 0;
+        bool full = false;
+    };
+
+    // called before build() on engines that will be asked to search
+    // streams; can_stream() is true after the build if they can
+    virtual void enable_stream() { }
+    virtual bool can_stream() { return false; }
+
+    // like search() for the next buffer of a stream; matches are reported
+    // relative to T including those that started in earlier buffers.
+    // returns -1 if the engine can't stream.
+    int search_stream(
+        StreamState&, unsigned max, const uint8_t* T, int n, MpseMatch, void* context);
+
     virtual void set_opt(int) { }
     virtual int print_info() { return 0; }
     virtual int get_pattern_count() { return 0; }
@@ -79,15 +113,25 @@ public:
     void set_api(const MpseApi* p) { api = p; }
     const MpseApi* get_api() { return api; }
 
+    // port groups with identical fast pattern sets share one instance;
+    // the last group to release it deletes it
+    void add_ref() { ++ref_count; }
+    unsigned rem_ref() { return --ref_count; }
+
 protected:
     Mpse(const char* method);
 
     virtual int _search(
         const uint8_t* T, int n, MpseMatch, void* context, int* current_state) = 0;
 
+    virtual int _search_stream(
+        StreamState&, unsigned /*max*/, const uint8_t*, int, MpseMatch, void*)
+    { return -1; }
+
 private:
     std::string method;
     int verbose;
+    unsigned ref_count;
     const MpseApi* api;
 };
 
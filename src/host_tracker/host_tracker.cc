@@ -24,5 +24,280 @@
 
 #include "host_tracker.h"
 
+#include <algorithm>
+
 THREAD_LOCAL struct HostTrackerStats host_tracker_stats;
 
+//-------------------------------------------------------------------------
+// reader epochs
+//
+// Each reading thread owns a slot holding the global epoch it saw when it
+// started reading, or 0 when idle.  A record retired at epoch E can be freed
+// once every busy slot holds an epoch after E.  Slots are never given back;
+// if they run out, readers fall back to holding the retire lock, which also
+// keeps reclamation out.
+//-------------------------------------------------------------------------
+
+#define HOST_READER_SLOTS 256
+
+struct alignas(64) HostReaderSlot
+{
+    std::atomic<uint64_t> epoch;
+};
+
+static HostReaderSlot reader_slots[HOST_READER_SLOTS];
+static std::atomic<unsigned> reader_slots_used(0);
+static std::atomic<uint64_t> global_epoch(1);
+
+static std::mutex retire_lock;
+static const HostRecord* retired = nullptr;
+static unsigned retired_count = 0;
+
+static THREAD_LOCAL HostReaderSlot* reader_slot = nullptr;
+static THREAD_LOCAL bool reader_slot_tried = false;
+static THREAD_LOCAL unsigned reader_depth = 0;
+static THREAD_LOCAL bool reader_locked = false;
+
+HostReadGuard::HostReadGuard()
+{
+    if ( reader_depth++ )
+        return;
+
+    if ( !reader_slot_tried )
+    {
+        unsigned idx = reader_slots_used++;
+
+        if ( idx < HOST_READER_SLOTS )
+            reader_slot = reader_slots + idx;
+        else
+            reader_slots_used = HOST_READER_SLOTS;
+
+        reader_slot_tried = true;
+    }
+
+    if ( reader_slot )
+        reader_slot->epoch = global_epoch.load();
+    else
+    {
+        retire_lock.lock();
+        reader_locked = true;
+    }
+}
+
+HostReadGuard::~HostReadGuard()
+{
+    if ( --reader_depth )
+        return;
+
+    if ( reader_slot )
+        reader_slot->epoch.store(0, std::memory_order_release);
+    else
+    {
+        reader_locked = false;
+        retire_lock.unlock();
+    }
+}
+
+// call with the retire lock held
+static void reclaim_retired()
+{
+    // a fallback reader on this thread may be looking at any of them
+    if ( reader_locked )
+        return;
+
+    uint64_t oldest = UINT64_MAX;
+    unsigned n = std::min(reader_slots_used.load(), (unsigned)HOST_READER_SLOTS);
+
+    for ( unsigned i = 0; i < n; i++ )
+    {
+        uint64_t e = reader_slots[i].epoch.load();
+
+        if ( e and e < oldest )
+            oldest = e;
+    }
+
+    const HostRecord** link = &retired;
+
+    while ( const HostRecord* rec = *link )
+    {
+        if ( rec->retired_epoch < oldest )
+        {
+            *link = rec->retired_next;
+            delete rec;
+            retired_count--;
+        }
+        else
+            link = &rec->retired_next;
+    }
+}
+
+static void retire(const HostRecord* rec)
+{
+    std::unique_lock<std::mutex> lck(retire_lock, std::defer_lock);
+
+    if ( !reader_locked )
+        lck.lock();
+
+    rec->retired_epoch = global_epoch++;
+    rec->retired_next = retired;
+    retired = rec;
+    retired_count++;
+
+    reclaim_retired();
+}
+
+unsigned host_tracker_reclaim()
+{
+    std::unique_lock<std::mutex> lck(retire_lock, std::defer_lock);
+
+    if ( !reader_locked )
+        lck.lock();
+
+    reclaim_retired();
+    return retired_count;
+}
+
+//-------------------------------------------------------------------------
+// HostApplicationList
+//-------------------------------------------------------------------------
+
+HostApplicationList::HostApplicationList(const HostApplicationList& rhs)
+{
+    if ( rhs.count > local_max )
+    {
+        capacity = rhs.count;
+        heap = new HostApplicationEntry[capacity];
+    }
+    std::copy(rhs.begin(), rhs.end(), data());
+    count = rhs.count;
+}
+
+const HostApplicationEntry* HostApplicationList::find(const HostApplicationEntry& app_entry) const
+{
+    for ( const HostApplicationEntry* p = begin(); p < end(); ++p )
+    {
+        if ( *p == app_entry )
+            return p;
+    }
+    return nullptr;
+}
+
+void HostApplicationList::add(const HostApplicationEntry& app_entry)
+{
+    if ( count == capacity )
+    {
+        capacity *= 2;
+        HostApplicationEntry* tmp = new HostApplicationEntry[capacity];
+        std::copy(begin(), end(), tmp);
+        delete[] heap;
+        heap = tmp;
+    }
+    data()[count++] = app_entry;
+}
+
+bool HostApplicationList::remove(const HostApplicationEntry& app_entry)
+{
+    const HostApplicationEntry* p = find(app_entry);
+
+    if ( !p )
+        return false;
+
+    HostApplicationEntry* d = data();
+    std::copy(p + 1, (const HostApplicationEntry*)d + count, d + (p - d));
+    count--;
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// HostTracker
+//-------------------------------------------------------------------------
+
+void HostTracker::publish(HostRecord* rec)
+{
+    retire(record.exchange(rec));
+}
+
+void HostTracker::set_ip_addr(const snort::SfIp& new_ip_addr)
+{
+    std::lock_guard<std::mutex> lck(host_tracker_lock);
+    HostRecord* rec = new HostRecord(*get_record());
+    std::memcpy(&rec->ip_addr, &new_ip_addr, sizeof(rec->ip_addr));
+    publish(rec);
+}
+
+void HostTracker::set_stream_policy(const Policy& policy)
+{
+    std::lock_guard<std::mutex> lck(host_tracker_lock);
+    HostRecord* rec = new HostRecord(*get_record());
+    rec->stream_policy = policy;
+    publish(rec);
+}
+
+void HostTracker::set_frag_policy(const Policy& policy)
+{
+    std::lock_guard<std::mutex> lck(host_tracker_lock);
+    HostRecord* rec = new HostRecord(*get_record());
+    rec->frag_policy = policy;
+    publish(rec);
+}
+
+bool HostTracker::add_service(const HostApplicationEntry& app_entry)
+{
+    host_tracker_stats.service_adds++;
+
+    std::lock_guard<std::mutex> lck(host_tracker_lock);
+
+    if ( get_record()->services.find(app_entry) )
+        return false;   //  Already exists.
+
+    HostRecord* rec = new HostRecord(*get_record());
+    rec->services.add(app_entry);
+    publish(rec);
+    return true;
+}
+
+void HostTracker::add_or_replace_service(const HostApplicationEntry& app_entry)
+{
+    host_tracker_stats.service_adds++;
+
+    std::lock_guard<std::mutex> lck(host_tracker_lock);
+
+    HostRecord* rec = new HostRecord(*get_record());
+    rec->services.remove(app_entry);
+    rec->services.add(app_entry);
+    publish(rec);
+}
+
+bool HostTracker::find_service(Protocol ipproto, Port port, HostApplicationEntry& app_entry)
+{
+    HostApplicationEntry tmp_entry(ipproto, port, UNKNOWN_PROTOCOL_ID);
+    host_tracker_stats.service_finds++;
+
+    HostReadGuard rg;
+    const HostApplicationEntry* p = get_record()->services.find(tmp_entry);
+
+    if ( p )
+    {
+        app_entry = *p;
+        return true;
+    }
+
+    return false;
+}
+
+bool HostTracker::remove_service(Protocol ipproto, Port port)
+{
+    HostApplicationEntry tmp_entry(ipproto, port, UNKNOWN_PROTOCOL_ID);
+    host_tracker_stats.service_removes++;
+
+    std::lock_guard<std::mutex> lck(host_tracker_lock);
+
+    if ( !get_record()->services.find(tmp_entry) )
+        return false;
+
+    HostRecord* rec = new HostRecord(*get_record());
+    rec->services.remove(tmp_entry);
+    publish(rec);
+    return true;   //  Assumes only one matching entry.
+}
+
@@ -24,10 +24,16 @@
 // The HostTracker class holds information known about a host (may be from
 // configuration or dynamic discovery).  It provides a thread-safe API to
 // set/get the host data.
-
-#include <algorithm>
+//
+// The data lives in an immutable HostRecord.  Readers take no locks: they
+// enter a reader epoch, load the current record, copy out what they need
+// and leave.  Writers serialize on a per host mutex, copy the record, change
+// the copy and publish it with a single pointer store.  Replaced records are
+// retired and freed once every reader that might still see them has left
+// its epoch.
+
+#include <atomic>
 #include <cstring>
-#include <list>
 #include <mutex>
 
 #include "framework/counts.h"
@@ -72,12 +78,46 @@ struct HostApplicationEntry
     }
 };
 
-class HostTracker
+// small vector of entries; most hosts have only a few services so they are
+// kept inline with the record and searched without chasing pointers
+class HostApplicationList
 {
+public:
+    HostApplicationList() = default;
+    HostApplicationList(const HostApplicationList&);
+    HostApplicationList& operator=(const HostApplicationList&) = delete;
+
+    ~HostApplicationList()
+    { delete[] heap; }
+
+    const HostApplicationEntry* begin() const
+    { return heap ? heap : local; }
+
+    const HostApplicationEntry* end() const
+    { return begin() + count; }
+
+    unsigned size() const
+    { return count; }
+
+    const HostApplicationEntry* find(const HostApplicationEntry&) const;
+
+    void add(const HostApplicationEntry&);
+    bool remove(const HostApplicationEntry&);
+
+    static const unsigned local_max = 8;
+
 private:
-    std::mutex host_tracker_lock;     //  Ensure that updates to a
-                                      //  shared object are safe.
+    HostApplicationEntry* data()
+    { return heap ? heap : local; }
 
+    HostApplicationEntry local[local_max];
+    HostApplicationEntry* heap = nullptr;
+    uint16_t count = 0;
+    uint16_t capacity = local_max;
+};
+
+struct HostRecord
+{
     //  FIXIT-M do we need to use a host_id instead of SfIp as in sfrna?
     snort::SfIp ip_addr;
 
@@ -85,120 +125,101 @@ private:
     Policy stream_policy = 0;
     Policy frag_policy = 0;
 
-    std::list<HostApplicationEntry> services;
-    std::list<HostApplicationEntry> clients;
+    HostApplicationList services;
+    HostApplicationList clients;
+
+    HostRecord()
+    { memset(&ip_addr, 0, sizeof(ip_addr)); }
+
+    HostRecord(const HostRecord& rhs) :
+        ip_addr(rhs.ip_addr), stream_policy(rhs.stream_policy), frag_policy(rhs.frag_policy),
+        services(rhs.services), clients(rhs.clients)
+    { }
+
+    HostRecord& operator=(const HostRecord&) = delete;
+
+    // retire list linkage, only touched under the retire lock
+    mutable const HostRecord* retired_next = nullptr;
+    mutable uint64_t retired_epoch = 0;
+};
+
+// marks the calling thread as reading records until destroyed
+class HostReadGuard
+{
+public:
+    HostReadGuard();
+    ~HostReadGuard();
+
+    HostReadGuard(const HostReadGuard&) = delete;
+    HostReadGuard& operator=(const HostReadGuard&) = delete;
+};
+
+class HostTracker
+{
+private:
+    std::mutex host_tracker_lock;     //  Serializes writers only.
+    std::atomic<const HostRecord*> record;
+
+    // call with the lock held; retires the current record
+    void publish(HostRecord*);
 
 public:
     HostTracker()
-    {
-        memset(&ip_addr, 0, sizeof(ip_addr));
-    }
+    { record = new HostRecord; }
+
+    ~HostTracker()
+    { delete record.load(); }
+
+    HostTracker(const HostTracker&) = delete;
+    HostTracker& operator=(const HostTracker&) = delete;
+
+    // the current version; only valid while a HostReadGuard is held
+    const HostRecord* get_record() const
+    { return record.load(); }
 
     snort::SfIp get_ip_addr()
     {
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
-        return ip_addr;
+        HostReadGuard rg;
+        return get_record()->ip_addr;
     }
 
-    void set_ip_addr(const snort::SfIp& new_ip_addr)
-    {
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
-        std::memcpy(&ip_addr, &new_ip_addr, sizeof(ip_addr));
-    }
+    void set_ip_addr(const snort::SfIp& new_ip_addr);
 
     Policy get_stream_policy()
     {
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
-        return stream_policy;
+        HostReadGuard rg;
+        return get_record()->stream_policy;
     }
 
-    void set_stream_policy(const Policy& policy)
-    {
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
-        stream_policy = policy;
-    }
+    void set_stream_policy(const Policy& policy);
 
     Policy get_frag_policy()
     {
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
-        return frag_policy;
+        HostReadGuard rg;
+        return get_record()->frag_policy;
     }
 
-    void set_frag_policy(const Policy& policy)
-    {
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
-        frag_policy = policy;
-    }
+    void set_frag_policy(const Policy& policy);
 
     //  Add host service data only if it doesn't already exist.  Returns
     //  false if entry exists already, and true if entry was added.
-    bool add_service(const HostApplicationEntry& app_entry)
-    {
-        host_tracker_stats.service_adds++;
-
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
-
-        auto iter = std::find(services.begin(), services.end(), app_entry);
-        if (iter != services.end())
-            return false;   //  Already exists.
-
-        services.push_front(app_entry);
-        return true;
-    }
+    bool add_service(const HostApplicationEntry& app_entry);
 
     //  Add host service data if it doesn't already exist.  If it does exist
     //  replace the previous entry with the new entry.
-    void add_or_replace_service(const HostApplicationEntry& app_entry)
-    {
-        host_tracker_stats.service_adds++;
-
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
-
-        auto iter = std::find(services.begin(), services.end(), app_entry);
-        if (iter != services.end())
-            services.erase(iter);
-
-        services.push_front(app_entry);
-    }
+    void add_or_replace_service(const HostApplicationEntry& app_entry);
 
     //  Returns true and fills in copy of HostApplicationEntry when found.
     //  Returns false when not found.
-    bool find_service(Protocol ipproto, Port port, HostApplicationEntry& app_entry)
-    {
-        HostApplicationEntry tmp_entry(ipproto, port, UNKNOWN_PROTOCOL_ID);
-        host_tracker_stats.service_finds++;
-
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
-
-        auto iter = std::find(services.begin(), services.end(), tmp_entry);
-        if (iter != services.end())
-        {
-            app_entry = *iter;
-            return true;
-        }
-
-        return false;
-    }
+    bool find_service(Protocol ipproto, Port port, HostApplicationEntry& app_entry);
 
     //  Removes HostApplicationEntry object associated with ipproto and port.
     //  Returns true if entry existed.  False otherwise.
-    bool remove_service(Protocol ipproto, Port port)
-    {
-        HostApplicationEntry tmp_entry(ipproto, port, UNKNOWN_PROTOCOL_ID);
-        host_tracker_stats.service_removes++;
-
-        std::lock_guard<std::mutex> lck(host_tracker_lock);
-
-        auto iter = std::find(services.begin(), services.end(), tmp_entry);
-        if (iter != services.end())
-        {
-            services.erase(iter);
-            return true;   //  Assumes only one matching entry.
-        }
-
-        return false;
-    }
+    bool remove_service(Protocol ipproto, Port port);
 };
 
+// free retired records that no reader can still see; returns how many remain
+unsigned host_tracker_reclaim();
+
 #endif
 
@@ -25,6 +25,10 @@
 
 #include "host_tracker/host_tracker.h"
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include <CppUTest/CommandLineTestRunner.h>
 #include <CppUTest/TestHarness.h>
 
@@ -143,6 +147,87 @@ TEST(host_tracker, add_find_service_test)
     CHECK(true == ret);
 }
 
+//  Services beyond the inline entries spill to the heap without losing any.
+TEST(host_tracker, many_services_test)
+{
+    HostTracker ht;
+    HostApplicationEntry entry;
+    unsigned n = 3 * HostApplicationList::local_max;
+
+    for ( unsigned i = 0; i < n; i++ )
+        CHECK(ht.add_service(HostApplicationEntry(6, 1000 + i, i)));
+
+    for ( unsigned i = 0; i < n; i++ )
+    {
+        CHECK(ht.find_service(6, 1000 + i, entry));
+        CHECK(entry.snort_protocol_id == i);
+    }
+
+    for ( unsigned i = 0; i < n; i += 2 )
+        CHECK(ht.remove_service(6, 1000 + i));
+
+    for ( unsigned i = 0; i < n; i++ )
+        CHECK(ht.find_service(6, 1000 + i, entry) == (i & 1));
+
+    ht.add_or_replace_service(HostApplicationEntry(6, 1001, 77));
+    CHECK(ht.find_service(6, 1001, entry));
+    CHECK(entry.snort_protocol_id == 77);
+    CHECK(ht.get_record()->services.size() == n / 2);
+
+    CHECK(host_tracker_reclaim() == 0);
+}
+
+//  Readers never see a torn record while a writer publishes versions, and
+//  every retired version is freed once the readers are gone.
+TEST(host_tracker, concurrent_readers_test)
+{
+    HostTracker ht;
+    std::atomic<bool> done(false);
+    std::atomic<unsigned> bad(0);
+    std::vector<std::thread> readers;
+
+    for ( unsigned t = 0; t < 4; t++ )
+    {
+        readers.emplace_back([&]()
+        {
+            while ( !done )
+            {
+                HostReadGuard rg;
+                const HostRecord* rec = ht.get_record();
+
+                // the writer adds a service and then raises the stream and
+                // frag policies to the new service count, in that order
+                unsigned n = rec->services.size();
+
+                if ( rec->frag_policy > rec->stream_policy or rec->stream_policy > n or
+                    rec->frag_policy + 1 < n )
+                    bad++;
+
+                for ( const auto& e : rec->services )
+                {
+                    if ( e.snort_protocol_id != e.port )
+                        bad++;
+                }
+            }
+        });
+    }
+
+    for ( unsigned i = 1; i <= 200; i++ )
+    {
+        ht.add_service(HostApplicationEntry(17, i, i));
+        ht.set_stream_policy(i);
+        ht.set_frag_policy(i);
+    }
+
+    done = true;
+
+    for ( auto& r : readers )
+        r.join();
+
+    CHECK(bad == 0);
+    CHECK(host_tracker_reclaim() == 0);
+}
+
 int main(int argc, char** argv)
 {
     return CommandLineTestRunner::RunAllTests(argc, argv);
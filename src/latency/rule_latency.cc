@@ -158,7 +158,7 @@ struct DefaultRuleInterface
 
             for ( int i = 0; i < root.num_children; ++i )
             {
-                auto& child_state = root.children[i]->state[get_instance_id()];
+                auto& child_state = root.children[i]->get_state(get_instance_id());
                 // FIXIT-L rename to something like latency_timeout_count
                 ++child_state.latency_timeouts;
                 ++child_state.latency_suspends;
@@ -172,7 +172,7 @@ struct DefaultRuleInterface
             for ( int i = 0; i < root.num_children; ++i )
             {
                 // FIXIT-L rename to something like latency_timeout_count
-                ++root.children[i]->state[get_instance_id()].latency_timeouts;
+                ++root.children[i]->get_state(get_instance_id()).latency_timeouts;
             }
         }
 
@@ -612,6 +612,7 @@ TEST_CASE ( "default latency rule interface", "[latency]" )
 
     std::unique_ptr<dot_node_state_t[]> child_state(new dot_node_state_t[instances]());
     child.state = child_state.get();
+    child.state_stride = sizeof(dot_node_state_t);
 
     detection_option_tree_root_t root;
     root.latency_state = latency_state.get();
@@ -224,6 +224,18 @@ static const Parameter search_engine_params[] =
     { "enable_single_rule_group", Parameter::PT_BOOL, nullptr, "false",
       "put all rules into one group" },
 
+    { "fp_profile", Parameter::PT_STRING, nullptr, nullptr,
+      "file of fast pattern counts from fp_profile_out used to avoid noisy fast patterns" },
+
+    { "fp_profile_out", Parameter::PT_STRING, nullptr, nullptr,
+      "file to write fast pattern counts from the rule profiler to at exit" },
+
+    { "fp_profile_threshold", Parameter::PT_INT, "1:", "100",
+      "minimum false triggers in fp_profile for a fast pattern to be avoided" },
+
+    { "compile_threads", Parameter::PT_INT, "0:", "0",
+      "number of threads used to compile fast pattern state machines (0 means one per cpu)" },
+
     { "debug", Parameter::PT_BOOL, nullptr, "false",
       "print verbose fast pattern info" },
 
@@ -257,6 +269,12 @@ static const Parameter search_engine_params[] =
     { "show_fast_patterns", Parameter::PT_BOOL, nullptr, "false",
       "print fast pattern info for each rule" },
 
+    { "search_streams", Parameter::PT_BOOL, nullptr, "false",
+      "search reassembled pkt and file data as a continuous stream if the search method supports it" },
+
+    { "stream_memcap", Parameter::PT_INT, "0:65535", "2048",
+      "maximum bytes of saved search state per flow with search_streams" },
+
     { "split_any_any", Parameter::PT_BOOL, nullptr, "true",
       "evaluate any-any rules separately to save memory" },
 
@@ -280,6 +298,8 @@ const PegInfo mpse_pegs[] =
     { CountType::SUM, "non_qualified_events", "total non-qualified events" },
     { CountType::SUM, "qualified_events", "total qualified events" },
     { CountType::SUM, "searched_bytes", "total bytes searched" },
+    { CountType::SUM, "stream_searches", "fast pattern searches continuing a flow's saved engine state" },
+    { CountType::SUM, "stream_fallbacks", "flow directions returned to block searches" },
     { CountType::END, nullptr, nullptr }
 };
 
@@ -316,6 +336,20 @@ bool SearchEngineModule::set(const char*, Value& v, SnortConfig* sc)
         if ( v.get_bool() )
             fp->set_single_rule_group();
     }
+    else if ( v.is("compile_threads") )
+        fp->set_compile_threads(v.get_long());
+
+    else if ( v.is("fp_profile") )
+    {
+        if ( !fp->set_fp_profile(v.get_string()) )
+            ParseError("can't read fast pattern profile %s", v.get_string());
+    }
+    else if ( v.is("fp_profile_out") )
+        fp->set_fp_profile_out(v.get_string());
+
+    else if ( v.is("fp_profile_threshold") )
+        fp->set_fp_profile_threshold(v.get_long());
+
     else if ( v.is("debug") )
     {
         if ( v.get_bool() )
@@ -361,6 +395,12 @@ bool SearchEngineModule::set(const char*, Value& v, SnortConfig* sc)
     else if ( v.is("show_fast_patterns") )
         fp->set_debug_print_fast_patterns(v.get_bool());
 
+    else if ( v.is("search_streams") )
+        fp->set_search_streams(v.get_bool());
+
+    else if ( v.is("stream_memcap") )
+        fp->set_stream_memcap(v.get_long());
+
     else if ( v.is("split_any_any") )
         fp->set_split_any_any(v.get_long());
 
@@ -157,6 +157,9 @@ static ProfileStats* get_profile(const char* key)
     if ( !strcmp(key, "eventq") )
         return &eventqPerfStats;
 
+    if ( !strcmp(key, "ips_context") )
+        return &contextPerfStats;
+
     if ( !strcmp(key, "total") )
         return &totalPerfStats;
 
@@ -177,6 +180,7 @@ static void register_profiles()
     Profiler::register_module("nfp_rule_tree_eval", "rule_eval", get_profile);
     Profiler::register_module("decode", nullptr, get_profile);
     Profiler::register_module("eventq", nullptr, get_profile);
+    Profiler::register_module("ips_context", nullptr, get_profile);
     Profiler::register_module("total", nullptr, get_profile);
     Profiler::register_module("daq_meta", nullptr, get_profile);
 }
@@ -756,10 +760,11 @@ void Snort::thread_rotate()
  */
 bool Snort::thread_init_privileged(const char* intf)
 {
-    s_data = new uint8_t[65535];
     show_source(intf);
 
+    // pin first so that everything this thread allocates is on its NUMA node
     SnortConfig::get_conf()->thread_config->implement_thread_affinity(STHREAD_TYPE_PACKET, get_instance_id());
+    s_data = new uint8_t[65535];
 
     // FIXIT-M the start-up sequence is a little off due to dropping privs
     SFDAQInstance *daq_instance = new SFDAQInstance(intf);
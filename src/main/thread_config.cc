@@ -36,6 +36,7 @@ static hwloc_topology_t topology = nullptr;
 static hwloc_cpuset_t process_cpuset = nullptr;
 static const struct hwloc_topology_support* topology_support = nullptr;
 static unsigned instance_max = 1;
+static unsigned numa_nodes = 1;
 
 struct CpuSet
 {
@@ -66,6 +67,9 @@ bool ThreadConfig::init()
     }
     else
         process_cpuset = hwloc_bitmap_dup(hwloc_topology_get_allowed_cpuset(topology));
+
+    int nodes = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_NUMANODE);
+    numa_nodes = (nodes > 1) ? nodes : 1;
     return true;
 }
 
@@ -116,6 +120,7 @@ void ThreadConfig::term()
         process_cpuset = nullptr;
     }
     topology_support = nullptr;
+    numa_nodes = 1;
 }
 
 ThreadConfig::~ThreadConfig()
@@ -139,6 +144,44 @@ void ThreadConfig::set_thread_affinity(SThreadType type, unsigned id, CpuSet* cp
         snort::ParseWarning(WARN_CONF, "This platform does not support setting thread affinity.\n");
 }
 
+/* Threads pinned within a subset of the NUMA nodes have their memory policy set to those nodes
+    so that everything they allocate afterwards (DAQ rings, flow caches, reassembly segments,
+    detection contexts) is local regardless of which thread first touches it.  Without the strict
+    flag this is only a preference so a full node falls back to the others instead of failing. */
+static void implement_memory_binding(SThreadType type, unsigned id, hwloc_const_cpuset_t cpuset)
+{
+    if (numa_nodes < 2)
+        return;
+
+    hwloc_nodeset_t nodeset = hwloc_bitmap_alloc();
+    hwloc_cpuset_to_nodeset(topology, cpuset, nodeset);
+
+    char* s;
+    hwloc_bitmap_list_asprintf(&s, nodeset);
+
+    if (!topology_support->membind->set_thisthread_membind ||
+        !topology_support->membind->bind_membind)
+        snort::LogMessage("Thread %u (type %u) is on NUMA node %s; "
+            "this platform does not support binding memory.\n", id, type, s);
+
+    else if ((unsigned)hwloc_bitmap_weight(nodeset) >= numa_nodes)
+    {
+        hwloc_set_membind(topology, cpuset, HWLOC_MEMBIND_DEFAULT, HWLOC_MEMBIND_THREAD);
+        snort::LogMessage("Thread %u (type %u) spans all %u NUMA nodes; memory is not bound.\n",
+            id, type, numa_nodes);
+    }
+    else if (hwloc_set_membind(topology, cpuset, HWLOC_MEMBIND_BIND, HWLOC_MEMBIND_THREAD))
+        snort::WarningMessage("Failed to bind memory for thread %u (type %u) to NUMA node %s: "
+            "%s (%d)\n", id, type, s, snort::get_error(errno), errno);
+
+    else
+        snort::LogMessage("Binding memory for thread %u (type %u) to NUMA node %s.\n",
+            id, type, s);
+
+    free(s);
+    hwloc_bitmap_free(nodeset);
+}
+
 void ThreadConfig::implement_thread_affinity(SThreadType type, unsigned id)
 {
     if (!topology_support->cpubind->set_thisthread_cpubind)
@@ -168,6 +211,8 @@ void ThreadConfig::implement_thread_affinity(SThreadType type, unsigned id)
     }
 
     free(s);
+
+    implement_memory_binding(type, id, desired_cpuset);
 }
 
 
@@ -228,4 +273,37 @@ TEST_CASE("Set and implement thread affinity", "[ThreadConfig]")
     }
 }
 
+TEST_CASE("Bind memory to the node of a pinned thread", "[ThreadConfig]")
+{
+    CHECK(numa_nodes >= 1);
+
+    if (numa_nodes > 1 &&
+        topology_support->cpubind->set_thisthread_cpubind &&
+        topology_support->membind->set_thisthread_membind &&
+        topology_support->membind->get_thisthread_membind &&
+        topology_support->membind->bind_membind)
+    {
+        CpuSet* cpuset = new CpuSet(hwloc_bitmap_dup(process_cpuset));
+        ThreadConfig tc;
+
+        hwloc_bitmap_singlify(cpuset->cpuset);
+        tc.set_thread_affinity(STHREAD_TYPE_PACKET, 0, cpuset);
+        tc.implement_thread_affinity(STHREAD_TYPE_PACKET, 0);
+
+        hwloc_cpuset_t bound = hwloc_bitmap_alloc();
+        hwloc_membind_policy_t policy;
+
+        hwloc_get_membind(topology, bound, &policy, HWLOC_MEMBIND_THREAD);
+        CHECK(policy == HWLOC_MEMBIND_BIND);
+        CHECK(hwloc_bitmap_isincluded(cpuset->cpuset, bound));
+        CHECK(!hwloc_bitmap_isincluded(process_cpuset, bound));
+
+        tc.implement_thread_affinity(STHREAD_TYPE_MAIN, 0);
+        hwloc_get_membind(topology, bound, &policy, HWLOC_MEMBIND_THREAD);
+        CHECK(policy != HWLOC_MEMBIND_BIND);
+
+        hwloc_bitmap_free(bound);
+    }
+}
+
 #endif
@@ -0,0 +1,342 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+
+// huge_arena.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "huge_arena.h"
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#include "log/messages.h"
+#include "utils/util.h"
+
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#endif
+
+using namespace snort;
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace memory
+{
+
+static const size_t page_2m = (size_t)1 << 21;
+static const size_t page_1g = (size_t)1 << 30;
+
+// smaller requests share an arena; larger ones get a mapping of their own
+static const size_t arena_size = 32 * 1024 * 1024;
+static const size_t max_shared = arena_size / 4;
+
+struct Arena
+{
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    unsigned live;
+};
+
+struct alignas(16) Block
+{
+    Arena* arena;  // nullptr if from the heap
+    size_t size;
+};
+
+// MPSE compiles run on a thread pool and flow caches are allocated by
+// packet threads so the arenas are serialized; heap blocks aren't
+static std::mutex arena_mutex;
+
+static std::atomic<HugePages> mode { HugePages::OFF };
+static std::atomic<size_t> fallback { 0 };
+static Arena* current = nullptr;
+static HugeArenaStats stats = { 0, 0, 0, 0 };
+static bool warned = false;
+
+static inline size_t round_up(size_t n, size_t m)
+{ return (n + m - 1) / m * m; }
+
+#ifdef MAP_HUGETLB
+static void* map_huge(size_t& size, size_t page, int shift)
+{
+    size_t n = round_up(size, page);
+    void* p = mmap(nullptr, n, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+
+    if ( p == MAP_FAILED )
+        return nullptr;
+
+    size = n;
+    return p;
+}
+#endif
+
+// align to 2 MB so the kernel can back the whole range with huge pages
+static void* map_thp(size_t& size)
+{
+    size_t n = round_up(size, page_2m);
+    uint8_t* p = (uint8_t*)mmap(nullptr, n + page_2m, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if ( p == MAP_FAILED )
+        return nullptr;
+
+    uint8_t* a = (uint8_t*)round_up((uintptr_t)p, page_2m);
+
+    if ( a > p )
+        munmap(p, a - p);
+
+    size_t tail = (p + n + page_2m) - (a + n);
+
+    if ( tail )
+        munmap(a + n, tail);
+
+#ifdef MADV_HUGEPAGE
+    madvise(a, n, MADV_HUGEPAGE);
+#endif
+
+    size = n;
+    return a;
+}
+
+static Arena* new_arena(size_t need)
+{
+    size_t size = (need > arena_size) ? need : arena_size;
+    void* p = nullptr;
+
+#ifdef MAP_HUGETLB
+    if ( mode == HugePages::PAGE_1G )
+        p = map_huge(size, page_1g, 30);
+
+    if ( !p and (mode == HugePages::PAGE_1G or mode == HugePages::PAGE_2M) )
+        p = map_huge(size, page_2m, 21);
+
+    if ( !p and mode != HugePages::THP and !warned )
+    {
+        WarningMessage("huge_pages: unable to map huge pages (%s); "
+            "using transparent huge pages instead\n", get_error(errno));
+        warned = true;
+    }
+#endif
+
+    if ( !p )
+        p = map_thp(size);
+
+    if ( !p )
+        return nullptr;
+
+    Arena* a = new Arena;
+    a->base = (uint8_t*)p;
+    a->size = size;
+    a->used = 0;
+    a->live = 0;
+
+    stats.mapped += size;
+    stats.arenas++;
+    return a;
+}
+
+static void delete_arena(Arena* a)
+{
+    munmap(a->base, a->size);
+    stats.mapped -= a->size;
+    stats.arenas--;
+    delete a;
+}
+
+static void* heap_alloc(size_t need)
+{
+    Block* b = (Block*)snort_calloc(need);
+    b->arena = nullptr;
+    b->size = need;
+    fallback += need;
+    return b + 1;
+}
+
+void HugeArena::configure(HugePages hp)
+{
+    std::lock_guard<std::mutex> lock(arena_mutex);
+    mode = hp;
+    warned = false;
+}
+
+HugePages HugeArena::get_mode()
+{ return mode; }
+
+void* HugeArena::allocate(size_t n)
+{
+    size_t need = round_up(n ? n : 1, sizeof(Block)) + sizeof(Block);
+
+    if ( mode == HugePages::OFF )
+        return heap_alloc(need);
+
+    std::lock_guard<std::mutex> lock(arena_mutex);
+    Arena* a;
+
+    if ( need > max_shared )
+        a = new_arena(need);
+
+    else
+    {
+        if ( current and current->used + need > current->size )
+        {
+            if ( !current->live )
+                delete_arena(current);
+
+            current = nullptr;
+        }
+        if ( !current )
+            current = new_arena(arena_size);
+
+        a = current;
+    }
+
+    if ( !a )
+        return heap_alloc(need);
+
+    Block* b = (Block*)(a->base + a->used);
+    a->used += need;
+    a->live++;
+
+    b->arena = a;
+    b->size = need;
+    stats.used += need;
+
+    return b + 1;
+}
+
+void HugeArena::deallocate(void* p)
+{
+    if ( !p )
+        return;
+
+    Block* b = (Block*)p - 1;
+
+    if ( !b->arena )
+    {
+        fallback -= b->size;
+        snort_free(b);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(arena_mutex);
+    Arena* a = b->arena;
+    stats.used -= b->size;
+
+    if ( --a->live )
+        return;
+
+    // the open arena is recycled; memory handed out must be zeroed
+    if ( a == current )
+    {
+        memset(a->base, 0, a->used);
+        a->used = 0;
+    }
+    else
+        delete_arena(a);
+}
+
+HugeArenaStats HugeArena::get_stats()
+{
+    std::lock_guard<std::mutex> lock(arena_mutex);
+    HugeArenaStats hs = stats;
+    hs.fallback = fallback;
+    return hs;
+}
+
+} // namespace memory
+
+#ifdef UNIT_TEST
+
+using namespace memory;
+
+TEST_CASE("huge arena off uses the heap", "[memory]")
+{
+    HugeArena::configure(HugePages::OFF);
+
+    uint8_t* p = (uint8_t*)HugeArena::allocate(100);
+    CHECK(p[0] == 0);
+    CHECK(p[99] == 0);
+    CHECK(HugeArena::get_stats().fallback > 100);
+
+    HugeArena::deallocate(p);
+    CHECK(HugeArena::get_stats().fallback == 0);
+}
+
+TEST_CASE("huge arena shares and releases mappings", "[memory]")
+{
+    HugeArena::configure(HugePages::THP);
+
+    uint8_t* a = (uint8_t*)HugeArena::allocate(1000);
+    uint8_t* b = (uint8_t*)HugeArena::allocate(1000);
+    CHECK(((uintptr_t)a & 15) == 0);
+    CHECK(b > a);
+    CHECK(HugeArena::get_stats().arenas == 1);
+
+    memset(a, 0xff, 1000);
+    HugeArena::deallocate(a);
+    HugeArena::deallocate(b);
+
+    // the open arena is reused and rezeroed
+    uint8_t* c = (uint8_t*)HugeArena::allocate(1000);
+    CHECK(c == a);
+    CHECK(c[0] == 0);
+    CHECK(c[999] == 0);
+
+    // big requests get their own mapping which goes away when freed
+    uint8_t* d = (uint8_t*)HugeArena::allocate(64 * 1024 * 1024);
+    CHECK(HugeArena::get_stats().arenas == 2);
+    CHECK(((uintptr_t)(d - sizeof(Block)) & (page_2m - 1)) == 0);
+    d[64 * 1024 * 1024 - 1] = 1;
+
+    HugeArena::deallocate(d);
+    CHECK(HugeArena::get_stats().arenas == 1);
+
+    HugeArena::deallocate(c);
+    CHECK(HugeArena::get_stats().used == 0);
+    HugeArena::configure(HugePages::OFF);
+}
+
+TEST_CASE("huge arena falls back without huge pages", "[memory]")
+{
+    // works whether or not huge pages are reserved on this box
+    HugeArena::configure(HugePages::PAGE_1G);
+
+    const size_t n = 2 * max_shared / sizeof(uint64_t);
+    uint64_t* p = (uint64_t*)HugeArena::allocate(n * sizeof(uint64_t));
+    CHECK(p[n - 1] == 0);
+    p[n - 1] = 1;
+
+    HugeArena::deallocate(p);
+    CHECK(HugeArena::get_stats().used == 0);
+    HugeArena::configure(HugePages::OFF);
+}
+
+#endif
+
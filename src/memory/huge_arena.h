@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+
+// huge_arena.h
+
+#ifndef HUGE_ARENA_H
+#define HUGE_ARENA_H
+
+// HugeArena places large, randomly accessed tables (MPSE state tables,
+// flow caches) on huge pages to cut TLB misses.  Allocations are carved
+// from 2 MB or 1 GB page mappings and released when every block in the
+// mapping has been freed, so it suits data built once and freed together.
+// When huge pages can't be mapped it falls back to normal pages with a
+// transparent huge page hint, and with huge_pages = off it is just
+// snort_calloc.
+
+#include <cstddef>
+
+#include "memory_config.h"
+
+namespace memory
+{
+
+struct HugeArenaStats
+{
+    size_t mapped;    // bytes mapped for arenas
+    size_t used;      // bytes carved from arenas
+    size_t fallback;  // bytes that went to the heap
+    unsigned arenas;
+};
+
+class HugeArena
+{
+public:
+    static void configure(HugePages);
+    static HugePages get_mode();
+
+    // returns zeroed memory; never fails (fatal like snort_calloc)
+    static void* allocate(size_t);
+    static void deallocate(void*);
+
+    static HugeArenaStats get_stats();
+};
+
+} // namespace memory
+
+#endif
+
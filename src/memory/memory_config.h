@@ -23,11 +23,15 @@
 
 #include <cstddef>
 
+// backing for large read mostly tables, see huge_arena.h
+enum class HugePages { OFF, THP, PAGE_2M, PAGE_1G };
+
 struct MemoryConfig
 {
     size_t cap = 0;
     bool soft = false;
     size_t threshold = 0;
+    HugePages huge_pages = HugePages::OFF;
 
     constexpr MemoryConfig() = default;
 };
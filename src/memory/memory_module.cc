@@ -26,6 +26,7 @@
 
 #include "main/snort_config.h"
 
+#include "huge_arena.h"
 #include "memory_config.h"
 
 using namespace snort;
@@ -50,6 +51,10 @@ static const Parameter s_params[] =
         "set the per-packet-thread threshold for preemptive cleanup actions "
         "(percent, 0 to disable)" },
 
+    { "huge_pages", Parameter::PT_ENUM, "off | thp | 2m | 1g", "off",
+        "back search engine state tables and flow caches with huge pages; "
+        "falls back to transparent huge pages if none are reserved" },
+
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
@@ -74,14 +79,19 @@ bool MemoryModule::set(const char*, Value& v, SnortConfig* sc)
     else if ( v.is("threshold") )
         sc->memory->threshold = v.get_long();
 
+    else if ( v.is("huge_pages") )
+        sc->memory->huge_pages = static_cast<HugePages>(v.get_long());
+
     else
         return false;
 
     return true;
 }
 
-bool MemoryModule::end(const char*, int, SnortConfig*)
+bool MemoryModule::end(const char*, int, SnortConfig* sc)
 {
+    // must be set before the search engines are compiled
+    memory::HugeArena::configure(sc->memory->huge_pages);
     configured = true;
     return true;
 }
@@ -83,6 +83,8 @@ public:
     bool debug = false;
     bool dump_ports = false;
     bool log_all_sessions = false;
+    uint32_t lua_detector_max_instructions = 0;
+    uint32_t lua_detector_max_usecs = 0;
 
     bool safe_search_enabled = true;
     bool dns_host_reporting = true;
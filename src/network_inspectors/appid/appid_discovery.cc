@@ -29,6 +29,9 @@
 #include "profiler/profiler.h"
 #include "protocols/packet.h"
 #include "protocols/tcp.h"
+#include "time/clock_defs.h"
+#include "time/stopwatch.h"
+#include "utils/stats.h"
 
 #include "app_forecast.h"
 #include "appid_config.h"
@@ -52,12 +55,23 @@
 
 using namespace snort;
 
+// results of the last shared payload scan on this packet thread
+struct AppIdPatternScan
+{
+    PegCount packet_number = 0;
+    const uint8_t* data = nullptr;
+    uint16_t dsize = 0;
+    IpProtocol proto = IpProtocol::PROTO_NOT_SET;
+    std::vector<AppIdPatternMatchNode*> matches;
+};
+
+SearchTool* AppIdDiscovery::tcp_patterns = nullptr;
+SearchTool* AppIdDiscovery::udp_patterns = nullptr;
+static THREAD_LOCAL AppIdPatternScan* pattern_scan = nullptr;
+
 AppIdDiscovery::AppIdDiscovery(AppIdInspector& ins)
     : inspector(ins)
-{
-    tcp_patterns = new SearchTool("ac_full", true);
-    udp_patterns = new SearchTool("ac_full", true);
-}
+{ }
 
 AppIdDiscovery::~AppIdDiscovery()
 {
@@ -66,9 +80,6 @@ AppIdDiscovery::~AppIdDiscovery()
 
     pattern_data.clear();
 
-    delete tcp_patterns;
-    delete udp_patterns;
-
     for ( auto kv : tcp_detectors )
         delete kv.second;
 
@@ -76,28 +87,71 @@ AppIdDiscovery::~AppIdDiscovery()
         delete kv.second;
 }
 
+void AppIdDiscovery::create_patterns()
+{
+    if ( !tcp_patterns )
+        tcp_patterns = new SearchTool("ac_full", true);
+
+    if ( !udp_patterns )
+        udp_patterns = new SearchTool("ac_full", true);
+}
+
+void AppIdDiscovery::prep_patterns()
+{
+    Stopwatch<SnortClock> sw;
+    sw.start();
+
+    tcp_patterns->prep();
+    udp_patterns->prep();
+
+    sw.stop();
+
+    AppIdDiscovery& sd = ServiceDiscovery::get_instance();
+    AppIdDiscovery& cd = ClientDiscovery::get_instance();
+
+    LogMessage("AppId payload patterns: tcp %d (service %d, client %d), "
+        "udp %d (service %d, client %d), compiled in %" PRIu64 " usecs\n",
+        sd.tcp_pattern_count + cd.tcp_pattern_count, sd.tcp_pattern_count, cd.tcp_pattern_count,
+        sd.udp_pattern_count + cd.udp_pattern_count, sd.udp_pattern_count, cd.udp_pattern_count,
+        (uint64_t)TO_USECS(sw.get()));
+}
+
+void AppIdDiscovery::delete_patterns()
+{
+    delete tcp_patterns;
+    tcp_patterns = nullptr;
+
+    delete udp_patterns;
+    udp_patterns = nullptr;
+}
+
 void AppIdDiscovery::initialize_plugins(AppIdInspector* ins)
 {
+    create_patterns();
     ServiceDiscovery::get_instance(ins);
     ClientDiscovery::get_instance(ins);
 }
 
 void AppIdDiscovery::finalize_plugins()
 {
-    ServiceDiscovery::get_instance().finalize_service_patterns();
     ClientDiscovery::get_instance().finalize_client_plugins();
+    prep_patterns();
 }
 
 void AppIdDiscovery::release_plugins()
 {
     ServiceDiscovery::release_instance();
     ClientDiscovery::release_instance();
+    delete_patterns();
 }
 
 void AppIdDiscovery::tterm()
 {
     ClientDiscovery::get_instance().release_thread_resources();
     ServiceDiscovery::get_instance().release_thread_resources();
+
+    delete pattern_scan;
+    pattern_scan = nullptr;
 }
 
 void AppIdDiscovery::register_detector(const std::string& name, AppIdDetector* cd,  IpProtocol proto)
@@ -114,7 +168,7 @@ void AppIdDiscovery::register_detector(const std::string& name, AppIdDetector* c
 void AppIdDiscovery::add_pattern_data(AppIdDetector* detector, SearchTool* st, int position, const
     uint8_t* const pattern, unsigned size, unsigned nocase)
 {
-    AppIdPatternMatchNode* pd = new AppIdPatternMatchNode(detector, position, size);
+    AppIdPatternMatchNode* pd = new AppIdPatternMatchNode(this, detector, position, size);
     pattern_data.push_back(pd);
     st->add((const char*)pattern, size, pd, nocase);
 }
@@ -138,6 +192,44 @@ int AppIdDiscovery::add_service_port(AppIdDetector*, const ServiceDetectorPort&)
     return APPID_EINVALID;
 }
 
+static int collect_pattern_match(void* id, void*, int match_end_pos, void* data, void*)
+{
+    AppIdPatternMatchNode* pd = (AppIdPatternMatchNode*)id;
+
+    if ( pd->valid_match(match_end_pos) )
+        ((std::vector<AppIdPatternMatchNode*>*)data)->push_back(pd);
+
+    return 0;
+}
+
+const std::vector<AppIdPatternMatchNode*>& AppIdDiscovery::find_pattern_matches(
+    const Packet* p, IpProtocol proto)
+{
+    if ( !pattern_scan )
+        pattern_scan = new AppIdPatternScan;
+
+    PegCount packet_number = get_packet_number();
+
+    // service and client discovery usually ask for the same payload back to back
+    if ( pattern_scan->packet_number == packet_number and pattern_scan->data == p->data and
+        pattern_scan->dsize == p->dsize and pattern_scan->proto == proto )
+        return pattern_scan->matches;
+
+    pattern_scan->packet_number = packet_number;
+    pattern_scan->data = p->data;
+    pattern_scan->dsize = p->dsize;
+    pattern_scan->proto = proto;
+    pattern_scan->matches.clear();
+
+    SearchTool* patterns = (proto == IpProtocol::TCP) ? tcp_patterns : udp_patterns;
+
+    if ( patterns and p->dsize )
+        patterns->find_all((const char*)p->data, p->dsize, &collect_pattern_match, false,
+            (void*)&pattern_scan->matches);
+
+    return pattern_scan->matches;
+}
+
 void AppIdDiscovery::do_application_discovery(Packet* p, AppIdInspector& inspector)
 {
     IpProtocol protocol = IpProtocol::PROTO_NOT_SET;
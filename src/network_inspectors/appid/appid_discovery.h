@@ -37,6 +37,7 @@
 class AppIdInspector;
 class AppIdSession;
 class AppIdDetector;
+class AppIdDiscovery;
 class ServiceDetector;
 struct ServiceDetectorPort;
 
@@ -57,8 +58,8 @@ struct Packet;
 class AppIdPatternMatchNode
 {
 public:
-    AppIdPatternMatchNode(AppIdDetector* detector, int start, unsigned len)
-        : service(detector), pattern_start_pos(start), size(len) { }
+    AppIdPatternMatchNode(AppIdDiscovery* disco, AppIdDetector* detector, int start,
+        unsigned len) : owner(disco), service(detector), pattern_start_pos(start), size(len) { }
 
     bool valid_match(int end_position)
     {
@@ -68,6 +69,7 @@ public:
             return true;
     }
 
+    AppIdDiscovery* owner;
     AppIdDetector* service;
     int pattern_start_pos;
     unsigned size;
@@ -110,6 +112,11 @@ public:
 
     static void do_application_discovery(snort::Packet* p, AppIdInspector&);
 
+    // service and client payload patterns share one automaton per protocol; the
+    // payload is scanned once and each discovery picks out the hits it owns
+    static const std::vector<AppIdPatternMatchNode*>& find_pattern_matches(
+        const snort::Packet*, IpProtocol);
+
     AppIdDetectors* get_tcp_detectors()
     {
         return &tcp_detectors;
@@ -127,13 +134,17 @@ protected:
     AppIdInspector& inspector;
     AppIdDetectors tcp_detectors;
     AppIdDetectors udp_detectors;
-    snort::SearchTool* tcp_patterns = nullptr;
+    static snort::SearchTool* tcp_patterns;
     int tcp_pattern_count = 0;
-    snort::SearchTool* udp_patterns = nullptr;
+    static snort::SearchTool* udp_patterns;
     int udp_pattern_count = 0;
     std::vector<AppIdPatternMatchNode*> pattern_data;
 
 private:
+    static void create_patterns();
+    static void prep_patterns();
+    static void delete_patterns();
+
     static bool do_pre_discovery(snort::Packet* p, AppIdSession** p_asd, AppIdInspector& inspector,
         IpProtocol& protocol, AppidSessionDirection& direction);
     static bool do_discovery(snort::Packet* p, AppIdSession& asd, IpProtocol protocol,
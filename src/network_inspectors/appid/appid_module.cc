@@ -61,7 +61,7 @@ static const Parameter s_params[] =
       "the first packet of an already decrypted SSL flow (debug single session only)" },
 #endif
     { "memcap", Parameter::PT_INT, "0:", "0",
-      "disregard - not implemented" },  // FIXIT-M implement or delete appid.memcap
+      "max bytes of ranked service detector lists per packet thread (0 is unlimited)" },
     { "log_stats", Parameter::PT_BOOL, nullptr, "false",
       "enable logging of appid statistics" },
     { "app_stats_period", Parameter::PT_INT, "0:", "300",
@@ -84,6 +84,10 @@ static const Parameter s_params[] =
       "path to third party appid configuration file" },
     { "log_all_sessions", Parameter::PT_BOOL, nullptr, "false",
       "enable logging of all appid sessions" },
+    { "lua_detector_max_instructions", Parameter::PT_INT, "0:", "0",
+      "abort a lua detector call after this many VM instructions (0 is unlimited)" },
+    { "lua_detector_max_usecs", Parameter::PT_INT, "0:", "0",
+      "abort a lua detector call after this many microseconds (0 is unlimited)" },
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
@@ -196,6 +200,17 @@ static const PegInfo appid_pegs[] =
     { CountType::SUM, "ignored_packets", "count of packets ignored" },
     { CountType::SUM, "total_sessions", "count of sessions created" },
     { CountType::SUM, "appid_unknown", "count of sessions where appid could not be determined" },
+    { CountType::SUM, "service_detectors_tried", "count of service detector validations" },
+    { CountType::MAX, "max_service_detectors_tried",
+        "maximum service detector validations on a single flow" },
+    { CountType::SUM, "service_ranked_searches",
+        "count of brute force service searches ranked by first packet features" },
+    { CountType::SUM, "lua_detector_calls", "count of lua detector validate calls" },
+    { CountType::SUM, "lua_detector_usecs", "total microseconds in lua detector validate calls" },
+    { CountType::MAX, "max_lua_detector_usecs",
+        "maximum microseconds in a single lua detector validate call" },
+    { CountType::SUM, "lua_detector_budget_exceeded",
+        "count of lua detector calls aborted for exceeding their budget" },
     { CountType::END, nullptr, nullptr},
 };
 
@@ -259,6 +274,10 @@ bool AppIdModule::set(const char* fqn, Value& v, SnortConfig* c)
         config->dump_ports = v.get_bool();
     else if ( v.is("log_all_sessions") )
         config->log_all_sessions = v.get_bool();
+    else if ( v.is("lua_detector_max_instructions") )
+        config->lua_detector_max_instructions = v.get_long();
+    else if ( v.is("lua_detector_max_usecs") )
+        config->lua_detector_max_usecs = v.get_long();
     else
         return Module::set(fqn, v, c);
 
@@ -41,7 +41,14 @@ struct AppIdStats
     PegCount processed_packets;
     PegCount ignored_packets;
     PegCount total_sessions;
-    PegCount appid_unknown;  
+    PegCount appid_unknown;
+    PegCount service_detectors_tried;
+    PegCount max_service_detectors_tried;
+    PegCount service_ranked_searches;
+    PegCount lua_detector_calls;
+    PegCount lua_detector_usecs;
+    PegCount max_lua_detector_usecs;
+    PegCount lua_detector_budget_exceeded;
 };
 
 extern THREAD_LOCAL AppIdStats appid_stats;
@@ -35,6 +35,7 @@
 #include "length_app_cache.h"
 #include "service_state.h"
 
+class AppIdDetector;
 class ClientDetector;
 class ServiceDetector;
 class AppIdDnsSession;
@@ -192,6 +193,7 @@ public:
     ServiceDetector* service_detector = nullptr;
     snort::AppIdServiceSubtype* subtype = nullptr;
     std::vector<ServiceDetector*> service_candidates;
+    uint16_t service_detectors_tried = 0;
     ServiceAppDescriptor service;
     ClientAppDescriptor client;
     PayloadAppDescriptor payload;
@@ -206,6 +208,8 @@ public:
     AppId referred_payload_app_id = APP_ID_NONE;
     AppId misc_app_id = APP_ID_NONE;
 
+    // lua detectors that ran over their budget are not called again on this flow
+    std::vector<const AppIdDetector*> disabled_lua_detectors;
 
     // FIXIT-M netbios_name is never set to a valid value
     char* netbios_name = nullptr;
@@ -259,6 +263,15 @@ public:
     bool is_client_detected() { return common.flags & APPID_SESSION_CLIENT_DETECTED; }
     bool is_decrypted() { return common.flags & APPID_SESSION_DECRYPTED; }
 
+    void disable_lua_detector(const AppIdDetector* ad) { disabled_lua_detectors.push_back(ad); }
+    bool is_lua_detector_disabled(const AppIdDetector* ad) const
+    {
+        for ( auto d : disabled_lua_detectors )
+            if ( d == ad )
+                return true;
+        return false;
+    }
+
     void* get_flow_data(unsigned id);
     int add_flow_data(void* data, unsigned id, AppIdFreeFCN);
     int add_flow_data_id(uint16_t port, ServiceDetector*);
@@ -129,58 +129,33 @@ void ClientDiscovery::finalize_client_plugins()
 
     for ( auto kv : udp_detectors )
         kv.second->finalize();
-
-    if ( tcp_patterns )
-        tcp_patterns->prep();
-
-    if ( udp_patterns )
-        udp_patterns->prep();
 }
 
-/*
- * Callback function for string search
- *
- * @param   id      id in array of search strings from pop_config.cmds
- * @param   index   index in array of search strings from pop_config.cmds
- * @param   data    buffer passed in to search function
- *
- * @return response
- * @retval 1        commands caller to stop searching
- */
-static int pattern_match(void* id, void* /*unused_tree*/, int match_end_pos, void* data,
-    void* /*unused_neg*/)
+static void pattern_match(const AppIdPatternMatchNode* pd, ClientAppMatch** matches)
 {
-    ClientAppMatch** matches = (ClientAppMatch**)data;
-    AppIdPatternMatchNode* pd = (AppIdPatternMatchNode*)id;
-
-    if ( pd->valid_match(match_end_pos) )
-    {
-        ClientAppMatch* cam;
+    ClientAppMatch* cam;
 
-        for (cam = *matches; cam; cam = cam->next)
-            if (cam->detector == pd->service)
-                break;
+    for (cam = *matches; cam; cam = cam->next)
+        if (cam->detector == pd->service)
+            break;
 
-        if (cam)
-            cam->count++;
-        else
+    if (cam)
+        cam->count++;
+    else
+    {
+        if (match_free_list)
         {
-            if (match_free_list)
-            {
-                cam = match_free_list;
-                match_free_list = cam->next;
-            }
-            else
-                cam = (ClientAppMatch*)snort_alloc(sizeof(ClientAppMatch));
-
-            cam->count = 1;
-            cam->detector =  static_cast<const ClientDetector*>(pd->service);
-            cam->next = *matches;
-            *matches = cam;
+            cam = match_free_list;
+            match_free_list = cam->next;
         }
-    }
+        else
+            cam = (ClientAppMatch*)snort_alloc(sizeof(ClientAppMatch));
 
-    return 0;
+        cam->count = 1;
+        cam->detector =  static_cast<const ClientDetector*>(pd->service);
+        cam->next = *matches;
+        *matches = cam;
+    }
 }
 
 static const ClientDetector* get_next_detector(ClientAppMatch** match_list)
@@ -245,15 +220,10 @@ static void free_matched_list(ClientAppMatch** match_list)
 ClientAppMatch* ClientDiscovery::find_detector_candidates(const Packet* pkt, IpProtocol protocol)
 {
     ClientAppMatch* match_list = nullptr;
-    SearchTool* patterns;
-
-    if (protocol == IpProtocol::TCP)
-        patterns = ClientDiscovery::get_instance().tcp_patterns;
-    else
-        patterns = ClientDiscovery::get_instance().udp_patterns;
 
-    if ( patterns )
-        patterns->find_all((const char*)pkt->data, pkt->dsize, &pattern_match, false, (void*)&match_list);
+    for ( auto pd : find_pattern_matches(pkt, protocol) )
+        if ( pd->owner == this )
+            pattern_match(pd, &match_list);
 
     return match_list;
 }
@@ -2485,7 +2485,7 @@ int register_detector(lua_State* L)
     return 1;                         /* return methods on the stack */
 }
 
-int LuaStateDescriptor::lua_validate(AppIdDiscoveryArgs& args)
+int LuaStateDescriptor::lua_validate(const AppIdDetector* ad, AppIdDiscoveryArgs& args)
 {
     Profile lua_detector_context(luaCustomPerfStats);
 
@@ -2496,6 +2496,9 @@ int LuaStateDescriptor::lua_validate(AppIdDiscoveryArgs& args)
         return APPID_ENULL;
     }
 
+    if ( args.asd.is_lua_detector_disabled(ad) )
+        return APPID_NOMATCH;
+
     // get the table for this chunk (env)
     lua_getfield(my_lua_state, LUA_REGISTRYINDEX, package_info.name.c_str());
     ldp.data = args.data;
@@ -2525,7 +2528,32 @@ int LuaStateDescriptor::lua_validate(AppIdDiscoveryArgs& args)
 
     lua_getfield(my_lua_state, -1, validateFn); // get the function we want to call
 
-    if ( lua_pcall(my_lua_state, 0, 1, 0) )
+    uint64_t usecs;
+    lua_detector_mgr->start_call();
+    int err = lua_pcall(my_lua_state, 0, 1, 0);
+    bool in_budget = lua_detector_mgr->end_call(usecs);
+
+    appid_stats.lua_detector_calls++;
+    appid_stats.lua_detector_usecs += usecs;
+    if ( usecs > appid_stats.max_lua_detector_usecs )
+        appid_stats.max_lua_detector_usecs = usecs;
+
+    if ( !in_budget )
+    {
+        // a call that completed anyway keeps its result, but either way the
+        // detector is not given another chance on this flow
+        appid_stats.lua_detector_budget_exceeded++;
+        args.asd.disable_lua_detector(ad);
+
+        if ( err )
+        {
+            LuaDetectorManager::free_detector_flows();
+            ldp.pkt = nullptr;
+            return APPID_NOMATCH;
+        }
+    }
+
+    if ( err )
     {
         // Runtime Lua errors are suppressed in production code since detectors are written for
         // efficiency and with defensive minimum checks. Errors are dealt as exceptions
@@ -2634,7 +2662,7 @@ int LuaServiceDetector::validate(AppIdDiscoveryArgs& args)
     std::string name = this->name + "_";
     lua_getglobal(my_lua_state, name.c_str());
     auto& ud = *UserData<LuaServiceObject>::check(my_lua_state, DETECTOR, 1);
-    return ud->lsd.lua_validate(args);
+    return ud->lsd.lua_validate(this, args);
 }
 
 LuaClientDetector::LuaClientDetector(AppIdDiscovery* cdm, const std::string& detector_name,
@@ -2711,5 +2739,5 @@ int LuaClientDetector::validate(AppIdDiscoveryArgs& args)
     lua_settop(my_lua_state,0); //set stack index to 0
     lua_getglobal(my_lua_state, name.c_str());
     auto& ud = *UserData<LuaClientObject>::check(my_lua_state, DETECTOR, 1);
-    return ud->lsd.lua_validate(args);
+    return ud->lsd.lua_validate(this, args);
 }
@@ -82,7 +82,7 @@ public:
     //int detector_user_data_ref = 0;    // key into LUA_REGISTRYINDEX
     DetectorPackageInfo package_info;
     AppId service_id = APP_ID_UNKNOWN;
-    int lua_validate(AppIdDiscoveryArgs&);
+    int lua_validate(const AppIdDetector*, AppIdDiscoveryArgs&);
 };
 
 class LuaServiceDetector : public ServiceDetector
@@ -29,6 +29,7 @@
 #include <libgen.h>
 
 #include <cassert>
+#include <unordered_map>
 
 #include "appid_config.h"
 #include "lua_detector_util.h"
@@ -45,10 +46,21 @@ using namespace snort;
 #define MAX_DEFAULT_NUM_LUA_TRACKERS  10000
 #define AVG_LUA_TRACKER_SIZE_IN_BYTES 740
 #define MAX_MEMORY_FOR_LUA_DETECTORS (512 * 1024 * 1024)
+#define LUA_BUDGET_CHECK_INTERVAL 1000   // VM instructions between budget checks
 
 THREAD_LOCAL LuaDetectorManager* lua_detector_mgr = nullptr;
 static THREAD_LOCAL SF_LIST allocated_detector_flow_list;
 
+// detector bytecode compiled once by the control thread; packet threads load
+// their copy from here instead of parsing every script again
+static std::unordered_map<std::string, std::string> detector_bytecode;
+
+static int dump_chunk(lua_State*, const void* p, size_t sz, void* ud)
+{
+    static_cast<std::string*>(ud)->append(static_cast<const char*>(p), sz);
+    return 0;
+}
+
 bool get_lua_field(lua_State* L, int table, const char* field, std::string& out)
 {
     lua_getfield(L, table, field);
@@ -156,6 +168,21 @@ LuaDetectorManager::LuaDetectorManager(AppIdConfig& config, int is_control) :
     L = create_lua_state(config.mod_config, is_control);
     if (is_control == 1)
         init_chp_glossary();
+    else
+    {
+        max_instructions = config.mod_config->lua_detector_max_instructions;
+
+        if ( config.mod_config->lua_detector_max_usecs )
+        {
+            long t = clock_ticks(config.mod_config->lua_detector_max_usecs);
+            max_time = TO_DURATION(max_time, t);
+        }
+
+        if ( max_instructions and max_instructions < LUA_BUDGET_CHECK_INTERVAL )
+            hook_count = max_instructions;
+        else if ( max_instructions or max_time > 0_ticks )
+            hook_count = LUA_BUDGET_CHECK_INTERVAL;
+    }
 }
 
 LuaDetectorManager::~LuaDetectorManager()
@@ -187,6 +214,8 @@ LuaDetectorManager::~LuaDetectorManager()
             }
 	    delete lua_object;
         }
+        if (init(L))
+            detector_bytecode.clear();
         lua_close(L);
     }
 
@@ -230,6 +259,54 @@ void LuaDetectorManager::free_detector_flows()
     sflist_static_free_all(&allocated_detector_flow_list, free_detector_flow);
 }
 
+void LuaDetectorManager::budget_hook(lua_State* L, lua_Debug*)
+{
+    LuaDetectorManager* mgr = lua_detector_mgr;
+
+    if ( mgr->max_instructions )
+    {
+        mgr->instructions += mgr->hook_count;
+
+        if ( mgr->instructions >= mgr->max_instructions )
+            mgr->over_budget = true;
+    }
+
+    if ( !mgr->over_budget and mgr->max_time > 0_ticks and mgr->call_time.get() > mgr->max_time )
+        mgr->over_budget = true;
+
+    if ( mgr->over_budget )
+        luaL_error(L, "detector exceeded its budget");
+}
+
+void LuaDetectorManager::start_call()
+{
+    over_budget = false;
+    instructions = 0;
+    call_time.reset();
+    call_time.start();
+
+    // the hook only sees interpreted code; JIT compiled traces are caught by
+    // the elapsed time check in end_call()
+    if ( hook_count )
+        lua_sethook(L, budget_hook, LUA_MASKCOUNT, hook_count);
+}
+
+bool LuaDetectorManager::end_call(uint64_t& usecs)
+{
+    call_time.stop();
+
+    if ( hook_count )
+        lua_sethook(L, nullptr, 0, 0);
+
+    hr_duration elapsed = call_time.get();
+    usecs = clock_usecs(TO_USECS(elapsed));
+
+    if ( max_time > 0_ticks and elapsed > max_time )
+        over_budget = true;
+
+    return !over_budget;
+}
+
 /**calculates Number of flow and host tracker entries for Lua detectors, given amount
  * of memory allocated to RNA (fraction of total system memory) and number of detectors
  * loaded in database. Calculations are based on CAICCI detector and observing memory
@@ -350,9 +427,40 @@ static LuaObject* create_lua_detector(lua_State* L, const char* detector_name, b
     return nullptr;
 }
 
+bool LuaDetectorManager::load_chunk(const char* filename)
+{
+    if ( !init(L) )
+    {
+        auto it = detector_bytecode.find(filename);
+
+        if ( it != detector_bytecode.end() )
+        {
+            std::string chunk_name = std::string("@") + filename;
+
+            if ( !luaL_loadbuffer(L, it->second.data(), it->second.size(), chunk_name.c_str()) )
+                return true;
+
+            lua_pop(L, 1);  // pop the error, fall back to the source
+        }
+    }
+
+    if ( luaL_loadfile(L, filename) )
+        return false;
+
+    if ( init(L) )
+    {
+        std::string& code = detector_bytecode[filename];
+        code.clear();
+
+        if ( lua_dump(L, dump_chunk, &code) )
+            detector_bytecode.erase(filename);
+    }
+    return true;
+}
+
 void LuaDetectorManager::load_detector(char* detector_filename, bool isCustom)
 {
-    if (luaL_loadfile(L, detector_filename))
+    if (!load_chunk(detector_filename))
     {
         if (init(L))
             ErrorMessage("Error - appid: can not load Lua detector, %s\n", lua_tostring(L, -1));
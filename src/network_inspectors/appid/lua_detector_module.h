@@ -31,6 +31,8 @@
 
 #include "main/thread.h"
 #include "protocols/protocol_ids.h"
+#include "time/clock_defs.h"
+#include "time/stopwatch.h"
 
 class AppIdConfig;
 class AppIdDetector;
@@ -50,6 +52,12 @@ public:
     static void terminate();
     static void add_detector_flow(DetectorFlow*);
     static void free_detector_flows();
+
+    // a detector call is bounded by the configured instruction and time budgets;
+    // end_call() returns false if the call ran over either one
+    void start_call();
+    bool end_call(uint64_t& usecs);
+
     // FIXIT-M: RELOAD - When reload is supported, move this variable to a separate location
     lua_State* L;
 
@@ -57,12 +65,21 @@ private:
     void initialize_lua_detectors();
     void activate_lua_detectors();
     void list_lua_detectors();
+    bool load_chunk(const char* filename);
     void load_detector(char* detectorName, bool isCustom);
     void load_lua_detectors(const char* path, bool isCustom);
+    static void budget_hook(lua_State*, lua_Debug*);
 
     AppIdConfig& config;
     std::list<LuaObject*> allocated_objects;
     size_t num_odp_detectors = 0;
+
+    Stopwatch<SnortClock> call_time;
+    hr_duration max_time = 0_ticks;
+    uint64_t max_instructions = 0;
+    uint64_t instructions = 0;
+    int hook_count = 0;
+    bool over_budget = false;
 };
 
 extern THREAD_LOCAL LuaDetectorManager* lua_detector_mgr;
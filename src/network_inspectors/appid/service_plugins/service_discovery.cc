@@ -35,6 +35,7 @@
 #include "appid_config.h"
 #include "appid_debug.h"
 #include "appid_dns_session.h"
+#include "appid_module.h"
 #include "appid_session.h"
 #include "detector_plugins/detector_dns.h"
 #include "detector_plugins/detector_http.h"
@@ -176,14 +177,6 @@ void ServiceDiscovery::initialize()
     }
 }
 
-void ServiceDiscovery::finalize_service_patterns()
-{
-    if (tcp_patterns)
-        tcp_patterns->prep();
-    if (udp_patterns)
-        udp_patterns->prep();
-}
-
 int ServiceDiscovery::add_service_port(AppIdDetector* detector, const ServiceDetectorPort& pp)
 {
     ServiceDetector* service = static_cast<ServiceDetector*>(detector);
@@ -194,6 +187,7 @@ int ServiceDiscovery::add_service_port(AppIdDetector* detector, const ServiceDet
             ftp_service = service;
 
         tcp_services[ pp.port ].push_back(service);
+        tcp_features.add_port(service, pp.port);
     }
     else if (pp.proto == IpProtocol::UDP)
     {
@@ -201,6 +195,8 @@ int ServiceDiscovery::add_service_port(AppIdDetector* detector, const ServiceDet
             udp_services[ pp.port ].push_back(service);
         else
             udp_reversed_services[ pp.port ].push_back(service);
+
+        udp_features.add_port(service, pp.port);
     }
     else
     {
@@ -212,6 +208,65 @@ int ServiceDiscovery::add_service_port(AppIdDetector* detector, const ServiceDet
     return 0;
 }
 
+void ServiceDiscovery::register_tcp_pattern(AppIdDetector* detector, const uint8_t* const pattern,
+    unsigned size, int position, unsigned nocase)
+{
+    tcp_features.add_pattern(static_cast<ServiceDetector*>(detector), pattern, size, position,
+        nocase);
+    AppIdDiscovery::register_tcp_pattern(detector, pattern, size, position, nocase);
+}
+
+void ServiceDiscovery::register_udp_pattern(AppIdDetector* detector, const uint8_t* const pattern,
+    unsigned size, int position, unsigned nocase)
+{
+    udp_features.add_pattern(static_cast<ServiceDetector*>(detector), pattern, size, position,
+        nocase);
+    AppIdDiscovery::register_udp_pattern(detector, pattern, size, position, nocase);
+}
+
+void ServiceDiscovery::rank_detectors(IpProtocol proto, const ServiceFeatures* sf,
+    std::vector<ServiceDetector*>& list)
+{
+    AppIdDetectors* detectors;
+    ServiceFeatureIndex* features;
+
+    if ( proto == IpProtocol::TCP )
+    {
+        detectors = &tcp_detectors;
+        features = &tcp_features;
+    }
+    else if ( proto == IpProtocol::UDP )
+    {
+        detectors = &udp_detectors;
+        features = &udp_features;
+    }
+    else
+        return;
+
+    list.clear();
+    list.reserve(detectors->size());
+
+    for ( auto& kv : *detectors )
+        list.push_back(static_cast<ServiceDetector*>(kv.second));
+
+    if ( sf )
+    {
+        features->rank(*sf, list);
+        appid_stats.service_ranked_searches++;
+    }
+}
+
+int ServiceDiscovery::validate_service(ServiceDetector* service, AppIdDiscoveryArgs& args,
+    AppIdSession& asd)
+{
+    appid_stats.service_detectors_tried++;
+
+    if ( ++asd.service_detectors_tried > appid_stats.max_service_detectors_tried )
+        appid_stats.max_service_detectors_tried = asd.service_detectors_tried;
+
+    return service->validate(args);
+}
+
 static int AppIdPatternPrecedence(const void* a, const void* b)
 {
     const ServiceMatch* sm1 = (const ServiceMatch*)a;
@@ -224,33 +279,25 @@ static int AppIdPatternPrecedence(const void* a, const void* b)
         return (sm2->size - sm1->size);
 }
 
-static int pattern_match(void* id, void*, int match_end_pos, void* data, void*)
+static void pattern_match(const AppIdPatternMatchNode* pd, ServiceMatch** matches)
 {
-    ServiceMatch** matches = (ServiceMatch**)data;
-    AppIdPatternMatchNode* pd = (AppIdPatternMatchNode*)id;
+    ServiceMatch* sm;
 
-    if ( pd->valid_match(match_end_pos) )
-    {
-        ServiceMatch* sm;
-
-        for (sm = *matches; sm; sm = sm->next)
-            if (sm->service == (ServiceDetector*)pd->service)
-                break;
+    for (sm = *matches; sm; sm = sm->next)
+        if (sm->service == (ServiceDetector*)pd->service)
+            break;
 
-        if (sm)
-            sm->count++;
-        else
-        {
-            sm = (ServiceMatch*)snort_calloc(sizeof(ServiceMatch));
-            sm->count++;
-            sm->service = static_cast<ServiceDetector*>(pd->service);
-            sm->size = pd->size;
-            sm->next = *matches;
-            *matches = sm;
-        }
+    if (sm)
+        sm->count++;
+    else
+    {
+        sm = (ServiceMatch*)snort_calloc(sizeof(ServiceMatch));
+        sm->count++;
+        sm->service = static_cast<ServiceDetector*>(pd->service);
+        sm->size = pd->size;
+        sm->next = *matches;
+        *matches = sm;
     }
-
-    return 0;
 }
 
 /**Perform pattern match of a packet and construct a list of services sorted in order of
@@ -263,35 +310,27 @@ static int pattern_match(void* id, void*, int match_end_pos, void* data, void*)
 */
 void ServiceDiscovery::match_by_pattern(AppIdSession& asd, const Packet* pkt, IpProtocol proto)
 {
-    SearchTool* patterns = nullptr;
+    ServiceMatch* match_list = nullptr;
 
-    if (proto == IpProtocol::TCP)
-        patterns = tcp_patterns;
-    else
-        patterns = udp_patterns;
-
-    if (patterns)
-    {
-        ServiceMatch* match_list = nullptr;
-        patterns->find_all((const char*)pkt->data, pkt->dsize, &pattern_match, false,
-            (void*)&match_list);
+    for ( auto pd : find_pattern_matches(pkt, proto) )
+        if ( pd->owner == this )
+            pattern_match(pd, &match_list);
 
-        std::vector<ServiceMatch*> smOrderedList;
-        for (ServiceMatch* sm = match_list; sm; sm = sm->next)
-            smOrderedList.push_back(sm);
+    std::vector<ServiceMatch*> smOrderedList;
+    for (ServiceMatch* sm = match_list; sm; sm = sm->next)
+        smOrderedList.push_back(sm);
 
-        if (!smOrderedList.empty() )
+    if (!smOrderedList.empty() )
+    {
+        std::sort(smOrderedList.begin(), smOrderedList.end(), AppIdPatternPrecedence);
+        for ( auto& sm : smOrderedList )
         {
-            std::sort(smOrderedList.begin(), smOrderedList.end(), AppIdPatternPrecedence);
-            for ( auto& sm : smOrderedList )
+            if ( std::find(asd.service_candidates.begin(), asd.service_candidates.end(),
+                sm->service) == asd.service_candidates.end() )
             {
-                if ( std::find(asd.service_candidates.begin(), asd.service_candidates.end(),
-                    sm->service) == asd.service_candidates.end() )
-                {
-                    asd.service_candidates.push_back(sm->service);
-                }
-                snort_free(sm);
+                asd.service_candidates.push_back(sm->service);
             }
+            snort_free(sm);
         }
     }
 }
@@ -366,8 +405,15 @@ void ServiceDiscovery::get_next_service(const Packet* p, const AppidSessionDirec
     /* See if there are any port detectors to try.  If not, move onto patterns. */
     if ( asd.service_search_state == SESSION_SERVICE_SEARCH_STATE::PORT )
     {
-        get_port_based_services(proto,
-            (dir ==  APP_ID_FROM_RESPONDER) ? p->ptrs.sp : p->ptrs.dp, asd);
+        uint16_t port = (dir ==  APP_ID_FROM_RESPONDER) ? p->ptrs.sp : p->ptrs.dp;
+        get_port_based_services(proto, port, asd);
+
+        ServiceFeatures sf = { p->data, p->dsize, dir, port };
+        if ( proto == IpProtocol::TCP )
+            tcp_features.rank(sf, asd.service_candidates);
+        else
+            udp_features.rank(sf, asd.service_candidates);
+
         asd.service_search_state = SESSION_SERVICE_SEARCH_STATE::PATTERN;
     }
 
@@ -463,7 +509,8 @@ int ServiceDiscovery::identify_service(AppIdSession& asd, Packet* p, AppidSessio
             else if ( sds_state == SERVICE_ID_STATE::SEARCHING_BRUTE_FORCE and
                       asd.service_candidates.empty() )
             {
-                asd.service_detector = sds->select_detector_by_brute_force(proto);
+                ServiceFeatures sf = { p->data, p->dsize, dir, port };
+                asd.service_detector = sds->select_detector_by_brute_force(proto, &sf);
                 got_brute_force = true;
             }
         }
@@ -476,7 +523,7 @@ int ServiceDiscovery::identify_service(AppIdSession& asd, Packet* p, AppidSessio
     /* If we already have a service to try, then try it out. */
     if ( asd.service_detector )
     {
-        ret = asd.service_detector->validate(args);
+        ret = validate_service(asd.service_detector, args, asd);
         if (ret == APPID_NOMATCH)
             got_fail_service = true;
         else if (ret == APPID_NOT_COMPATIBLE)
@@ -506,7 +553,7 @@ int ServiceDiscovery::identify_service(AppIdSession& asd, Packet* p, AppidSessio
             ServiceDetector* service = (ServiceDetector*)*it;
             int result;
 
-            result = service->validate(args);
+            result = validate_service(service, args, asd);
             if ( appidDebug->is_active() )
                 LogMessage("AppIdDbg %s %s service candidate returned %s (%d)\n",
                     appidDebug->get_debug_session(), service->get_log_name().c_str(),
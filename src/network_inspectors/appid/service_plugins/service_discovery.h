@@ -32,8 +32,10 @@
 #include "utils/sflsq.h"
 
 #include "appid_types.h"
+#include "service_feature_index.h"
 
 class AppIdConfig;
+class AppIdDiscoveryArgs;
 class AppIdSession;
 class ServiceDetector;
 class ServiceDiscoveryState;
@@ -71,8 +73,14 @@ public:
     static ServiceDiscovery& get_instance(AppIdInspector* ins = nullptr);
     static void release_instance();
 
-    void finalize_service_patterns();
     int add_service_port(AppIdDetector*, const ServiceDetectorPort&) override;
+    void register_tcp_pattern(AppIdDetector*, const uint8_t* const pattern, unsigned size,
+        int position, unsigned nocase) override;
+    void register_udp_pattern(AppIdDetector*, const uint8_t* const pattern, unsigned size,
+        int position, unsigned nocase) override;
+
+    // brute force order for an unknown service, most likely detectors first
+    void rank_detectors(IpProtocol, const ServiceFeatures*, std::vector<ServiceDetector*>&);
 
     AppIdDetectorsIterator get_detector_iterator(IpProtocol);
     ServiceDetector* get_next_tcp_detector(AppIdDetectorsIterator&);
@@ -90,11 +98,14 @@ private:
     void get_next_service(const snort::Packet*, const AppidSessionDirection dir, AppIdSession&);
     void get_port_based_services(IpProtocol, uint16_t port, AppIdSession&);
     void match_by_pattern(AppIdSession&, const snort::Packet*, IpProtocol);
+    int validate_service(ServiceDetector*, AppIdDiscoveryArgs&, AppIdSession&);
     static ServiceDiscovery* discovery_manager;
     std::vector<AppIdDetector*> service_detector_list;
     std::unordered_map<uint16_t, std::vector<ServiceDetector*> > tcp_services;
     std::unordered_map<uint16_t, std::vector<ServiceDetector*> > udp_services;
     std::unordered_map<uint16_t, std::vector<ServiceDetector*> > udp_reversed_services;
+    ServiceFeatureIndex tcp_features;
+    ServiceFeatureIndex udp_features;
 };
 
 #endif
@@ -0,0 +1,169 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "service_feature_index.h"
+
+#include <algorithm>
+#include <cctype>
+
+// anchored prefix hits dominate; the port class only breaks ties
+#define PREFIX_WEIGHT      2
+#define PORT_CLASS_WEIGHT  1
+#define MISMATCH_PENALTY   1
+
+#define PORT_CLASS_WELL_KNOWN 0x01
+#define PORT_CLASS_REGISTERED 0x02
+#define PORT_CLASS_DYNAMIC    0x04
+
+static inline uint8_t get_port_class(uint16_t port)
+{
+    if ( port < 1024 )
+        return PORT_CLASS_WELL_KNOWN;
+
+    if ( port < 49152 )
+        return PORT_CLASS_REGISTERED;
+
+    return PORT_CLASS_DYNAMIC;
+}
+
+ServiceFeatureIndex::Entry& ServiceFeatureIndex::get_entry(ServiceDetector* sd)
+{
+    auto it = slots.find(sd);
+
+    if ( it != slots.end() )
+        return entries[it->second];
+
+    slots[sd] = entries.size();
+    entries.emplace_back();
+    return entries.back();
+}
+
+const ServiceFeatureIndex::Entry* ServiceFeatureIndex::find_entry(const ServiceDetector* sd) const
+{
+    auto it = slots.find(sd);
+    return (it != slots.end()) ? &entries[it->second] : nullptr;
+}
+
+void ServiceFeatureIndex::add_pattern(
+    ServiceDetector* sd, const uint8_t* pattern, unsigned size, int position, bool nocase)
+{
+    Entry& e = get_entry(sd);
+
+    if ( position < 0 or !size )
+    {
+        e.floating = true;
+        return;
+    }
+
+    unsigned end = position + size;
+
+    if ( end < e.min_size )
+        e.min_size = end;
+
+    // only patterns at offset 0 say anything about the leading bytes
+    if ( position > 0 )
+        return;
+
+    Prefix pre;
+    pre.len = (size < max_prefix) ? size : max_prefix;
+    pre.nocase = nocase;
+
+    for ( unsigned i = 0; i < pre.len; i++ )
+        pre.bytes[i] = nocase ? tolower(pattern[i]) : pattern[i];
+
+    e.prefixes.push_back(pre);
+}
+
+void ServiceFeatureIndex::add_port(ServiceDetector* sd, uint16_t port)
+{
+    get_entry(sd).port_classes |= get_port_class(port);
+}
+
+unsigned ServiceFeatureIndex::match_prefix(const Entry& e, const ServiceFeatures& f) const
+{
+    unsigned best = 0;
+
+    for ( const auto& pre : e.prefixes )
+    {
+        unsigned n = 0;
+
+        while ( n < pre.len and n < f.size )
+        {
+            uint8_t b = pre.nocase ? tolower(f.data[n]) : f.data[n];
+
+            if ( b != pre.bytes[n] )
+                break;
+
+            n++;
+        }
+        if ( n > best )
+            best = n;
+    }
+    return best;
+}
+
+int ServiceFeatureIndex::get_score(const ServiceDetector* sd, const ServiceFeatures& f) const
+{
+    const Entry* e = find_entry(sd);
+
+    if ( !e )
+        return 0;
+
+    int score = 0;
+
+    if ( f.port and (e->port_classes & get_port_class(f.port)) )
+        score += PORT_CLASS_WEIGHT;
+
+    if ( e->prefixes.empty() or !f.size )
+        return score;
+
+    // service patterns mostly describe what the server sends, so a hit on
+    // responder data is stronger evidence than one on initiator data
+    unsigned n = match_prefix(*e, f);
+
+    if ( n )
+        score += n * ((f.dir == APP_ID_FROM_RESPONDER) ? PREFIX_WEIGHT : 1);
+    else if ( f.dir == APP_ID_FROM_RESPONDER and !e->floating and f.size >= e->min_size )
+        score -= MISMATCH_PENALTY;
+
+    return score;
+}
+
+void ServiceFeatureIndex::rank(const ServiceFeatures& f, std::vector<ServiceDetector*>& list) const
+{
+    if ( list.size() < 2 )
+        return;
+
+    std::vector<std::pair<int, ServiceDetector*>> scored;
+    scored.reserve(list.size());
+
+    for ( auto sd : list )
+        scored.emplace_back(get_score(sd, f), sd);
+
+    std::stable_sort(scored.begin(), scored.end(),
+        [](const std::pair<int, ServiceDetector*>& a, const std::pair<int, ServiceDetector*>& b)
+        { return a.first > b.first; });
+
+    for ( unsigned i = 0; i < scored.size(); i++ )
+        list[i] = scored[i].second;
+}
+
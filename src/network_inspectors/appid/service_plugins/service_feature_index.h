@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+#ifndef SERVICE_FEATURE_INDEX_H
+#define SERVICE_FEATURE_INDEX_H
+
+// ServiceFeatureIndex is a compact summary of what each service detector
+// registered (anchored pattern prefixes, minimum payload length, port
+// classes).  It scores detectors against the first packet of a flow so that
+// port and brute force candidates are tried most likely first instead of in
+// registration order.  Ranking never removes a detector; it only reorders.
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "appid_types.h"
+
+class ServiceDetector;
+
+struct ServiceFeatures
+{
+    const uint8_t* data;
+    uint16_t size;
+    AppidSessionDirection dir;
+    uint16_t port;
+};
+
+class ServiceFeatureIndex
+{
+public:
+    void add_pattern(ServiceDetector*, const uint8_t* pattern, unsigned size, int position,
+        bool nocase);
+    void add_port(ServiceDetector*, uint16_t port);
+
+    int get_score(const ServiceDetector*, const ServiceFeatures&) const;
+
+    // stable sort, highest score first; ties keep their current order
+    void rank(const ServiceFeatures&, std::vector<ServiceDetector*>&) const;
+
+    unsigned get_detector_count() const
+    { return entries.size(); }
+
+    static const unsigned max_prefix = 4;
+
+private:
+    struct Prefix
+    {
+        uint8_t bytes[max_prefix];
+        uint8_t len;
+        bool nocase;
+    };
+
+    struct Entry
+    {
+        std::vector<Prefix> prefixes;
+        uint16_t min_size = UINT16_MAX;
+        uint8_t port_classes = 0;
+        bool floating = false;
+    };
+
+    Entry& get_entry(ServiceDetector*);
+    const Entry* find_entry(const ServiceDetector*) const;
+    unsigned match_prefix(const Entry&, const ServiceFeatures&) const;
+
+    std::vector<Entry> entries;
+    std::unordered_map<const ServiceDetector*, unsigned> slots;
+};
+
+#endif
+
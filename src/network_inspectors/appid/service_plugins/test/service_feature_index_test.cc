@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// service_feature_index_test.cc
+// unit tests for first packet ranking of service detectors
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "network_inspectors/appid/service_plugins/service_feature_index.cc"
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+// detectors are only used as keys here
+static ServiceDetector* const ssh = (ServiceDetector*)0x10;
+static ServiceDetector* const ftp = (ServiceDetector*)0x20;
+static ServiceDetector* const rpc = (ServiceDetector*)0x30;
+
+static const uint8_t ssh_banner[] = "SSH-2.0-OpenSSH_7.4";
+static const uint8_t ftp_banner[] = "220 ProFTPD Server";
+
+TEST_GROUP(service_feature_index)
+{
+    ServiceFeatureIndex index;
+
+    void setup() override
+    {
+        index.add_pattern(ssh, (const uint8_t*)"SSH-", 4, 0, false);
+        index.add_port(ssh, 22);
+        index.add_pattern(ftp, (const uint8_t*)"220 ", 4, 0, false);
+        index.add_port(ftp, 21);
+        index.add_pattern(rpc, (const uint8_t*)"\x00\x00\x00\x02", 4, 4, false);
+        index.add_port(rpc, 111);
+    }
+};
+
+TEST(service_feature_index, unknown_detector_scores_zero)
+{
+    ServiceFeatures sf = { ssh_banner, sizeof(ssh_banner) - 1, APP_ID_FROM_RESPONDER, 2222 };
+    CHECK_EQUAL(0, index.get_score((ServiceDetector*)0x40, sf));
+}
+
+TEST(service_feature_index, responder_prefix_outranks_port)
+{
+    ServiceFeatures sf = { ssh_banner, sizeof(ssh_banner) - 1, APP_ID_FROM_RESPONDER, 2222 };
+    std::vector<ServiceDetector*> list = { rpc, ftp, ssh };
+
+    index.rank(sf, list);
+    CHECK(list[0] == ssh);
+    CHECK(list.size() == 3);
+}
+
+TEST(service_feature_index, initiator_prefix_weighs_less)
+{
+    ServiceFeatures resp = { ftp_banner, sizeof(ftp_banner) - 1, APP_ID_FROM_RESPONDER, 0 };
+    ServiceFeatures init = { ftp_banner, sizeof(ftp_banner) - 1, APP_ID_FROM_INITIATOR, 0 };
+
+    CHECK(index.get_score(ftp, resp) > index.get_score(ftp, init));
+    CHECK(index.get_score(ftp, init) > 0);
+}
+
+TEST(service_feature_index, mismatch_demotes_anchored_detector)
+{
+    ServiceFeatures sf = { ftp_banner, sizeof(ftp_banner) - 1, APP_ID_FROM_RESPONDER, 0 };
+    CHECK(index.get_score(ssh, sf) < 0);
+}
+
+TEST(service_feature_index, ties_keep_order)
+{
+    ServiceFeatures sf = { nullptr, 0, APP_ID_FROM_INITIATOR, 0 };
+    std::vector<ServiceDetector*> list = { rpc, ftp, ssh };
+
+    index.rank(sf, list);
+    CHECK(list[0] == rpc);
+    CHECK(list[1] == ftp);
+    CHECK(list[2] == ssh);
+}
+
+TEST(service_feature_index, nocase_prefix)
+{
+    ServiceDetector* http = (ServiceDetector*)0x50;
+    static const uint8_t resp[] = "http/1.1 200 OK";
+    ServiceFeatures sf = { resp, sizeof(resp) - 1, APP_ID_FROM_RESPONDER, 8080 };
+
+    index.add_pattern(http, (const uint8_t*)"HTTP/", 5, 0, true);
+    CHECK_EQUAL(2 * ServiceFeatureIndex::max_prefix, (unsigned)index.get_score(http, sf));
+}
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -25,6 +25,7 @@
 
 #include "service_state.h"
 
+#include <cassert>
 #include <map>
 
 #include "log/messages.h"
@@ -37,6 +38,37 @@
 
 using namespace snort;
 
+static THREAD_LOCAL size_t list_memory = 0;
+static THREAD_LOCAL size_t list_memcap = 0;
+
+AppIdDetectorList::AppIdDetectorList(IpProtocol proto, const ServiceFeatures* sf)
+{
+    ServiceDiscovery& sd = ServiceDiscovery::get_instance();
+
+    if ( proto == IpProtocol::TCP )
+        shared = sd.get_tcp_detectors();
+    else
+        shared = sd.get_udp_detectors();
+
+    size_t need = shared->size() * sizeof(ServiceDetector*);
+
+    if ( sf and AppIdServiceState::reserve(need) )
+    {
+        sd.rank_detectors(proto, sf, ranked);
+        rit = ranked.begin();
+        held = need;
+        shared = nullptr;
+    }
+    else
+        sit = shared->begin();
+}
+
+AppIdDetectorList::~AppIdDetectorList()
+{
+    if ( held )
+        AppIdServiceState::release(held);
+}
+
 ServiceDiscoveryState::ServiceDiscoveryState()
 {
     state = SERVICE_ID_STATE::SEARCHING_PORT_PATTERN;
@@ -51,12 +83,14 @@ ServiceDiscoveryState::~ServiceDiscoveryState()
     delete udp_brute_force_mgr;
 }
 
-ServiceDetector* ServiceDiscoveryState::select_detector_by_brute_force(IpProtocol proto)
+ServiceDetector* ServiceDiscoveryState::select_detector_by_brute_force(IpProtocol proto,
+    const ServiceFeatures* sf)
 {
+    // the order is fixed by the first packet that reaches brute force for this service
     if (proto == IpProtocol::TCP)
     {
         if ( !tcp_brute_force_mgr )
-            tcp_brute_force_mgr = new AppIdDetectorList(IpProtocol::TCP);
+            tcp_brute_force_mgr = new AppIdDetectorList(IpProtocol::TCP, sf);
         service = tcp_brute_force_mgr->next();
         if (appidDebug->is_active())
             LogMessage("AppIdDbg %s Brute-force state %s\n", appidDebug->get_debug_session(),
@@ -65,7 +99,7 @@ ServiceDetector* ServiceDiscoveryState::select_detector_by_brute_force(IpProtoco
     else if (proto == IpProtocol::UDP)
     {
         if ( !udp_brute_force_mgr )
-            udp_brute_force_mgr = new AppIdDetectorList(IpProtocol::UDP);
+            udp_brute_force_mgr = new AppIdDetectorList(IpProtocol::UDP, sf);
         service = udp_brute_force_mgr->next();
         if (appidDebug->is_active())
             LogMessage("AppIdDbg %s Brute-force state %s\n", appidDebug->get_debug_session(),
@@ -231,8 +265,9 @@ public:
 static THREAD_LOCAL std::map<AppIdServiceStateKey, ServiceDiscoveryState*>* service_state_cache =
     nullptr;
 
-void AppIdServiceState::initialize()
+void AppIdServiceState::initialize(size_t memcap)
 {
+    list_memcap = memcap;
     service_state_cache = new std::map<AppIdServiceStateKey, ServiceDiscoveryState*>;
 }
 
@@ -247,6 +282,7 @@ void AppIdServiceState::clean()
         delete service_state_cache;
         service_state_cache = nullptr;
     }
+    assert(!list_memory);
 }
 
 ServiceDiscoveryState* AppIdServiceState::add(const SfIp* ip, IpProtocol proto, uint16_t port,
@@ -335,6 +371,24 @@ void AppIdServiceState::check_reset(AppIdSession& asd, const SfIp* ip, uint16_t
     }
 }
 
+bool AppIdServiceState::reserve(size_t n)
+{
+    if ( list_memcap and list_memory + n > list_memcap )
+        return false;
+
+    list_memory += n;
+    return true;
+}
+
+void AppIdServiceState::release(size_t n)
+{
+    assert(list_memory >= n);
+    list_memory -= n;
+}
+
+size_t AppIdServiceState::get_memory()
+{ return list_memory; }
+
 void AppIdServiceState::dump_stats()
 {
     // FIXIT-L - do we need to keep ipv4 and ipv6 separate?
@@ -38,35 +38,45 @@ enum SERVICE_ID_STATE
     VALID
 };
 
+// walks the detectors of a protocol for brute force.  a ranked list is a
+// copy held against appid.memcap; without features or room for the copy
+// the shared detectors are walked in name order.
 class AppIdDetectorList
 {
 public:
-    AppIdDetectorList(IpProtocol proto)
-    {
-        if (proto == IpProtocol::TCP)
-            detectors = ServiceDiscovery::get_instance().get_tcp_detectors();
-        else
-            detectors = ServiceDiscovery::get_instance().get_udp_detectors();
-        dit = detectors->begin();
-    }
+    AppIdDetectorList(IpProtocol proto, const ServiceFeatures* sf = nullptr);
+    ~AppIdDetectorList();
 
     ServiceDetector* next()
     {
         ServiceDetector* detector = nullptr;
 
-        if ( dit != detectors->end())
-            detector = (ServiceDetector*)(dit++)->second;
+        if ( shared )
+        {
+            if ( sit != shared->end() )
+                detector = (ServiceDetector*)(sit++)->second;
+        }
+        else if ( rit != ranked.end() )
+            detector = *rit++;
+
         return detector;
     }
 
     void reset()
     {
-        dit = detectors->begin();
+        if ( shared )
+            sit = shared->begin();
+        else
+            rit = ranked.begin();
     }
 
 private:
-    AppIdDetectors* detectors;
-    AppIdDetectorsIterator dit;
+    AppIdDetectors* shared = nullptr;
+    AppIdDetectorsIterator sit;
+
+    std::vector<ServiceDetector*> ranked;
+    std::vector<ServiceDetector*>::iterator rit;
+    size_t held = 0;
 };
 
 class ServiceDiscoveryState
@@ -74,7 +84,8 @@ class ServiceDiscoveryState
 public:
     ServiceDiscoveryState();
     ~ServiceDiscoveryState();
-    ServiceDetector* select_detector_by_brute_force(IpProtocol proto);
+    ServiceDetector* select_detector_by_brute_force(IpProtocol proto,
+        const ServiceFeatures* sf = nullptr);
     void set_service_id_valid(ServiceDetector* sd);
     void set_service_id_failed(AppIdSession& asd, const snort::SfIp* client_ip,
         unsigned invalid_delta = 0);
@@ -133,7 +144,7 @@ private:
 class AppIdServiceState
 {
 public:
-    static void initialize();
+    static void initialize(size_t memcap = 0);
     static void clean();
     static ServiceDiscoveryState* add(const snort::SfIp*, IpProtocol, uint16_t port, bool decrypted);
     static ServiceDiscoveryState* get(const snort::SfIp*, IpProtocol, uint16_t port, bool decrypted);
@@ -141,6 +152,11 @@ public:
     static void check_reset(AppIdSession& asd, const snort::SfIp* ip, uint16_t port);
 
     static void dump_stats();
+
+    // bytes of ranked detector lists on this thread, capped by appid.memcap
+    static bool reserve(size_t);
+    static void release(size_t);
+    static size_t get_memory();
 };
 
 #endif
@@ -84,7 +84,6 @@ void AppIdDiscovery::register_udp_pattern(AppIdDetector*, const uint8_t* const,
 int AppIdDiscovery::add_service_port(AppIdDetector*,
     const ServiceDetectorPort&) { return APPID_EINVALID; }
 void ServiceDiscovery::initialize() {}
-void ServiceDiscovery::finalize_service_patterns() {}
 void ServiceDiscovery::match_by_pattern(AppIdSession&, const Packet*, IpProtocol) {}
 void ServiceDiscovery::get_port_based_services(IpProtocol, uint16_t, AppIdSession&) {}
 void ServiceDiscovery::get_next_service(const Packet*, const AppidSessionDirection, AppIdSession&) {}
@@ -97,6 +96,12 @@ int ServiceDiscovery::fail_service(AppIdSession&, const Packet*, AppidSessionDir
     ServiceDetector*, ServiceDiscoveryState*) { return 0; }
 int ServiceDiscovery::add_service_port(AppIdDetector*,
     const ServiceDetectorPort&) { return APPID_EINVALID; }
+void ServiceDiscovery::register_tcp_pattern(AppIdDetector*, const uint8_t* const, unsigned,
+    int, unsigned) {}
+void ServiceDiscovery::register_udp_pattern(AppIdDetector*, const uint8_t* const, unsigned,
+    int, unsigned) {}
+void ServiceDiscovery::rank_detectors(IpProtocol, const ServiceFeatures*,
+    std::vector<ServiceDetector*>&) {}
 ServiceDiscovery::ServiceDiscovery(AppIdInspector& ins)
     : AppIdDiscovery(ins) {}
 
@@ -140,6 +145,38 @@ TEST(service_state_tests, select_detector_by_brute_force)
     STRCMP_EQUAL(test_log, "");
 }
 
+TEST(service_state_tests, ranked_lists_held_against_memcap)
+{
+    AppIdInspector ins;
+    ServiceDiscovery& sd = ServiceDiscovery::get_instance(&ins);
+    AppIdDetectors* tcp = sd.get_tcp_detectors();
+    (*tcp)["a"] = nullptr;
+    (*tcp)["b"] = nullptr;
+
+    const size_t list_size = 2 * sizeof(ServiceDetector*);
+    ServiceFeatures sf = { nullptr, 0, APP_ID_FROM_INITIATOR, 80 };
+
+    AppIdServiceState::initialize(list_size);
+    {
+        ServiceDiscoveryState s1, s2, s3;
+
+        // no features, no copy
+        s1.select_detector_by_brute_force(IpProtocol::TCP);
+        CHECK(AppIdServiceState::get_memory() == 0);
+
+        s2.select_detector_by_brute_force(IpProtocol::TCP, &sf);
+        CHECK(AppIdServiceState::get_memory() == list_size);
+
+        // over the cap the shared detectors are walked instead
+        s3.select_detector_by_brute_force(IpProtocol::TCP, &sf);
+        CHECK(AppIdServiceState::get_memory() == list_size);
+    }
+    CHECK(AppIdServiceState::get_memory() == 0);
+
+    AppIdServiceState::clean();
+    tcp->clear();
+}
+
 TEST(service_state_tests, set_service_id_failed)
 {
     ServiceDiscoveryState sds;
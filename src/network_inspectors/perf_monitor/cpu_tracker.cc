@@ -32,6 +32,14 @@
 #include <mach/thread_act.h>
 #endif
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
 #ifdef UNIT_TEST
 #include "catch/snort_catch.h"
 #endif
@@ -45,15 +53,71 @@ static inline uint64_t get_microseconds(struct timeval t)
     return (uint64_t)t.tv_sec * 1000000 + t.tv_usec;
 }
 
+// user space TLB read misses by the calling thread on any cpu.  this fails
+// (-1) if perf events are restricted by perf_event_paranoid or unsupported.
+static int open_tlb_counter(uint64_t cache)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    UNUSED(cache);
+    return -1;
+#endif
+}
+
+static uint64_t read_counter(int fd)
+{
+    uint64_t count = 0;
+
+#ifdef __linux__
+    if ( fd >= 0 and read(fd, &count, sizeof(count)) != sizeof(count) )
+        count = 0;
+#else
+    UNUSED(fd);
+#endif
+
+    return count;
+}
+
 CPUTracker::CPUTracker(PerfConfig *perf) : PerfTracker(perf, TRACKER_NAME)
 {
+#ifdef __linux__
+    dtlb_fd = open_tlb_counter(PERF_COUNT_HW_CACHE_DTLB);
+    itlb_fd = open_tlb_counter(PERF_COUNT_HW_CACHE_ITLB);
+#else
+    dtlb_fd = itlb_fd = -1;
+#endif
+
     formatter->register_section("thread_" + to_string(snort::get_instance_id()));
     formatter->register_field("cpu_user", &user_stat);
     formatter->register_field("cpu_system", &system_stat);
     formatter->register_field("cpu_wall", &wall_stat);
+    formatter->register_field("dtlb_misses", &dtlb_stat);
+    formatter->register_field("itlb_misses", &itlb_stat);
     formatter->finalize_fields();
 }
 
+CPUTracker::~CPUTracker()
+{
+#ifdef __linux__
+    if ( dtlb_fd >= 0 )
+        close(dtlb_fd);
+
+    if ( itlb_fd >= 0 )
+        close(itlb_fd);
+#endif
+}
+
 void CPUTracker::get_clocks(struct timeval& user_time,
     struct timeval& sys_time, struct timeval& wall_time)
 {
@@ -83,6 +147,12 @@ void CPUTracker::get_clocks(struct timeval& user_time,
     gettimeofday(&wall_time, nullptr);
 }
 
+void CPUTracker::get_tlb_misses(uint64_t& dtlb, uint64_t& itlb)
+{
+    dtlb = read_counter(dtlb_fd);
+    itlb = read_counter(itlb_fd);
+}
+
 void CPUTracker::get_times(uint64_t& user, uint64_t& system, uint64_t& wall)
 {
     struct timeval user_tv, sys_tv, wall_tv;
@@ -97,6 +167,7 @@ void CPUTracker::get_times(uint64_t& user, uint64_t& system, uint64_t& wall)
 void CPUTracker::reset()
 {
     get_times(last_ut, last_st, last_wt);
+    get_tlb_misses(last_dtlb, last_itlb);
 }
 
 void CPUTracker::process(bool)
@@ -113,6 +184,16 @@ void CPUTracker::process(bool)
     last_st = system;
     last_wt = wall;
 
+    uint64_t dtlb, itlb;
+
+    get_tlb_misses(dtlb, itlb);
+
+    dtlb_stat = dtlb - last_dtlb;
+    itlb_stat = itlb - last_itlb;
+
+    last_dtlb = dtlb;
+    last_itlb = itlb;
+
     write();
 }
 
@@ -122,6 +203,7 @@ class TestCPUTracker : public CPUTracker
 {
 public:
     struct timeval user, sys, wall;
+    uint64_t dtlb = 0, itlb = 0;
     PerfFormatter* output;
 
     TestCPUTracker(PerfConfig* perf) : CPUTracker(perf)
@@ -141,6 +223,12 @@ protected:
         wall_time = wall;
     }
 
+    void get_tlb_misses(uint64_t& dtlb_misses, uint64_t& itlb_misses) override
+    {
+        dtlb_misses = dtlb;
+        itlb_misses = itlb;
+    }
+
 };
 
 TEST_CASE("timeval to scalar", "[cpu_tracker]")
@@ -211,4 +299,26 @@ TEST_CASE("process and output", "[cpu_tracker]")
     CHECK(*formatter->public_values["thread_0.cpu_wall"].pc == expected[pass++][w_idx]);
 }
 
+TEST_CASE("tlb misses", "[cpu_tracker]")
+{
+    PerfConfig config;
+    config.format = PerfFormat::MOCK;
+    TestCPUTracker tracker(&config);
+    MockFormatter *formatter = (MockFormatter*)tracker.output;
+
+    tracker.dtlb = 100;
+    tracker.itlb = 10;
+    tracker.reset();
+
+    tracker.dtlb = 1100;
+    tracker.itlb = 30;
+    tracker.process(false);
+    CHECK(*formatter->public_values["thread_0.dtlb_misses"].pc == 1000);
+    CHECK(*formatter->public_values["thread_0.itlb_misses"].pc == 20);
+
+    tracker.process(false);
+    CHECK(*formatter->public_values["thread_0.dtlb_misses"].pc == 0);
+    CHECK(*formatter->public_values["thread_0.itlb_misses"].pc == 0);
+}
+
 #endif
@@ -27,6 +27,7 @@ class CPUTracker : public PerfTracker
 {
 public:
     CPUTracker(PerfConfig*);
+    ~CPUTracker() override;
     void reset() override;
     void process(bool) override;
 
@@ -34,6 +35,9 @@ protected:
     virtual void get_clocks(struct timeval& user_time,
         struct timeval& sys_time, struct timeval& wall_time);
 
+    // data and instruction TLB misses by this thread; 0 if unavailable
+    virtual void get_tlb_misses(uint64_t& dtlb, uint64_t& itlb);
+
 private:
     //19 bits for microseconds
     //45 bits for seconds (out to year 1116918)
@@ -41,9 +45,17 @@ private:
     uint64_t last_ut;
     uint64_t last_st;
 
+    uint64_t last_dtlb;
+    uint64_t last_itlb;
+
+    int dtlb_fd;
+    int itlb_fd;
+
     PegCount user_stat;
     PegCount system_stat;
     PegCount wall_stat;
+    PegCount dtlb_stat;
+    PegCount itlb_stat;
 
     void get_times(uint64_t& user, uint64_t& system, uint64_t& wall);
 };
@@ -33,30 +33,324 @@
 
 #include "ps_detect.h"
 
-#include "hash/xhash.h"
+#include <climits>
+#include <vector>
+
+#include "hash/hashfcn.h"
 #include "log/messages.h"
 #include "protocols/icmp4.h"
 #include "protocols/packet.h"
 #include "protocols/tcp.h"
 #include "stream/stream.h"
 #include "time/packet_time.h"
-#include "utils/cpp_macros.h"
 #include "utils/stats.h"
 
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#endif
+
 #include "ps_inspect.h"
 
 using namespace snort;
 
-PADDING_GUARD_BEGIN
-struct PS_HASH_KEY
+//-------------------------------------------------------------------------
+// tracker table
+//
+// Trackers live in a fixed array sized from memcap.  A key hashes to a
+// bucket of PS_BUCKET_WAYS slots and the slot hashes are kept apart from
+// the trackers so a probe reads one small line before touching a tracker.
+// Slots never move, which lets the timer wheel refer to them by index.
+//
+// Each slot is scheduled on the wheel when its window opens and is freed
+// when the window closes; an expired tracker holds nothing the next update
+// wouldn't reset anyway.  When a bucket is full the victim is the slot
+// with the least to lose: free, then expired, then the oldest live
+// non-priority tracker.  Live priority trackers are never pushed out.
+//-------------------------------------------------------------------------
+
+#define PS_BUCKET_WAYS 4
+
+#define PS_ROLE_SCANNED 0
+#define PS_ROLE_SCANNER 1
+
+// two levels of 64 one second and 64 second buckets
+#define PS_WHEEL_BITS 6
+#define PS_WHEEL_SIZE (1 << PS_WHEEL_BITS)
+#define PS_WHEEL_MASK (PS_WHEEL_SIZE - 1)
+#define PS_WHEEL_SPAN (PS_WHEEL_SIZE * PS_WHEEL_SIZE)
+
+struct PsKey
 {
-    int protocol;
-    SfIp scanner;
-    SfIp scanned;
+    SfIp ip;
+    uint8_t protocol;
+    uint8_t role;
+    bool scheduled;
+};
+
+class PsTrackerTable
+{
+public:
+    PsTrackerTable(unsigned long memcap);
+
+    // keep is a tracker already in hand that must not be chosen as the victim
+    PS_TRACKER* get(const SfIp&, uint8_t protocol, uint8_t role, time_t now,
+        const PS_TRACKER* keep = nullptr);
+    void schedule(const PS_TRACKER*);
+    void expire(time_t now);
+    void clear();
+
+    static unsigned slot_size()
+    { return sizeof(uint32_t) + sizeof(PsKey) + sizeof(PS_TRACKER); }
+
+private:
+    static uint32_t hash(const SfIp&, uint8_t protocol, uint8_t role);
+
+    void add_timer(uint32_t slot, time_t expires);
+    void fire(uint32_t slot);
+    void sweep();
+
+    unsigned num_buckets;
+    std::vector<uint32_t> hashes;   // 0 is a free slot
+    std::vector<PsKey> keys;
+    std::vector<PS_TRACKER> trackers;
+
+    std::vector<uint32_t> seconds[PS_WHEEL_SIZE];
+    std::vector<uint32_t> minutes[PS_WHEEL_SIZE];
+    time_t wheel_time = 0;
 };
-PADDING_GUARD_END
 
-static THREAD_LOCAL XHash* portscan_hash = nullptr;
+PsTrackerTable::PsTrackerTable(unsigned long memcap)
+{
+    num_buckets = memcap / (slot_size() * PS_BUCKET_WAYS);
+
+    if ( !num_buckets )
+        num_buckets = 1;
+
+    unsigned n = num_buckets * PS_BUCKET_WAYS;
+
+    hashes.assign(n, 0);
+    keys.resize(n);
+    trackers.resize(n);
+
+    for ( auto& k : keys )
+        k.scheduled = false;
+}
+
+uint32_t PsTrackerTable::hash(const SfIp& ip, uint8_t protocol, uint8_t role)
+{
+    const uint32_t* w = ip.get_ip6_ptr();
+
+    uint32_t a = w[0] ^ ((uint32_t)protocol << 8 | role);
+    uint32_t b = w[1];
+    uint32_t c = w[2];
+
+    mix(a, b, c);
+
+    a += w[3];
+    b += ip.get_family();
+
+    finalize(a, b, c);
+
+    return c ? c : 1;
+}
+
+PS_TRACKER* PsTrackerTable::get(
+    const SfIp& ip, uint8_t protocol, uint8_t role, time_t now, const PS_TRACKER* keep)
+{
+    uint32_t h = hash(ip, protocol, role);
+    unsigned base = (h % num_buckets) * PS_BUCKET_WAYS;
+
+    unsigned victim = base;
+    int victim_rank = INT_MAX;
+
+    for ( unsigned i = base; i < base + PS_BUCKET_WAYS; ++i )
+    {
+        if ( hashes[i] == h and keys[i].protocol == protocol and keys[i].role == role and
+            keys[i].ip.equals(ip) )
+            return &trackers[i];
+
+        if ( &trackers[i] == keep )
+            continue;
+
+        int rank;
+
+        if ( !hashes[i] )
+            rank = 0;
+
+        else if ( trackers[i].proto.window < now )
+            rank = 1;
+
+        else if ( !trackers[i].priority_node )
+            rank = 2;
+
+        else
+            rank = 3;
+
+        if ( rank < victim_rank or
+            (rank == victim_rank and trackers[i].proto.window < trackers[victim].proto.window) )
+        {
+            victim = i;
+            victim_rank = rank;
+        }
+    }
+
+    if ( victim_rank == 3 )
+        return nullptr;
+
+    // a pending timer stays with the slot and is checked against the new
+    // tracker when it fires
+    hashes[victim] = h;
+    keys[victim].ip.set(ip);
+    keys[victim].protocol = protocol;
+    keys[victim].role = role;
+    memset(&trackers[victim], 0, sizeof(PS_TRACKER));
+
+    return &trackers[victim];
+}
+
+void PsTrackerTable::schedule(const PS_TRACKER* pt)
+{
+    uint32_t slot = pt - trackers.data();
+
+    if ( keys[slot].scheduled or !pt->proto.window )
+        return;
+
+    keys[slot].scheduled = true;
+    add_timer(slot, pt->proto.window + 1);
+}
+
+void PsTrackerTable::add_timer(uint32_t slot, time_t expires)
+{
+    if ( expires <= wheel_time )
+        expires = wheel_time + 1;
+
+    time_t delta = expires - wheel_time;
+
+    if ( delta < PS_WHEEL_SIZE )
+        seconds[expires & PS_WHEEL_MASK].push_back(slot);
+
+    else if ( delta < PS_WHEEL_SPAN )
+        minutes[(expires >> PS_WHEEL_BITS) & PS_WHEEL_MASK].push_back(slot);
+
+    // beyond the wheel; park in the last bucket and reschedule from there
+    else
+        minutes[((wheel_time >> PS_WHEEL_BITS) + PS_WHEEL_MASK) & PS_WHEEL_MASK].push_back(slot);
+}
+
+void PsTrackerTable::fire(uint32_t slot)
+{
+    PS_TRACKER& pt = trackers[slot];
+
+    if ( !hashes[slot] or !pt.proto.window )
+    {
+        keys[slot].scheduled = false;
+        return;
+    }
+
+    if ( pt.proto.window >= wheel_time )
+    {
+        add_timer(slot, pt.proto.window + 1);
+        return;
+    }
+
+    keys[slot].scheduled = false;
+    hashes[slot] = 0;
+}
+
+// packet time jumped past the whole wheel; rebuild it from the slots
+void PsTrackerTable::sweep()
+{
+    for ( unsigned i = 0; i < PS_WHEEL_SIZE; ++i )
+    {
+        seconds[i].clear();
+        minutes[i].clear();
+    }
+
+    for ( uint32_t slot = 0; slot < keys.size(); ++slot )
+    {
+        if ( keys[slot].scheduled )
+            fire(slot);
+    }
+}
+
+void PsTrackerTable::expire(time_t now)
+{
+    if ( !wheel_time or now < wheel_time )
+    {
+        wheel_time = now;
+        return;
+    }
+
+    if ( now - wheel_time >= PS_WHEEL_SPAN )
+    {
+        wheel_time = now;
+        sweep();
+        return;
+    }
+
+    std::vector<uint32_t> due;
+
+    while ( wheel_time < now )
+    {
+        ++wheel_time;
+
+        if ( !(wheel_time & PS_WHEEL_MASK) )
+        {
+            // cascade the next minute down to the seconds level
+            due.swap(minutes[(wheel_time >> PS_WHEEL_BITS) & PS_WHEEL_MASK]);
+
+            for ( auto slot : due )
+                add_timer(slot, trackers[slot].proto.window + 1);
+
+            due.clear();
+        }
+
+        due.swap(seconds[wheel_time & PS_WHEEL_MASK]);
+
+        for ( auto slot : due )
+            fire(slot);
+
+        due.clear();
+    }
+}
+
+void PsTrackerTable::clear()
+{
+    std::fill(hashes.begin(), hashes.end(), 0);
+
+    for ( auto& k : keys )
+        k.scheduled = false;
+
+    for ( unsigned i = 0; i < PS_WHEEL_SIZE; ++i )
+    {
+        seconds[i].clear();
+        minutes[i].clear();
+    }
+    wheel_time = 0;
+}
+
+static THREAD_LOCAL PsTrackerTable* portscan_table = nullptr;
+
+static inline uint32_t ps_hash_ip(const SfIp* ip)
+{
+    if ( !ip->is_set() )
+        return 0;
+
+    const uint32_t* w = ip->get_ip6_ptr();
+
+    uint32_t a = w[0];
+    uint32_t b = w[1];
+    uint32_t c = w[2];
+
+    mix(a, b, c);
+
+    a += w[3];
+    b += ip->get_family();
+
+    finalize(a, b, c);
+
+    return c ? c : 1;
+}
 
 PS_PKT::PS_PKT(Packet* p)
 {
@@ -82,62 +376,27 @@ PortscanConfig::~PortscanConfig()
         ipset_free(watch_ip);
 }
 
-/*
-**  This function is passed into the hash algorithm, so that
-**  we only reuse nodes that aren't priority nodes.  We have to make
-**  sure that we only track so many priority nodes, otherwise we could
-**  have all priority nodes and not be able to allocate more.
-*/
-static int ps_tracker_free(void* key, void* data)
-{
-    if (!key || !data)
-        return 0;
-
-    PS_TRACKER* tracker = (PS_TRACKER*)data;
-
-    if (!tracker->priority_node)
-        return 0;
-
-    /*
-    **  Cycle through the protos to see if it's past the time.
-    **  We only get here if we ARE a priority node.
-    */
-    if (tracker->proto.window >= packet_time())
-        return 1;
-
-    return 0;
-}
-
 void ps_cleanup()
 {
-    if ( portscan_hash )
-    {
-        xhash_delete(portscan_hash);
-        portscan_hash = nullptr;
-    }
+    delete portscan_table;
+    portscan_table = nullptr;
 }
 
 unsigned ps_node_size()
-{ return sizeof(PS_HASH_KEY) + sizeof(PS_TRACKER); }
+{ return PsTrackerTable::slot_size(); }
 
 void ps_init_hash(unsigned long memcap)
 {
-    if ( portscan_hash )
+    if ( portscan_table )
         return;
 
-    int rows = memcap / ps_node_size();
-
-    portscan_hash = xhash_new(rows, sizeof(PS_HASH_KEY), sizeof(PS_TRACKER),
-        memcap, 1, ps_tracker_free, nullptr, 1);
-
-    if ( !portscan_hash )
-        FatalError("Failed to initialize portscan hash table.\n");
+    portscan_table = new PsTrackerTable(memcap);
 }
 
 void ps_reset()
 {
-    if ( portscan_hash )
-        xhash_make_empty(portscan_hash);
+    if ( portscan_table )
+        portscan_table->clear();
 }
 
 //  Check scanner and scanned ips to see if we can filter them out.
@@ -271,38 +530,16 @@ bool PortScan::ps_filter_ignore(PS_PKT* ps_pkt)
     return false;
 }
 
-/*
-**  Get a tracker node by either finding one or starting a new one.  We may
-**  return null, in which case we wait `til the next packet.
-*/
-static PS_TRACKER* ps_tracker_get(PS_HASH_KEY* key)
-{
-    PS_TRACKER* ht = (PS_TRACKER*)xhash_find(portscan_hash, (void*)key);
-
-    if ( ht )
-        return ht;
-
-    if ( xhash_add(portscan_hash, (void*)key, nullptr) != XHASH_OK )
-        return nullptr;
-
-    ht = (PS_TRACKER*)xhash_mru(portscan_hash);
-
-    if ( ht )
-        memset(ht, 0x00, sizeof(PS_TRACKER));
-
-    return ht;
-}
-
 bool PortScan::ps_tracker_lookup(
     PS_PKT* ps_pkt, PS_TRACKER** scanner, PS_TRACKER** scanned)
 {
-    PS_HASH_KEY key;
     Packet* p = (Packet*)ps_pkt->pkt;
+    int protocol;
 
-    if (ps_get_proto(ps_pkt, &key.protocol) == -1)
+    if (ps_get_proto(ps_pkt, &protocol) == -1)
         return false;
 
-    ps_pkt->proto = key.protocol;
+    ps_pkt->proto = protocol;
 
     /*
     **  Let's lookup the host that is being scanned, taking into account
@@ -311,27 +548,19 @@ bool PortScan::ps_tracker_lookup(
     if (config->detect_scan_type &
         (PS_TYPE_PORTSCAN | PS_TYPE_DECOYSCAN | PS_TYPE_DISTPORTSCAN))
     {
-        key.scanner.clear();
-
-        if (ps_pkt->reverse_pkt)
-            key.scanned.set(*p->ptrs.ip_api.get_src());
-        else
-            key.scanned.set(*p->ptrs.ip_api.get_dst());
+        const SfIp* ip = ps_pkt->reverse_pkt ?
+            p->ptrs.ip_api.get_src() : p->ptrs.ip_api.get_dst();
 
-        *scanned = ps_tracker_get(&key);
+        *scanned = portscan_table->get(*ip, protocol, PS_ROLE_SCANNED, packet_time());
     }
 
     //  Let's lookup the host that is scanning.
     if (config->detect_scan_type & PS_TYPE_PORTSWEEP)
     {
-        key.scanned.clear();
-
-        if (ps_pkt->reverse_pkt)
-            key.scanner.set(*p->ptrs.ip_api.get_dst());
-        else
-            key.scanner.set(*p->ptrs.ip_api.get_src());
+        const SfIp* ip = ps_pkt->reverse_pkt ?
+            p->ptrs.ip_api.get_dst() : p->ptrs.ip_api.get_src();
 
-        *scanner = ps_tracker_get(&key);
+        *scanner = portscan_table->get(*ip, protocol, PS_ROLE_SCANNER, packet_time(), *scanned);
     }
 
     return *scanner or *scanned;
@@ -467,10 +696,12 @@ int PortScan::ps_proto_update(PS_PROTO* proto, int ps_cnt, int pri_cnt,
     if (proto->connection_count < 0)
         proto->connection_count = 0;
 
-    if (!proto->u_ips.equals(*ip, false))
+    uint32_t ip_hash = ps_hash_ip(ip);
+
+    if (proto->u_ips != ip_hash)
     {
         proto->u_ip_count++;
-        proto->u_ips.set(*ip);
+        proto->u_ips = ip_hash;
     }
 
     /* we need to do the IP comparisons in host order */
@@ -1187,6 +1418,8 @@ int PortScan::ps_detect(PS_PKT* ps_pkt)
 
     Packet* p = (Packet*)ps_pkt->pkt;
 
+    portscan_table->expire(packet_time());
+
     do
     {
         if ( !ps_tracker_lookup(ps_pkt, &scanner, &scanned) )
@@ -1195,6 +1428,12 @@ int PortScan::ps_detect(PS_PKT* ps_pkt)
         if ( !ps_tracker_update(ps_pkt, scanner, scanned) )
             return 0;
 
+        if ( scanner )
+            portscan_table->schedule(scanner);
+
+        if ( scanned )
+            portscan_table->schedule(scanned);
+
         if ( !ps_tracker_alert(ps_pkt, scanner, scanned) )
             return 0;
 
@@ -1220,3 +1459,173 @@ int PortScan::ps_detect(PS_PKT* ps_pkt)
     return 1;
 }
 
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+static SfIp get_ip(unsigned n)
+{
+    SfIp ip;
+    uint32_t a = htonl(0x0a000000 + n);
+    ip.set(&a, AF_INET);
+    return ip;
+}
+
+// one bucket so every key competes for the same ways
+static const unsigned one_bucket = PsTrackerTable::slot_size() * PS_BUCKET_WAYS;
+
+static PS_TRACKER* add(PsTrackerTable& t, unsigned n, time_t now, time_t window, bool pri = false)
+{
+    PS_TRACKER* pt = t.get(get_ip(n), PS_PROTO_TCP, PS_ROLE_SCANNER, now);
+
+    if ( pt )
+    {
+        pt->proto.window = window;
+        pt->priority_node = pri;
+    }
+    return pt;
+}
+
+static bool is_live(PsTrackerTable& t, unsigned n, time_t now)
+{
+    // a freed or evicted tracker comes back zeroed
+    PS_TRACKER* pt = t.get(get_ip(n), PS_PROTO_TCP, PS_ROLE_SCANNER, now);
+    return pt and pt->proto.window;
+}
+
+TEST_CASE("tracker eviction order", "[PortScan]")
+{
+    PsTrackerTable t(one_bucket);
+    time_t now = 1000;
+
+    // slots never move so a victim is recognized by its tracker
+    PS_TRACKER* pri = add(t, 1, now, now + 30, true);
+    PS_TRACKER* newer = add(t, 2, now, now + 20);
+    PS_TRACKER* older = add(t, 3, now, now + 10);
+    PS_TRACKER* expired = add(t, 4, now, now - 1);
+
+    REQUIRE(pri);
+    REQUIRE(newer);
+    REQUIRE(older);
+    REQUIRE(expired);
+
+    // an existing key is found without evicting anything
+    CHECK(t.get(get_ip(2), PS_PROTO_TCP, PS_ROLE_SCANNER, now) == newer);
+    CHECK(newer->proto.window == now + 20);
+
+    // expired goes first, then the oldest live non-priority
+    CHECK(add(t, 5, now, now + 40) == expired);
+    CHECK(add(t, 6, now, now + 40) == older);
+    CHECK(add(t, 7, now, now + 40) == newer);
+
+    CHECK(pri->proto.window == now + 30);
+    CHECK(t.get(get_ip(1), PS_PROTO_TCP, PS_ROLE_SCANNER, now) == pri);
+
+    // live priority trackers are never pushed out
+    t.clear();
+    for ( unsigned i = 1; i <= PS_BUCKET_WAYS; ++i )
+        REQUIRE(add(t, i, now, now + 10, true));
+
+    CHECK(!add(t, 9, now, now + 10));
+    for ( unsigned i = 1; i <= PS_BUCKET_WAYS; ++i )
+        CHECK(is_live(t, i, now));
+
+    // until their window closes
+    CHECK(add(t, 9, now + 11, now + 20));
+}
+
+TEST_CASE("tracker eviction keep", "[PortScan]")
+{
+    PsTrackerTable t(one_bucket);
+    time_t now = 1000;
+
+    PS_TRACKER* keep = add(t, 1, now, now - 5);
+    REQUIRE(keep);
+
+    for ( unsigned i = 2; i <= PS_BUCKET_WAYS; ++i )
+        REQUIRE(add(t, i, now, now + 10));
+
+    // the oldest expired tracker is spared when it is in hand
+    PS_TRACKER* pt = t.get(get_ip(9), PS_PROTO_TCP, PS_ROLE_SCANNED, now, keep);
+    REQUIRE(pt);
+    CHECK(pt != keep);
+    CHECK(keep->proto.window == now - 5);
+}
+
+static void check_expiry(time_t start, time_t interval, time_t step)
+{
+    PsTrackerTable t(one_bucket);
+    t.expire(start);
+
+    PS_TRACKER* pt = add(t, 1, start, start + interval);
+    REQUIRE(pt);
+    t.schedule(pt);
+
+    time_t now = start;
+
+    // live through the last second of its window
+    while ( now + step <= start + interval )
+    {
+        now += step;
+        t.expire(now);
+        CHECK(pt->proto.window);
+        CHECK(is_live(t, 1, now));
+    }
+
+    // and freed once it closes
+    t.expire(start + interval + 1);
+    CHECK(!is_live(t, 1, start + interval + 1));
+}
+
+TEST_CASE("tracker expiry", "[PortScan]")
+{
+    SECTION("seconds")
+    {
+        check_expiry(1000, 30, 1);
+    }
+    SECTION("minute rollover")
+    {
+        // 1020 is just short of a 64 second boundary and 60 crosses it
+        check_expiry(1020, 60, 1);
+    }
+    SECTION("cascade from minutes")
+    {
+        check_expiry(1020, 300, 1);
+        check_expiry(1020, 300, 7);
+    }
+    SECTION("wheel rollover")
+    {
+        // 4090 is just short of a full wheel turn
+        check_expiry(4090, 200, 3);
+    }
+    SECTION("beyond the wheel")
+    {
+        check_expiry(1000, PS_WHEEL_SPAN + 100, 50);
+    }
+}
+
+TEST_CASE("tracker expiry after a jump", "[PortScan]")
+{
+    PsTrackerTable t(one_bucket);
+    time_t start = 1000;
+    t.expire(start);
+
+    PS_TRACKER* live = add(t, 1, start, start + 2 * PS_WHEEL_SPAN);
+    PS_TRACKER* done = add(t, 2, start, start + 10);
+    REQUIRE(live);
+    REQUIRE(done);
+    t.schedule(live);
+    t.schedule(done);
+
+    // a jump past the whole wheel rebuilds it from the slots
+    time_t now = start + PS_WHEEL_SPAN;
+    t.expire(now);
+    CHECK(is_live(t, 1, now));
+    CHECK(!is_live(t, 2, now));
+
+    now = start + 2 * PS_WHEEL_SPAN + 1;
+    t.expire(now);
+    CHECK(!is_live(t, 1, now));
+}
+#endif
@@ -130,7 +130,7 @@ struct PS_PROTO
 
     snort::SfIp high_ip;
     snort::SfIp low_ip;
-    snort::SfIp u_ips;
+    uint32_t u_ips;      // hash of the last address seen, 0 if none
 
     unsigned short open_ports[PS_OPEN_PORTS];
     unsigned char open_ports_cnt;
@@ -142,8 +142,7 @@ struct PS_PROTO
 
 struct PS_TRACKER
 {
-    int priority_node;
-    int protocol;
+    uint8_t priority_node;
     PS_PROTO proto;
 };
 
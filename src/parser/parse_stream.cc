@@ -23,22 +23,35 @@
 
 #include "parse_stream.h"
 
-#include <sstream>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "log/messages.h"
 #include "managers/ips_manager.h"
+#include "time/clock_defs.h"
+#include "time/stopwatch.h"
+#include "utils/stats.h"
 
 #include "parser.h"
 #include "parse_conf.h"
 #include "parse_rule.h"
 
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#endif
+
 using namespace snort;
 using namespace std;
 
-static unsigned chars = 0, tokens = 0;
-static unsigned lines = 1, comments = 0;
-static unsigned keys = 0, rules = 0;
-static unsigned lists = 0, strings = 0;
+static unsigned tokens = 0, rules = 0;
+
+// startup timing, accumulated over all rule files until printed
+static unsigned chunks = 0;
+static uint64_t read_usecs = 0, scan_usecs = 0, parse_usecs = 0;
 
 enum TokenType
 {
@@ -83,14 +96,288 @@ static uint8_t to_hex(char c)
         return 10 + c - 'a';
 }
 
-static TokenType get_token(
-    istream& is, string& s, const char* punct, int esc)
+enum FsmAction
+{
+    FSM_ACT, FSM_PRO,FSM_HDR,
+    FSM_SIP, FSM_SP, FSM_SPX,
+    FSM_DIR,
+    FSM_DIP, FSM_DP, FSM_DPX,
+    FSM_SOB, FSM_STB,
+    FSM_EOB,
+    FSM_KEY, FSM_OPT,
+    FSM_VAL, FSM_SET,
+    FSM_ADD, FSM_INC,
+    FSM_END,
+    FSM_NOP, FSM_ERR,
+    FSM_WRN,
+    FSM_MAX
+};
+
+const char* acts[FSM_MAX] =
+{
+    "act", "pro",
+    "sip", "sp",
+    "dir",
+    "dip", "dp",
+    "stb", "sob",
+    "eob",
+    "key", "opt",
+    "val", "set",
+    "add", "inc",
+    "end",
+    "nop", "err",
+    "wrn"
+};
+
+struct State
+{
+    int num;
+    int next;
+    TokenType type;
+    FsmAction action;
+    const char* match;
+    const char* punct;
+};
+
+static const State fsm[] =
+{
+    { -1, 0, TT_NONE,    FSM_ERR, nullptr,    "" },
+    { 0, 15, TT_LITERAL, FSM_KEY, "include",  "" },
+    { 0,  1, TT_LITERAL, FSM_ACT, nullptr,    "(" },
+    { 1,  8, TT_PUNCT,   FSM_STB, "(",        "(:,;)" },
+    { 1,  2, TT_LITERAL, FSM_PRO, nullptr,    "(" },
+    { 2,  8, TT_PUNCT,   FSM_HDR, "(",        "(:,;)" },
+    { 2,  3, TT_LIST,    FSM_SIP, nullptr,    "" },
+    { 2,  3, TT_LITERAL, FSM_SIP, nullptr,    "" },
+    { 3,  5, TT_LITERAL, FSM_SPX, "->",       nullptr },
+    { 3,  5, TT_LITERAL, FSM_SPX, "<>",       nullptr },
+    { 3,  4, TT_LIST,    FSM_SP,  nullptr,    nullptr },
+    { 3,  4, TT_LITERAL, FSM_SP,  nullptr,    nullptr },
+    { 4,  5, TT_LITERAL, FSM_DIR, nullptr,    nullptr },
+    { 5,  6, TT_LIST,    FSM_DIP, nullptr,    "(" },
+    { 5,  6, TT_LITERAL, FSM_DIP, nullptr,    "(" },
+    { 6,  8, TT_PUNCT,   FSM_DPX, "(",        "(:,;)" },
+    { 6,  7, TT_LIST,    FSM_DP,  nullptr,    "(:,;)" },
+    { 6,  7, TT_LITERAL, FSM_DP,  nullptr,    "(:,;)" },
+    { 7,  8, TT_PUNCT,   FSM_SOB, "(",        nullptr },
+    { 8,  0, TT_PUNCT,   FSM_EOB, ")",        nullptr },
+    { 8, 13, TT_LITERAL, FSM_KEY, "metadata", nullptr },
+    { 8, 16, TT_LITERAL, FSM_KEY, "reference",":;" },
+    { 8,  9, TT_LITERAL, FSM_KEY, nullptr,    nullptr },
+    { 9,  8, TT_PUNCT,   FSM_END, ";",        nullptr },
+    { 9, 10, TT_PUNCT,   FSM_NOP, ":",        nullptr },
+    // we can't allow this because the syntax is squiffy
+    // would prefer to require a ; after the last option
+    // (and delete all the other cases like this too)
+    //{  9,  0, TT_PUNCT,   FSM_EOB, ")",        ""      },
+    { 10, 12, TT_STRING,  FSM_OPT, nullptr,    nullptr },
+    { 10, 11, TT_LITERAL, FSM_OPT, nullptr,    nullptr },
+    { 11, 12, TT_STRING,  FSM_VAL, nullptr,    nullptr },
+    { 11, 12, TT_LITERAL, FSM_VAL, nullptr,    nullptr },
+    { 11,  8, TT_PUNCT,   FSM_END, ";",        nullptr },
+    { 11,  0, TT_PUNCT,   FSM_EOB, ")",        "" },
+    { 11, 10, TT_PUNCT,   FSM_SET, ",",        nullptr },
+    { 12,  8, TT_PUNCT,   FSM_END, ";",        nullptr },
+    { 12,  0, TT_PUNCT,   FSM_EOB, ")",        "" },
+    { 12, 10, TT_PUNCT,   FSM_SET, ",",        nullptr },
+    { 13, 14, TT_PUNCT,   FSM_NOP, ":",        nullptr },
+    { 14,  8, TT_PUNCT,   FSM_END, ";",        "(:,;)" },
+    { 14, 14, TT_NONE,    FSM_SET, ",",        nullptr },
+    { 14, 14, TT_NONE,    FSM_ADD, nullptr,    nullptr },
+    { 15,  0, TT_LITERAL, FSM_INC, nullptr,    nullptr },
+    { 16, 14, TT_PUNCT,   FSM_NOP, ":",        ";" },
+};
+
+// returns fsm[0] (FSM_ERR) on a syntax error.  the caller reports it since
+// this may be called off the main thread.
+static const State* get_state(int num, TokenType type, const string& tok)
+{
+    const unsigned sz = sizeof(fsm)/sizeof(fsm[0]);
+
+    for ( unsigned i = 0; i < sz; i++ )
+    {
+        const State* s = fsm + i;
+
+        if (
+            (num == s->num) &&
+            (!s->type || type == s->type) &&
+            (!s->match || tok == s->match) )
+        {
+            return s;
+        }
+    }
+    return fsm;
+}
+
+// FIXIT-L escaping should not be by option name
+// probably should remove content escaping except for \" so
+// that individual rule options can do whatever
+static int get_escape(const string& s)
+{
+    if ( s == "pcre" )
+        return 0;  // no escape, option goes to ;
+
+    else if ( s == "regex" || s == "sd_pattern" )
+        return -1; // no escape, option goes to "
+
+    return 1;      // escape, option goes to "
+}
+
+//-------------------------------------------------------------------------
+// scanning
+//
+// a scan runs the tokenizer and the fsm above and records the resulting
+// actions (and any diagnostics) as steps.  it has no side effects so large
+// rule files are split into chunks that are scanned concurrently.  the
+// steps are then replayed in order by exec() on the main thread.
+//-------------------------------------------------------------------------
+
+struct RuleStep
+{
+    FsmAction action;
+    unsigned line;     // lines read by the scan so far
+    unsigned at;       // for FSM_WRN, the scan line the message is about
+    string tok;        // the token or, for FSM_ERR and FSM_WRN, the message
+
+    RuleStep(FsmAction a, unsigned u, string&& s, unsigned w = 0) :
+        action(a), line(u), at(w), tok(move(s)) { }
+};
+
+typedef vector<RuleStep> RuleSteps;
+
+// everything a scan carries from one token to the next; two scans of the
+// same buffer that reach the same offset with equal state produce the
+// same steps from there on
+struct ScanState
+{
+    int prev = EOF;
+    int pos = 0;
+    int num = 0;
+    int esc = 1;
+    const char* punct = fsm[0].punct;
+
+    bool operator==(const ScanState& rhs) const
+    {
+        return prev == rhs.prev and pos == rhs.pos and num == rhs.num and
+            esc == rhs.esc and punct == rhs.punct;
+    }
+};
+
+class BufferInput
+{
+public:
+    BufferInput(const char* b, const char* e) : ptr(b), end(e) { }
+
+    int get()
+    { return (ptr < end) ? (uint8_t)*ptr++ : EOF; }
+
+    const char* get_ptr() const
+    { return ptr; }
+
+private:
+    const char* ptr;
+    const char* end;
+};
+
+class StreamInput
+{
+public:
+    StreamInput(istream& s) : is(s) { }
+
+    int get()
+    { return is.get(); }
+
+private:
+    istream& is;
+};
+
+template <typename Input>
+class RuleScanner
+{
+public:
+    RuleScanner(const Input& in, int num = 0, const char* punct = fsm[0].punct) : input(in)
+    { state.num = num; state.punct = punct; }
+
+    // append the steps for the next token; false at eof
+    bool scan(RuleSteps&);
+
+    // true between rules
+    bool is_clean() const
+    { return !state.num; }
+
+    const ScanState& get_state() const
+    { return state; }
+
+    unsigned get_line() const
+    { return line; }
+
+    const Input& get_input() const
+    { return input; }
+
+private:
+    TokenType get_token(RuleSteps&, string&);
+    void warn(RuleSteps&, unsigned at, const char*);
+
+private:
+    Input input;
+    ScanState state;
+    string key;
+    unsigned line = 0;
+};
+
+// scan lines count from the start of the chunk so the line number is
+// added to the message when the step is replayed
+template <typename Input>
+void RuleScanner<Input>::warn(RuleSteps& steps, unsigned at, const char* msg)
+{ steps.emplace_back(FSM_WRN, line, string(msg), at); }
+
+template <typename Input>
+bool RuleScanner<Input>::scan(RuleSteps& steps)
+{
+    string tok;
+    TokenType type = get_token(steps, tok);
+
+    if ( !type )
+        return false;
+
+    const State* s = ::get_state(state.num, type, tok);
+
+#ifdef TRACER
+    printf("%d: %s = '%s' -> %s\n",
+        state.num, toks[type], tok.c_str(), acts[s->action]);
+#endif
+
+    if ( s->action == FSM_ERR )
+        steps.emplace_back(FSM_ERR, line, string("syntax error"));
+
+    else
+    {
+        if ( s->action == FSM_KEY )
+            key = tok;
+
+        steps.emplace_back(s->action, line, move(tok));
+    }
+
+    state.num = s->next;
+    state.esc = get_escape(key);
+
+    if ( s->punct )
+        state.punct = s->punct;
+
+    return true;
+}
+
+template <typename Input>
+TokenType RuleScanner<Input>::get_token(RuleSteps& steps, string& s)
 {
-    static int prev = EOF;
+    int& prev = state.prev;
+    int& pos = state.pos;
+    const char* punct = state.punct;
+    int esc = state.esc;
+
     int c, list = 0, state = 0;
     s.clear();
     bool inc = true;
-    static int pos = 0;
     uint8_t hex = 0;
 
     if ( prev != EOF )
@@ -100,10 +387,7 @@ static TokenType get_token(
         inc = ( c != '\n' );
     }
     else
-    {
-        c = is.get();
-        chars++;
-    }
+        c = input.get();
 
     while ( c != EOF )
     {
@@ -113,11 +397,10 @@ static TokenType get_token(
 
         if ( c == '\n' )
         {
-            lines++;
             pos = 0;
 
             if ( inc )
-                inc_parse_position();
+                line++;
             else
                 inc = true;
         }
@@ -135,7 +418,6 @@ static TokenType get_token(
             else if ( c == '#' )
             {
                 s = c;
-                comments++;
                 state = 1;
             }
             else if ( c == '/' )
@@ -146,14 +428,12 @@ static TokenType get_token(
             else if ( c == '[' )
             {
                 s += c;
-                lists++;
                 list = 1;
                 state = 2;
             }
             else if ( c == '"' )
             {
                 s += c;
-                strings++;
                 state = 3;
             }
             else if ( c == '!' )
@@ -168,7 +448,6 @@ static TokenType get_token(
             else if ( !isspace(c) )
             {
                 s += c;
-                keys++;
                 state = 6;
             }
             break;
@@ -208,7 +487,7 @@ static TokenType get_token(
             else if ( c == '\\' )
                 state = (esc > 0) ? 4 : 16;
             else if ( c == '\n' )
-                ParseWarning(WARN_RULES, "line break in string on line %u\n", lines-1);
+                warn(steps, line, "line break in string");
             else
                 s += c;
             break;
@@ -223,7 +502,7 @@ static TokenType get_token(
             break;
         case 5:  // unquoted escape
             if ( c != '\n' && c != '\r' )
-                ParseWarning(WARN_RULES, "invalid escape on line %u\n", lines);
+                warn(steps, line + 1, "invalid escape");
             state = 0;
             break;
         case 6:  // token
@@ -243,7 +522,6 @@ static TokenType get_token(
             if ( c == '"' )
             {
                 s += c;
-                strings++;
                 state = 3;
             }
             else if ( isspace(c) || strchr(punct, c) )
@@ -280,7 +558,6 @@ static TokenType get_token(
                 state = 11;
                 break;
             }
-            keys++;
             // now as if state == 6
             if ( esc && c == '\\' )
             {
@@ -305,17 +582,14 @@ static TokenType get_token(
             break;
         case 12:  // end of comment?
             if ( c == '/' )
-            {
-                comments++;
                 state = 0;
-            }
             break;
         case 13:  // quoted string in comment
             if ( c == '"' )
                 state = 11;
             else if ( c == '\n' )
             {
-                ParseWarning(WARN_RULES, "line break in commented string on line %u\n", lines-1);
+                warn(steps, line, "line break in commented string");
                 state = 11;
             }
             break;
@@ -327,8 +601,7 @@ static TokenType get_token(
             }
             else
             {
-                ParseWarning(WARN_RULES, "\\x used with no following hex digits on line %u\n",
-                        lines-1);
+                warn(steps, line, "\\x used with no following hex digits");
                 s += c;
                 state = 3;
             }
@@ -354,122 +627,11 @@ static TokenType get_token(
             state = 3;
             break;
         }
-        c = is.get();
-        chars++;
+        c = input.get();
     }
     return TT_NONE;
 }
 
-enum FsmAction
-{
-    FSM_ACT, FSM_PRO,FSM_HDR,
-    FSM_SIP, FSM_SP, FSM_SPX,
-    FSM_DIR,
-    FSM_DIP, FSM_DP, FSM_DPX,
-    FSM_SOB, FSM_STB,
-    FSM_EOB,
-    FSM_KEY, FSM_OPT,
-    FSM_VAL, FSM_SET,
-    FSM_ADD, FSM_INC,
-    FSM_END,
-    FSM_NOP, FSM_ERR,
-    FSM_MAX
-};
-
-const char* acts[FSM_MAX] =
-{
-    "act", "pro",
-    "sip", "sp",
-    "dir",
-    "dip", "dp",
-    "stb", "sob",
-    "eob",
-    "key", "opt",
-    "val", "set",
-    "add", "inc",
-    "end",
-    "nop", "err"
-};
-
-struct State
-{
-    int num;
-    int next;
-    TokenType type;
-    FsmAction action;
-    const char* match;
-    const char* punct;
-};
-
-static const State fsm[] =
-{
-    { -1, 0, TT_NONE,    FSM_ERR, nullptr,    "" },
-    { 0, 15, TT_LITERAL, FSM_KEY, "include",  "" },
-    { 0,  1, TT_LITERAL, FSM_ACT, nullptr,    "(" },
-    { 1,  8, TT_PUNCT,   FSM_STB, "(",        "(:,;)" },
-    { 1,  2, TT_LITERAL, FSM_PRO, nullptr,    "(" },
-    { 2,  8, TT_PUNCT,   FSM_HDR, "(",        "(:,;)" },
-    { 2,  3, TT_LIST,    FSM_SIP, nullptr,    "" },
-    { 2,  3, TT_LITERAL, FSM_SIP, nullptr,    "" },
-    { 3,  5, TT_LITERAL, FSM_SPX, "->",       nullptr },
-    { 3,  5, TT_LITERAL, FSM_SPX, "<>",       nullptr },
-    { 3,  4, TT_LIST,    FSM_SP,  nullptr,    nullptr },
-    { 3,  4, TT_LITERAL, FSM_SP,  nullptr,    nullptr },
-    { 4,  5, TT_LITERAL, FSM_DIR, nullptr,    nullptr },
-    { 5,  6, TT_LIST,    FSM_DIP, nullptr,    "(" },
-    { 5,  6, TT_LITERAL, FSM_DIP, nullptr,    "(" },
-    { 6,  8, TT_PUNCT,   FSM_DPX, "(",        "(:,;)" },
-    { 6,  7, TT_LIST,    FSM_DP,  nullptr,    "(:,;)" },
-    { 6,  7, TT_LITERAL, FSM_DP,  nullptr,    "(:,;)" },
-    { 7,  8, TT_PUNCT,   FSM_SOB, "(",        nullptr },
-    { 8,  0, TT_PUNCT,   FSM_EOB, ")",        nullptr },
-    { 8, 13, TT_LITERAL, FSM_KEY, "metadata", nullptr },
-    { 8, 16, TT_LITERAL, FSM_KEY, "reference",":;" },
-    { 8,  9, TT_LITERAL, FSM_KEY, nullptr,    nullptr },
-    { 9,  8, TT_PUNCT,   FSM_END, ";",        nullptr },
-    { 9, 10, TT_PUNCT,   FSM_NOP, ":",        nullptr },
-    // we can't allow this because the syntax is squiffy
-    // would prefer to require a ; after the last option
-    // (and delete all the other cases like this too)
-    //{  9,  0, TT_PUNCT,   FSM_EOB, ")",        ""      },
-    { 10, 12, TT_STRING,  FSM_OPT, nullptr,    nullptr },
-    { 10, 11, TT_LITERAL, FSM_OPT, nullptr,    nullptr },
-    { 11, 12, TT_STRING,  FSM_VAL, nullptr,    nullptr },
-    { 11, 12, TT_LITERAL, FSM_VAL, nullptr,    nullptr },
-    { 11,  8, TT_PUNCT,   FSM_END, ";",        nullptr },
-    { 11,  0, TT_PUNCT,   FSM_EOB, ")",        "" },
-    { 11, 10, TT_PUNCT,   FSM_SET, ",",        nullptr },
-    { 12,  8, TT_PUNCT,   FSM_END, ";",        nullptr },
-    { 12,  0, TT_PUNCT,   FSM_EOB, ")",        "" },
-    { 12, 10, TT_PUNCT,   FSM_SET, ",",        nullptr },
-    { 13, 14, TT_PUNCT,   FSM_NOP, ":",        nullptr },
-    { 14,  8, TT_PUNCT,   FSM_END, ";",        "(:,;)" },
-    { 14, 14, TT_NONE,    FSM_SET, ",",        nullptr },
-    { 14, 14, TT_NONE,    FSM_ADD, nullptr,    nullptr },
-    { 15,  0, TT_LITERAL, FSM_INC, nullptr,    nullptr },
-    { 16, 14, TT_PUNCT,   FSM_NOP, ":",        ";" },
-};
-
-static const State* get_state(int num, TokenType type, const string& tok)
-{
-    const unsigned sz = sizeof(fsm)/sizeof(fsm[0]);
-
-    for ( unsigned i = 0; i < sz; i++ )
-    {
-        const State* s = fsm + i;
-
-        if (
-            (num == s->num) &&
-            (!s->type || type == s->type) &&
-            (!s->match || tok == s->match) )
-        {
-            return s;
-        }
-    }
-    ParseError("syntax error");
-    return fsm;
-}
-
 struct RuleParseState
 {
     RuleTreeNode rtn;
@@ -604,24 +766,68 @@ static bool exec(
     case FSM_NOP:
         break;
     case FSM_ERR:
+        ParseError("%s", tok.c_str());
+        break;
     default:
         break;
     }
     return false;
 }
 
-// FIXIT-L escaping should not be by option name
-// probably should remove content escaping except for \" so
-// that individual rule options can do whatever
-static int get_escape(const string& s)
+static void sync_line(unsigned& line, unsigned target)
 {
-    if ( s == "pcre" )
-        return 0;  // no escape, option goes to ;
+    while ( line < target )
+    {
+        inc_parse_position();
+        ++line;
+    }
+}
 
-    else if ( s == "regex" || s == "sd_pattern" )
-        return -1; // no escape, option goes to "
+// exec steps in order, keeping the parse location in sync with the lines
+// read by the scan.  line_adj converts a chunk's line count to the file's.
+// returns true if the input was ended early (END).
+static bool replay(
+    RuleSteps& steps, size_t from, RuleParseState& rps, snort::SnortConfig* sc,
+    unsigned& line, unsigned line_adj)
+{
+    for ( size_t i = from; i < steps.size(); ++i )
+    {
+        RuleStep& step = steps[i];
+        sync_line(line, step.line + line_adj);
 
-    return 1;      // escape, option goes to "
+        if ( step.action == FSM_WRN )
+        {
+            ParseWarning(WARN_RULES, "%s on line %u\n", step.tok.c_str(), step.at + line_adj);
+            continue;
+        }
+        ++tokens;
+
+        if ( exec(step.action, step.tok, rps, sc) )
+            return true;
+    }
+    return false;
+}
+
+// scan and exec one token at a time
+template <typename Input>
+static void parse_serial(RuleScanner<Input>& rs, RuleParseState& rps, snort::SnortConfig* sc)
+{
+    RuleSteps steps;
+    unsigned line = 0;
+
+    while ( rs.scan(steps) )
+    {
+        bool done = replay(steps, 0, rps, sc, line, 0);
+        steps.clear();
+
+        if ( done )
+            return;
+    }
+    if ( !rs.is_clean() )
+    {
+        sync_line(line, rs.get_line());
+        ParseError("incomplete rule");
+    }
 }
 
 // parse_body() is called at the end of a stub rule to parse the detection
@@ -629,69 +835,432 @@ static int get_escape(const string& s)
 // different state.
 static void parse_body(const char* extra, RuleParseState& rps, snort::SnortConfig* sc)
 {
-    stringstream is(extra);
+    BufferInput in(extra, extra + strlen(extra));
+    RuleScanner<BufferInput> rs(in, 8, "(:,;)");
+    RuleSteps steps;
+    unsigned line = 0;
 
-    string tok;
-    TokenType type;
-    int esc = 1;
+    // the body is part of the stub rule so an unterminated body is not
+    // reported here
+    while ( rs.scan(steps) )
+    {
+        replay(steps, 0, rps, sc, line, 0);
+        steps.clear();
+    }
+}
+
+//-------------------------------------------------------------------------
+// chunks
+//
+// each chunk after the first is scanned speculatively, as if a rule ended
+// just before it.  a chunk's scan runs on past its nominal end to the next
+// point between rules and records every such point along the way.  when
+// the chunks are merged, the scan known to be correct continues until it
+// reaches a point the next chunk's scan also passed with the same state;
+// from there the two scans are identical so the next chunk's steps are
+// used.  if that never happens (eg the chunk started inside a comment)
+// the correct scan just covers the chunk itself.  so the result is always
+// the same as a serial scan.
+//-------------------------------------------------------------------------
+
+#define MIN_CHUNK_SIZE (256 * 1024)
+
+struct CleanPoint
+{
+    ScanState state;
+    size_t step;
+    unsigned line;
+};
+
+struct ChunkScan
+{
+    RuleScanner<BufferInput> scanner;
+    RuleSteps steps;
+    unordered_map<const char*, CleanPoint> clean;
+    const char* end;
+    bool eof = false;
+
+    ChunkScan(const char* b, const char* e, const char* stop) :
+        scanner(BufferInput(b, stop)), end(e) { }
 
-    int num = 8;
-    const char* punct = "(:,;)";
+    const char* get_ptr() const
+    { return scanner.get_input().get_ptr(); }
+};
 
-    while ( (type = get_token(is, tok, punct, esc)) )
+// scan to the first point between rules at or past end; false at eof
+static bool scan_to(ChunkScan& cs, const char* end, bool record)
+{
+    while ( cs.scanner.scan(cs.steps) )
     {
-        ++tokens;
-        const State* s = get_state(num, type, tok);
+        if ( !cs.scanner.is_clean() )
+            continue;
 
-#ifdef TRACER
-        printf("%d: %s = '%s' -> %s\n",
-            num, toks[type], tok.c_str(), acts[s->action]);
-#endif
-        exec(s->action, tok, rps, sc);
+        const char* ptr = cs.get_ptr();
 
-        num = s->next;
-        esc = get_escape(rps.key);
+        if ( record )
+            cs.clean[ptr] = { cs.scanner.get_state(), cs.steps.size(), cs.scanner.get_line() };
 
-        if ( s->punct )
-            punct = s->punct;
+        if ( ptr >= end )
+            return true;
     }
+    return false;
 }
 
-void parse_stream(istream& is, snort::SnortConfig* sc)
+static void scan_chunk(ChunkScan* cs)
 {
-    string tok;
-    TokenType type;
-    int esc = 1;
+    cs->eof = !scan_to(*cs, cs->end, true);
+}
 
-    int num = 0;
-    const char* punct = fsm[0].punct;
+// where the merged steps go; parsing execs them
+class StepSink
+{
+public:
+    virtual ~StepSink() = default;
+
+    // returns true if the input was ended early (END)
+    virtual bool replay(RuleSteps&, size_t from, unsigned line_adj) = 0;
+
+    // the input ended inside a rule after the given number of lines
+    virtual void incomplete(unsigned line) = 0;
+};
+
+class ExecSink : public StepSink
+{
+public:
+    ExecSink(RuleParseState& r, snort::SnortConfig* c) : rps(r), sc(c) { }
+
+    bool replay(RuleSteps& steps, size_t from, unsigned line_adj) override
+    { return ::replay(steps, from, rps, sc, line, line_adj); }
+
+    void incomplete(unsigned end) override
+    {
+        sync_line(line, end);
+        ParseError("incomplete rule");
+    }
+
+private:
+    RuleParseState& rps;
+    snort::SnortConfig* sc;
+    unsigned line = 0;
+};
+
+static unsigned get_chunk_count(size_t len)
+{
+    unsigned n = thread::hardware_concurrency();
+    size_t max = len / MIN_CHUNK_SIZE;
+
+    if ( n > max )
+        n = max;
+
+    return n ? n : 1;
+}
+
+// split buf into about n chunks
+static void parse_chunks(const char* buf, size_t len, unsigned n, StepSink& sink)
+{
+    const char* stop = buf + len;
+
+    // chunks start at line starts
+    vector<const char*> starts { buf };
+
+    for ( unsigned i = 1; i < n; ++i )
+    {
+        const char* nominal = buf + i * (len / n);
+
+        if ( nominal <= starts.back() )
+            continue;
+
+        const char* eol = (const char*)memchr(nominal, '\n', stop - nominal);
+
+        if ( !eol or eol + 1 >= stop )
+            break;
+
+        starts.emplace_back(eol + 1);
+    }
+
+    vector<ChunkScan*> scans;
+    vector<thread> workers;
+
+    for ( unsigned i = 0; i < starts.size(); ++i )
+    {
+        const char* end = (i + 1 < starts.size()) ? starts[i + 1] : stop;
+        scans.emplace_back(new ChunkScan(starts[i], end, stop));
+    }
+
+    chunks += scans.size();
+
+    Stopwatch<SnortClock> scan_sw, parse_sw;
+    scan_sw.start();
+
+    for ( auto cs : scans )
+        workers.emplace_back(scan_chunk, cs);
+
+    workers[0].join();
+    scan_sw.stop();
+
+    ChunkScan* cur = scans[0];
+    size_t from = 0;
+    unsigned line_adj = 0;
+    bool done = false;
+
+    parse_sw.start();
+    done = sink.replay(cur->steps, from, line_adj);
+    parse_sw.stop();
+
+    for ( unsigned i = 1; i < scans.size() and !done and !cur->eof; ++i )
+    {
+        ChunkScan* next = scans[i];
+
+        scan_sw.start();
+        workers[i].join();
+        scan_sw.stop();
+
+        while ( true )
+        {
+            auto it = next->clean.find(cur->get_ptr());
+
+            if ( it != next->clean.end() and it->second.state == cur->scanner.get_state() )
+            {
+                line_adj = cur->scanner.get_line() + line_adj - it->second.line;
+                from = it->second.step;
+                cur = next;
+                break;
+            }
+
+            cur->steps.clear();
+            from = 0;
+
+            // the next scan is of no use, finish its chunk with this one
+            if ( cur->get_ptr() >= next->get_ptr() )
+            {
+                scan_sw.start();
+                cur->eof = !scan_to(*cur, next->end, false);
+                scan_sw.stop();
+                break;
+            }
+
+            scan_sw.start();
+            cur->eof = !scan_to(*cur, cur->get_ptr(), false);
+            scan_sw.stop();
+
+            parse_sw.start();
+            done = sink.replay(cur->steps, 0, line_adj);
+            parse_sw.stop();
+
+            cur->steps.clear();
+
+            if ( done or cur->eof )
+                break;
+        }
+        if ( done )
+            break;
+
+        parse_sw.start();
+        done = sink.replay(cur->steps, from, line_adj);
+        parse_sw.stop();
+    }
+
+    for ( auto& t : workers )
+    {
+        if ( t.joinable() )
+            t.join();
+    }
+
+    if ( !done and !cur->scanner.is_clean() )
+        sink.incomplete(cur->scanner.get_line() + line_adj);
+
+    for ( auto cs : scans )
+        delete cs;
+
+    scan_usecs += clock_usecs(TO_USECS(scan_sw.get()));
+    parse_usecs += clock_usecs(TO_USECS(parse_sw.get()));
+}
+
+//-------------------------------------------------------------------------
+// public methods
+//-------------------------------------------------------------------------
+
+void parse_stream(istream& is, snort::SnortConfig* sc)
+{
     RuleParseState rps;
 
-    while ( (type = get_token(is, tok, punct, esc)) )
+    // stdin is read as it comes, until END or eof
+    if ( &is == &cin )
     {
-        ++tokens;
-        const State* s = get_state(num, type, tok);
+        RuleScanner<StreamInput> rs((StreamInput(is)));
+        parse_serial(rs, rps, sc);
+        return;
+    }
 
-#ifdef TRACER
-        printf("%d: %s = '%s' -> %s\n",
-            num, toks[type], tok.c_str(), acts[s->action]);
-#endif
+    Stopwatch<SnortClock> sw;
+    sw.start();
 
-        if ( exec(s->action, tok, rps, sc) )
+    string buf((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+
+    sw.stop();
+    read_usecs += clock_usecs(TO_USECS(sw.get()));
+
+    ExecSink sink(rps, sc);
+    parse_chunks(buf.data(), buf.size(), get_chunk_count(buf.size()), sink);
+}
+
+void parse_stream_print()
+{
+    if ( chunks )
+    {
+        LogLabel("rule parsing");
+        LogCount("chunks", chunks);
+        LogCount("read usecs", read_usecs);
+        LogCount("scan wait usecs", scan_usecs);
+        LogCount("parse usecs", parse_usecs);
+    }
+    chunks = 0;
+    read_usecs = scan_usecs = parse_usecs = 0;
+}
+
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+
+// steps with file lines, as the merge hands them over
+class CollectSink : public StepSink
+{
+public:
+    bool replay(RuleSteps& steps, size_t from, unsigned line_adj) override
+    {
+        for ( size_t i = from; i < steps.size(); ++i )
+        {
+            const RuleStep& s = steps[i];
+            unsigned at = (s.action == FSM_WRN) ? s.at + line_adj : 0;
+            all.emplace_back(s.action, s.line + line_adj, string(s.tok), at);
+        }
+        return false;
+    }
+
+    void incomplete(unsigned line) override
+    { end = line; }
+
+    RuleSteps all;
+    unsigned end = 0;
+};
+
+static void scan_serial(const string& text, CollectSink& sink)
+{
+    RuleScanner<BufferInput> rs(BufferInput(text.data(), text.data() + text.size()));
+    RuleSteps steps;
+
+    while ( rs.scan(steps) )
+        ;
+
+    sink.replay(steps, 0, 0);
+
+    if ( !rs.is_clean() )
+        sink.incomplete(rs.get_line());
+}
+
+static bool same_steps(const RuleSteps& a, const RuleSteps& b)
+{
+    if ( a.size() != b.size() )
+        return false;
+
+    for ( size_t i = 0; i < a.size(); ++i )
+    {
+        if ( a[i].action != b[i].action or a[i].line != b[i].line or
+            a[i].at != b[i].at or a[i].tok != b[i].tok )
+            return false;
+    }
+    return true;
+}
+
+// strings and comments that span lines put chunk starts inside them
+static string make_rules(unsigned num)
+{
+    string text;
+
+    for ( unsigned i = 0; i < num; ++i )
+    {
+        string sid = to_string(i + 1);
+
+        switch ( i % 6 )
+        {
+        case 0:
+            text += "alert tcp any any -> any 80 ( msg:\"plain " + sid + "\"; sid:" + sid + "; )\n";
+            break;
+        case 1:
+            text += "alert tcp any any -> any any ( content:\"split\n";
+            text += "alert tcp any any -> any 80 ( sid:0; )\n";
+            text += "string\"; sid:" + sid + "; )\n";
+            break;
+        case 2:
+            text += "/* alert tcp any any -> any 80 ( sid:0; )\n";
+            text += "   \"quoted\n";
+            text += "alert tcp any any -> any 80 ( sid:0; ) */\n";
+            text += "alert udp any any -> any 53 ( sid:" + sid + "; )\n";
             break;
+        case 3:
+            text += "# alert tcp any any -> any 80 ( sid:0;\n";
+            text += "alert ip any any -> any any \\\n";
+            text += "    ( content:\"\\xZZ\"; sid:" + sid + "; )\n";
+            break;
+        case 4:
+            text += "alert tcp any any -> any 25 \\q ( sid:" + sid + "; )\n\n";
+            break;
+        case 5:
+            text += "alert tcp any any -> any 21 (\n    msg:\"multi\";\n    sid:" + sid + ";\n)\n";
+            break;
+        }
+    }
+    return text;
+}
+
+TEST_CASE("chunked scan matches serial scan", "[parse_stream]")
+{
+    string text = make_rules(120);
+
+    CollectSink serial;
+    scan_serial(text, serial);
+
+    unsigned wrn = 0;
+
+    for ( const auto& s : serial.all )
+        wrn += (s.action == FSM_WRN);
 
-        num = s->next;
-        esc = get_escape(rps.key);
+    // two line breaks in the split string and one for each other case
+    CHECK(wrn == 100);
+    CHECK(serial.end == 0);
 
-        if ( s->punct )
-            punct = s->punct;
+    // chunks as small as a line or two
+    for ( unsigned n : { 1, 2, 3, 7, 16, 41, 100, 250, 600 } )
+    {
+        CollectSink chunked;
+        parse_chunks(text.data(), text.size(), n, chunked);
+
+        INFO("chunks = " << n);
+        CHECK(same_steps(serial.all, chunked.all));
+        CHECK(chunked.end == 0);
     }
-    if ( num )
-        ParseError("incomplete rule");
+}
 
-    //printf("chars = %d, tokens = %d\n", chars, tokens);
-    //printf("lines = %d, comments = %d\n", lines, comments);
-    //printf("rules = %d, keys = %d\n", rules, keys);
-    //printf("lists = %d, strings = %d\n", lists, strings);
+TEST_CASE("chunked scan of an incomplete rule", "[parse_stream]")
+{
+    string text = make_rules(30);
+    text += "alert tcp any any -> any 80 ( content:\"open\n\nsid:1;\n";
+
+    CollectSink serial;
+    scan_serial(text, serial);
+    CHECK(serial.end > 0);
+
+    for ( unsigned n : { 2, 5, 20, 60 } )
+    {
+        CollectSink chunked;
+        parse_chunks(text.data(), text.size(), n, chunked);
+
+        INFO("chunks = " << n);
+        CHECK(same_steps(serial.all, chunked.all));
+        CHECK(chunked.end == serial.end);
+    }
 }
 
+#endif
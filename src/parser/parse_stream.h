@@ -28,6 +28,7 @@ struct SnortConfig;
 #include <istream>
 
 void parse_stream(std::istream&, snort::SnortConfig*);
+void parse_stream_print();
 
 #endif
 
@@ -583,6 +583,7 @@ void ParseRules(SnortConfig* sc)
     PortTablesFinish(sc->port_tables, sc->fast_pattern_config);
 
     parse_rule_print();
+    parse_stream_print();
 }
 
 /****************************************************************************
@@ -24,6 +24,7 @@
 #include "port_group.h"
 
 #include "detection/detection_options.h"
+#include "framework/mpse.h"
 #include "managers/mpse_manager.h"
 #include "utils/util.h"
 
@@ -43,7 +44,9 @@ void PortGroup::free(PortGroup* pg)
     {
         if (pg->mpse[i] != nullptr)
         {
-            MpseManager::delete_search_engine(pg->mpse[i]);
+            if ( !pg->mpse[i]->rem_ref() )
+                MpseManager::delete_search_engine(pg->mpse[i]);
+
             pg->mpse[i] = nullptr;
         }
     }
@@ -36,12 +36,15 @@
 //     The computed value will also be garbage (duration& operator+=(const duration& __d))
 #include "detection/detection_options.h"  // ... FIXIT-W
 
+#include "detection/fp_config.h"
 #include "detection/treenodes.h"
 #include "hash/ghash.h"
+#include "log/messages.h"
 #include "main/snort_config.h"
 #include "main/thread_config.h"
 #include "parser/parser.h"
 #include "target_based/snort_protocols.h"
+#include "utils/stats.h"
 
 #include "profiler_printer.h"
 #include "profiler_stats_table.h"
@@ -292,13 +295,49 @@ static void print_entries(std::vector<View>& entries, ProfilerSorter<View>& sort
 
 }
 
+// the fast pattern profile is written from the same consolidated counts
+// so it is done here; build_entries() can only be called once
+static void save_fp_profile(FastPatternConfig* fp, const std::vector<rule_stats::View>& entries)
+{
+    FpProfile* prof = fp->get_fp_profile();
+    assert(prof);
+
+    for ( const auto& v : entries )
+        prof->set_counts(v.sig_info.gid, v.sig_info.sid, v.checks(), v.matches());
+
+    const char* file = fp->get_fp_profile_out().c_str();
+
+    if ( !prof->save(file) )
+        ErrorMessage("can't write fast pattern profile %s\n", file);
+
+    uint64_t before, after;
+    unsigned n = prof->get_reselected(before, after);
+
+    if ( !n )
+        return;
+
+    LogLabel("fast pattern profile");
+    LogCount("reselected rules", n);
+    LogCount("false triggers before", before);
+    LogCount("false triggers after", after);
+}
+
 void show_rule_profiler_stats(const RuleProfilerConfig& config)
 {
-    if ( !config.show )
+    FastPatternConfig* fp = SnortConfig::get_conf()->fast_pattern_config;
+    bool save = fp and !fp->get_fp_profile_out().empty();
+
+    if ( !config.show and !save )
         return;
 
     auto entries = rule_stats::build_entries();
 
+    if ( save )
+        save_fp_profile(fp, entries);
+
+    if ( !config.show )
+        return;
+
     // if there aren't any eval'd rules, don't sort or print
     if ( entries.empty() )
         return;
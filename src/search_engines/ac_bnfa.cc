@@ -24,6 +24,7 @@
 *
 *   Updates:
 *   3/06 - Added AC_BNFA search
+*   Added AC_BNFA_BITMAP search, same nfa with bitmap compressed states
 */
 
 #ifdef HAVE_CONFIG_H
@@ -46,11 +47,16 @@ private:
     bnfa_struct_t* obj;
 
 public:
-    AcBnfaMpse(SnortConfig*, const MpseAgent* agent)
-        : Mpse("ac_bnfa")
+    AcBnfaMpse(SnortConfig*, const MpseAgent* agent, const char* method = "ac_bnfa",
+        int format = BNFA_SPARSE)
+        : Mpse(method)
     {
         obj=bnfaNew(agent);
-        if ( obj ) obj->bnfaMethod = 1;
+        if ( obj )
+        {
+            obj->bnfaMethod = 1;
+            obj->bnfaFormat = format;
+        }
     }
 
     ~AcBnfaMpse() override
@@ -77,10 +83,27 @@ public:
         return bnfaCompile(sc, obj);
     }
 
+    bool can_build_concurrently() override
+    { return true; }
+
+    int build() override
+    {
+        return bnfaBuild(obj);
+    }
+
+    int finish(SnortConfig* sc) override
+    {
+        return bnfaFinish(sc, obj);
+    }
+
     int _search(
         const uint8_t* T, int n, MpseMatch match,
         void* context, int* current_state) override
     {
+        if ( obj->bnfaFormat == BNFA_BITMAP )
+            return _bnfa_search_bitmap_nfa(
+                obj, T, n, match, context, 0 /* start-state */, current_state);
+
         /* return is actually the state */
         return _bnfa_search_csparse_nfa(
             obj, T, n, match, context, 0 /* start-state */, current_state);
@@ -151,9 +174,53 @@ static const MpseApi bnfa_api =
     bnfa_print,
 };
 
+//-------------------------------------------------------------------------
+// "ac_bnfa_bitmap"
+//-------------------------------------------------------------------------
+
+static Mpse* bnfa_bitmap_ctor(
+    SnortConfig* sc, class Module*, const MpseAgent* agent)
+{
+    return new AcBnfaMpse(sc, agent, "ac_bnfa_bitmap", BNFA_BITMAP);
+}
+
+static void bnfa_bitmap_init()
+{
+    bnfa_init_xlatcase();
+    bnfa_init_simd();
+    bnfaInitSummary();
+}
+
+static const MpseApi bnfa_bitmap_api =
+{
+    {
+        PT_SEARCH_ENGINE,
+        sizeof(MpseApi),
+        SEAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        "ac_bnfa_bitmap",
+        "Aho-Corasick Binary NFA with bitmap compressed states (moderate memory, "
+        "high performance) MPSE",
+        nullptr,
+        nullptr
+    },
+    MPSE_BASE,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+    bnfa_bitmap_ctor,
+    bnfa_dtor,
+    bnfa_bitmap_init,
+    bnfa_print,
+};
+
 const BaseApi* se_ac_bnfa[] =
 {
     &bnfa_api.base,
+    &bnfa_bitmap_api.base,
     nullptr
 };
 
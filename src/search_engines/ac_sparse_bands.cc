@@ -59,6 +59,15 @@ public:
     int prep_patterns(SnortConfig* sc) override
     { return acsmCompile2(sc, obj); }
 
+    bool can_build_concurrently() override
+    { return true; }
+
+    int build() override
+    { return acsmBuild2(obj); }
+
+    int finish(SnortConfig* sc) override
+    { return acsmFinish2(sc, obj); }
+
     int _search(
         const uint8_t* T, int n, MpseMatch match,
         void* context, int* current_state) override
@@ -117,10 +117,13 @@
 
 #include "acsmx2.h"
 
+#include <atomic>
 #include <cassert>
 #include <list>
+#include <mutex>
 
 #include "log/messages.h"
+#include "memory/huge_arena.h"
 #include "utils/stats.h"
 #include "utils/util.h"
 
@@ -130,31 +133,34 @@ using namespace snort;
 
 #define MEMASSERT(p,s) if (!(p)) { snort::FatalError("ACSM-No Memory: %s\n",s); }
 
-static int acsm2_total_memory = 0;
-static int acsm2_pattern_memory = 0;
-static int acsm2_matchlist_memory = 0;
-static int acsm2_transtable_memory = 0;
-static int acsm2_dfa_memory = 0;
-static int acsm2_dfa1_memory = 0;
-static int acsm2_dfa2_memory = 0;
-static int acsm2_dfa4_memory = 0;
-static int acsm2_failstate_memory = 0;
-
+static std::atomic<int> acsm2_total_memory(0);
+static std::atomic<int> acsm2_pattern_memory(0);
+static std::atomic<int> acsm2_matchlist_memory(0);
+static std::atomic<int> acsm2_transtable_memory(0);
+static std::atomic<int> acsm2_dfa_memory(0);
+static std::atomic<int> acsm2_dfa1_memory(0);
+static std::atomic<int> acsm2_dfa2_memory(0);
+static std::atomic<int> acsm2_dfa4_memory(0);
+static std::atomic<int> acsm2_failstate_memory(0);
+
+// instances may be compiled concurrently (see Mpse::build()) so the
+// counters are atomic and the last instance snapshot is locked
 struct acsm_summary_t
 {
-    unsigned num_states;
-    unsigned num_transitions;
-    unsigned num_instances;
-    unsigned num_patterns;
-    unsigned num_characters;
-    unsigned num_match_states;
-    unsigned num_1byte_instances;
-    unsigned num_2byte_instances;
-    unsigned num_4byte_instances;
+    std::atomic<unsigned> num_states;
+    std::atomic<unsigned> num_transitions;
+    std::atomic<unsigned> num_instances;
+    std::atomic<unsigned> num_patterns;
+    std::atomic<unsigned> num_characters;
+    std::atomic<unsigned> num_match_states;
+    std::atomic<unsigned> num_1byte_instances;
+    std::atomic<unsigned> num_2byte_instances;
+    std::atomic<unsigned> num_4byte_instances;
     ACSM_STRUCT2 acsm;
 };
 
 static acsm_summary_t summary;
+static std::mutex summary_mutex;
 
 void acsm_init_summary()
 {
@@ -269,9 +275,10 @@ static void* AC_MALLOC(int n, Acsm2MemoryType type)
     return p;
 }
 
+// the dfa tables are what searches touch so they go on huge pages if enabled
 static void* AC_MALLOC_DFA(int n, int sizeofstate)
 {
-    void* p = snort_calloc(n);
+    void* p = memory::HugeArena::allocate(n);
 
     switch (sizeofstate)
     {
@@ -341,7 +348,7 @@ static void AC_FREE_DFA(void* p, int n, int sizeofstate)
 
         acsm2_dfa_memory -= n;
         acsm2_total_memory -= n;
-        snort_free(p);
+        memory::HugeArena::deallocate(p);
     }
 }
 
@@ -1360,22 +1367,35 @@ static inline int _acsmCompile2(ACSM_STRUCT2* acsm)
     summary.num_transitions += acsm->acsmNumTrans;
     summary.num_instances++;
 
-    memcpy(&summary.acsm, acsm, sizeof(ACSM_STRUCT2));
+    {
+        std::lock_guard<std::mutex> lock(summary_mutex);
+        memcpy(&summary.acsm, acsm, sizeof(ACSM_STRUCT2));
+    }
 
     return 0;
 }
 
-int acsmCompile2(snort::SnortConfig* sc, ACSM_STRUCT2* acsm)
+int acsmBuild2(ACSM_STRUCT2* acsm)
 {
-    if ( int rval = _acsmCompile2(acsm) )
-        return rval;
+    return _acsmCompile2(acsm);
+}
 
+int acsmFinish2(snort::SnortConfig* sc, ACSM_STRUCT2* acsm)
+{
     if ( acsm->agent )
         acsmBuildMatchStateTrees2(sc, acsm);
 
     return 0;
 }
 
+int acsmCompile2(snort::SnortConfig* sc, ACSM_STRUCT2* acsm)
+{
+    if ( int rval = acsmBuild2(acsm) )
+        return rval;
+
+    return acsmFinish2(sc, acsm);
+}
+
 /*
 *   Get the NextState from the NFA, all NFA storage formats use this
 */
@@ -148,6 +148,11 @@ int acsmAddPattern2(
 
 int acsmCompile2(snort::SnortConfig*, ACSM_STRUCT2*);
 
+// acsmCompile2() == acsmBuild2() + acsmFinish2(); only the build step is
+// safe to run concurrently with other instances
+int acsmBuild2(ACSM_STRUCT2*);
+int acsmFinish2(snort::SnortConfig*, ACSM_STRUCT2*);
+
 int acsm_search_nfa(
     ACSM_STRUCT2*, const uint8_t* T, int n, MpseMatch, void* context, int* current_state);
 
@@ -147,8 +147,15 @@
 #include "bnfa_search.h"
 
 #include <list>
+#include <mutex>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BNFA_HAVE_AVX2
+#endif
 
 #include "log/messages.h"
+#include "memory/huge_arena.h"
 #include "utils/stats.h"
 #include "utils/util.h"
 
@@ -209,9 +216,41 @@ static void bnfa_free(void* p, int n, int* m)
     }
 }
 
+/*
+* The compiled transition list is what searches touch, so it goes on
+* huge pages when memory.huge_pages is set
+*/
+static void* bnfa_alloc_table(int n, int* m)
+{
+    if ( !n )
+        return nullptr;
+
+    void* p = memory::HugeArena::allocate(n);
+
+    if (m)
+        m[0] += n;
+
+    return p;
+}
+
+static void bnfa_free_table(void* p, int n, int* m)
+{
+    if ( p )
+    {
+        memory::HugeArena::deallocate(p);
+        if (m)
+        {
+            m[0] -= n;
+        }
+    }
+}
+
 #define BNFA_MALLOC(n,memory) (bnfa_state_t*)bnfa_alloc(n,&(memory))
 #define BNFA_FREE(p,n,memory) bnfa_free(p,n,&(memory))
 
+#define BNFA_MALLOC_TABLE(n,memory) (bnfa_state_t*)bnfa_alloc_table(n,&(memory))
+#define BNFA_FREE_TABLE(p,n,memory) bnfa_free_table(p,n,&(memory))
+
 /*
 *  Get next state from transition list
 */
@@ -888,7 +927,7 @@ static int _bnfa_conv_list_to_csparse_array(bnfa_struct_t* bnfa)
     /*
       Alloc The Transition List - we need an array of bnfa_state_t items of size 'nps'
     */
-    ps = BNFA_MALLOC(nps*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+    ps = BNFA_MALLOC_TABLE(nps*sizeof(bnfa_state_t),bnfa->nextstate_memory);
     if ( !ps )
     {
         /* Fatal */
@@ -1049,6 +1088,104 @@ static int _bnfa_conv_list_to_csparse_array(bnfa_struct_t* bnfa)
     return 0;
 }
 
+/*
+*  Convert the list based NFA to bitmap format
+*
+*  State 0 is a full row of 256 targets since it is visited most and has
+*  the most transitions.  Every other state gets a 64 byte node with a
+*  256 bit map of the inputs it has transitions for; the targets of all
+*  nodes are packed into one array in state and input order.  A lookup is
+*  one node, one popcount and one target load instead of the list search
+*  the sparse format does.
+*/
+static int _bnfa_conv_list_to_bitmap(bnfa_struct_t* bnfa)
+{
+    bnfa_state_t* FailState = bnfa->bnfaFailState;
+    bnfa_state_t full[BNFA_MAX_ALPHABET_SIZE];
+    unsigned ntargets = 0;
+
+    static_assert(sizeof(bnfa_bitmap_node_t) == 64, "bitmap nodes are one cache line");
+
+    for ( int k = 1; k < bnfa->bnfaNumStates; k++ )
+    {
+        _bnfa_list_conv_row_to_full(bnfa, (bnfa_state_t)k, full);
+
+        for ( int i = 0; i < bnfa->bnfaAlphabetSize; i++ )
+        {
+            if ( full[i] & BNFA_SPARSE_MAX_STATE )
+                ntargets++;
+        }
+    }
+
+    /* one block: alignment slack, nodes, root row, targets */
+    unsigned size = 64 + bnfa->bnfaNumStates * sizeof(bnfa_bitmap_node_t) +
+        (BNFA_MAX_ALPHABET_SIZE + ntargets) * sizeof(bnfa_state_t);
+
+    void* mem = BNFA_MALLOC_TABLE(size, bnfa->nextstate_memory);
+
+    if ( !mem )
+        return -1;
+
+    bnfa->bnfaBitmapMem = mem;
+    bnfa->bnfaBitmapSize = size;
+
+    uintptr_t base = ((uintptr_t)mem + 63) & ~(uintptr_t)63;
+    bnfa_bitmap_node_t* nodes = (bnfa_bitmap_node_t*)base;
+    bnfa_state_t* root = (bnfa_state_t*)(nodes + bnfa->bnfaNumStates);
+    bnfa_state_t* targets = root + BNFA_MAX_ALPHABET_SIZE;
+
+    bnfa->bnfaBitmapNodes = nodes;
+    bnfa->bnfaBitmapRoot = root;
+    bnfa->bnfaBitmapTargets = targets;
+
+    _bnfa_list_conv_row_to_full(bnfa, 0, full);
+
+    for ( int i = 0; i < BNFA_MAX_ALPHABET_SIZE; i++ )
+        root[i] = full[i] & BNFA_SPARSE_MAX_STATE;
+
+    nodes[0].mlist = bnfa->bnfaMatchList[0];
+
+    unsigned t = 0;
+
+    for ( int k = 1; k < bnfa->bnfaNumStates; k++ )
+    {
+        bnfa_bitmap_node_t* n = nodes + k;
+        _bnfa_list_conv_row_to_full(bnfa, (bnfa_state_t)k, full);
+
+        n->next = t;
+        n->fail = FailState[k];
+        n->mlist = bnfa->bnfaMatchList[k];
+
+        for ( int i = 0; i < bnfa->bnfaAlphabetSize; i++ )
+        {
+            if ( !(i & 63) )
+                n->rank[i >> 6] = t - n->next;
+
+            if ( bnfa_state_t s = full[i] & BNFA_SPARSE_MAX_STATE )
+            {
+                n->bits[i >> 6] |= 1ULL << (i & 63);
+                targets[t++] = s;
+            }
+        }
+    }
+
+    /* the raw bytes that leave state 0 for the vector skip; it only pays
+       when most bytes don't */
+    unsigned nroot = 0;
+
+    for ( int b = 0; b < BNFA_MAX_ALPHABET_SIZE; b++ )
+    {
+        if ( !root[xlatcase[b]] )
+            continue;
+
+        bnfa->bnfaRootSet[b >> 7][b & 0x0f] |= 1 << ((b >> 4) & 7);
+        nroot++;
+    }
+    bnfa->bnfaRootSkip = nroot < BNFA_MAX_ALPHABET_SIZE / 2;
+
+    return 0;
+}
+
 /*
 *  Print the state machine - rather verbose
 */
@@ -1076,6 +1213,12 @@ void bnfaPrint(bnfa_struct_t* bnfa)
             return;
     }
 
+    else if ( bnfa->bnfaFormat == BNFA_BITMAP )
+    {
+        printf("Print NFA-BITMAP state machine : %d active states\n", bnfa->bnfaNumStates);
+        if ( !bnfa->bnfaBitmapNodes )
+            return;
+    }
 #ifdef ALLOW_NFA_FULL
     else if ( bnfa->bnfaFormat ==BNFA_FULL )
     {
@@ -1135,6 +1278,34 @@ void bnfaPrint(bnfa_struct_t* bnfa)
                 }
             }
         }
+        else if ( bnfa->bnfaFormat == BNFA_BITMAP )
+        {
+            const bnfa_bitmap_node_t* n = bnfa->bnfaBitmapNodes + k;
+            const bnfa_state_t* next = k ? bnfa->bnfaBitmapTargets + n->next : bnfa->bnfaBitmapRoot;
+            int nc = 0;
+
+            printf("fs=%-4d ", k ? n->fail : 0);
+
+            for ( int i=0; i<bnfa->bnfaAlphabetSize; i++ )
+            {
+                bnfa_state_t state;
+
+                if ( !k )
+                    state = next[i];
+                else if ( n->bits[i >> 6] & (1ULL << (i & 63)) )
+                    state = next[nc++];
+                else
+                    continue;
+
+                if ( !state )
+                    continue;
+
+                if ( isascii(i) && isprint(i) )
+                    printf("%3c->%-5d\t",i,state);
+                else
+                    printf("%3d->%-5d\t",i,state);
+            }
+        }
 #ifdef ALLOW_NFA_FULL
         else if ( bnfa->bnfaFormat == BNFA_FULL )
         {
@@ -1279,8 +1450,9 @@ void bnfaFree(bnfa_struct_t* bnfa)
         bnfa->matchlist_memory);
     BNFA_FREE(bnfa->bnfaNextState,bnfa->bnfaNumStates*sizeof(bnfa_state_t*),
         bnfa->nextstate_memory);
-    BNFA_FREE(bnfa->bnfaTransList,(2*bnfa->bnfaNumStates+bnfa->bnfaNumTrans)*sizeof(bnfa_state_t*),
-        bnfa->nextstate_memory);
+    BNFA_FREE_TABLE(bnfa->bnfaTransList,
+        (2*bnfa->bnfaNumStates+bnfa->bnfaNumTrans)*sizeof(bnfa_state_t*),bnfa->nextstate_memory);
+    BNFA_FREE_TABLE(bnfa->bnfaBitmapMem,bnfa->bnfaBitmapSize,bnfa->nextstate_memory);
     snort_free(bnfa);   /* cannot update memory tracker when deleting bnfa so just 'free' it !*/
 }
 
@@ -1421,6 +1593,16 @@ static inline int _bnfaCompile(bnfa_struct_t* bnfa)
             bnfa->failstate_memory);
         bnfa->bnfaFailState=nullptr;
     }
+    else if ( bnfa->bnfaFormat == BNFA_BITMAP )
+    {
+        if ( _bnfa_conv_list_to_bitmap(bnfa) )
+        {
+            return -1;
+        }
+        BNFA_FREE(bnfa->bnfaFailState,sizeof(bnfa_state_t)*bnfa->bnfaNumStates,
+            bnfa->failstate_memory);
+        bnfa->bnfaFailState=nullptr;
+    }
 #ifdef ALLOW_NFA_FULL
     else if ( bnfa->bnfaFormat == BNFA_FULL )
     {
@@ -1453,17 +1635,27 @@ static inline int _bnfaCompile(bnfa_struct_t* bnfa)
     return 0;
 }
 
-int bnfaCompile(snort::SnortConfig* sc, bnfa_struct_t* bnfa)
+int bnfaBuild(bnfa_struct_t* bnfa)
 {
-    if ( int rval = _bnfaCompile (bnfa) )
-        return rval;
+    return _bnfaCompile(bnfa);
+}
 
+int bnfaFinish(snort::SnortConfig* sc, bnfa_struct_t* bnfa)
+{
     if ( bnfa->agent )
         bnfaBuildMatchStateTrees(sc, bnfa);
 
     return 0;
 }
 
+int bnfaCompile(snort::SnortConfig* sc, bnfa_struct_t* bnfa)
+{
+    if ( int rval = bnfaBuild(bnfa) )
+        return rval;
+
+    return bnfaFinish(sc, bnfa);
+}
+
 #ifdef ALLOW_NFA_FULL
 
 /*
@@ -1873,6 +2065,175 @@ unsigned _bnfa_search_csparse_nfa(
     return nfound;
 }
 
+/*
+*   Bitmap format search
+*
+*   The next state for a node is its bit for the input ranked into the
+*   packed targets, or the failure state's next state if the bit is clear.
+*   State 0 is a full row and ends the failure chain.
+*/
+static inline unsigned _bnfa_get_next_state_bitmap_nfa(
+    const bnfa_bitmap_node_t* nodes, const bnfa_state_t* targets,
+    const bnfa_state_t* root, unsigned state, unsigned input)
+{
+    const unsigned w = input >> 6;
+    const uint64_t bit = 1ULL << (input & 63);
+
+    while ( state )
+    {
+        const bnfa_bitmap_node_t* n = nodes + state;
+        const uint64_t bits = n->bits[w];
+
+        if ( bits & bit )
+            return targets[n->next + n->rank[w] + __builtin_popcountll(bits & (bit - 1))];
+
+        state = n->fail;
+    }
+    return root[input];
+}
+
+#ifdef BNFA_HAVE_AVX2
+/*
+*   At state 0 most inputs just stay at state 0, so skip 32 bytes at a time
+*   to the first one that leaves it.  Membership in the 256 bit set of such
+*   bytes is two lookups by low nibble, one for each half of the high
+*   nibble range, and a test of the high nibble's bit.
+*/
+__attribute__((target("avx2,popcnt")))
+static const uint8_t* _bnfa_skip_root_avx2(
+    const bnfa_struct_t* bnfa, const uint8_t* T, const uint8_t* Tend)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i seven = _mm256_set1_epi8(7);
+    const __m256i lo_set = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)bnfa->bnfaRootSet[0]));
+    const __m256i hi_set = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)bnfa->bnfaRootSet[1]));
+    const __m256i bits = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+
+    while ( Tend - T >= 32 )
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)T);
+        __m256i lo = _mm256_and_si256(v, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+
+        __m256i row = _mm256_blendv_epi8(
+            _mm256_shuffle_epi8(lo_set, lo), _mm256_shuffle_epi8(hi_set, lo),
+            _mm256_cmpgt_epi8(hi, seven));
+
+        __m256i bit = _mm256_shuffle_epi8(bits, hi);
+        __m256i hit = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit);
+
+        if ( unsigned m = _mm256_movemask_epi8(hit) )
+            return T + __builtin_ctz(m);
+
+        T += 32;
+    }
+    return T;
+}
+#endif
+
+template<bool simd>
+static inline __attribute__((always_inline)) unsigned _bnfa_search_bitmap(
+    bnfa_struct_t* bnfa, const uint8_t* Tx, int n, MpseMatch match,
+    void* context, unsigned sindex, int* current_state)
+{
+    const bnfa_bitmap_node_t* nodes = bnfa->bnfaBitmapNodes;
+    const bnfa_state_t* targets = bnfa->bnfaBitmapTargets;
+    const bnfa_state_t* root = bnfa->bnfaBitmapRoot;
+
+    unsigned nfound = 0;
+    unsigned last_match=LAST_STATE_INIT;
+    unsigned last_match_saved=LAST_STATE_INIT;
+
+    const uint8_t* T = Tx;
+    const uint8_t* Tend = T + n;
+
+    for (; T<Tend; T++)
+    {
+#ifdef BNFA_HAVE_AVX2
+        if ( simd and !sindex )
+        {
+            T = _bnfa_skip_root_avx2(bnfa, T, Tend);
+
+            if ( T == Tend )
+                break;
+        }
+#endif
+        uint8_t Tchar = xlatcase[ *T ];
+
+        sindex = _bnfa_get_next_state_bitmap_nfa(nodes, targets, root, sindex, Tchar);
+
+        /* Log matches in this state - if any */
+        bnfa_match_node_t* mlist = nodes[sindex].mlist;
+
+        if ( sindex && mlist )
+        {
+            if ( sindex == last_match )
+                continue;
+
+            last_match_saved = last_match;
+            last_match = sindex;
+
+            bnfa_pattern_t* patrn = (bnfa_pattern_t*)mlist->data;
+            unsigned index = T - Tx + 1;
+            nfound++;
+
+            int res = match(patrn->userdata, mlist->rule_option_tree, index,
+                context, mlist->neg_list);
+
+            if ( res > 0 )
+            {
+                *current_state = sindex;
+                return nfound;
+            }
+            else if ( res < 0 )
+            {
+                last_match = last_match_saved;
+            }
+        }
+    }
+    *current_state = sindex;
+    return nfound;
+}
+
+#ifdef BNFA_HAVE_AVX2
+__attribute__((target("avx2,popcnt")))
+static unsigned _bnfa_search_bitmap_avx2(
+    bnfa_struct_t* bnfa, const uint8_t* Tx, int n, MpseMatch match,
+    void* context, unsigned sindex, int* current_state)
+{
+    if ( bnfa->bnfaRootSkip )
+        return _bnfa_search_bitmap<true>(bnfa, Tx, n, match, context, sindex, current_state);
+
+    return _bnfa_search_bitmap<false>(bnfa, Tx, n, match, context, sindex, current_state);
+}
+#endif
+
+static bool bnfa_avx2 = false;
+
+void bnfa_init_simd(bool enable)
+{
+#ifdef BNFA_HAVE_AVX2
+    bnfa_avx2 = enable and __builtin_cpu_supports("avx2") and __builtin_cpu_supports("popcnt");
+#else
+    UNUSED(enable);
+#endif
+}
+
+unsigned _bnfa_search_bitmap_nfa(
+    bnfa_struct_t* bnfa, const uint8_t* Tx, int n, MpseMatch match,
+    void* context, unsigned sindex, int* current_state)
+{
+#ifdef BNFA_HAVE_AVX2
+    if ( bnfa_avx2 )
+        return _bnfa_search_bitmap_avx2(bnfa, Tx, n, match, context, sindex, current_state);
+#endif
+    return _bnfa_search_bitmap<false>(bnfa, Tx, n, match, context, sindex, current_state);
+}
+
 #ifdef BNFA_MAIN
 /*
  * Case specific search, global to all patterns
@@ -2012,6 +2373,7 @@ int bnfaPatternCount(bnfa_struct_t* p)
  */
 static bnfa_struct_t summary;
 static int summary_cnt = 0;
+static std::mutex summary_mutex;  // instances may be compiled concurrently
 
 static void bnfaPrintInfoEx(bnfa_struct_t* p)
 {
@@ -2066,6 +2428,7 @@ void bnfaInitSummary()
 
 void bnfaAccumInfo(bnfa_struct_t* p)
 {
+    std::lock_guard<std::mutex> lock(summary_mutex);
     bnfa_struct_t* px = &summary;
 
     summary_cnt++;
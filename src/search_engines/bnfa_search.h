@@ -99,13 +99,30 @@ struct bnfa_match_node_t
     bnfa_match_node_t* next;
 };
 
+/*
+*  Bitmap format state - one bit per input with a transition and the
+*  targets of those transitions packed in input order, so the target for
+*  input c is at next + rank[c/64] + the count of bits below c in its
+*  word.  Nodes are one cache line and the node index is the state.
+*/
+struct bnfa_bitmap_node_t
+{
+    uint64_t bits[4];
+    bnfa_match_node_t* mlist;
+    bnfa_state_t next;     /* index of the first target */
+    bnfa_state_t fail;     /* failure state */
+    uint8_t rank[4];       /* targets in the preceding words of bits */
+    uint8_t pad[12];
+};
+
 /*
 *  Final storage type for the state transitions
 */
 enum
 {
     BNFA_FULL,
-    BNFA_SPARSE
+    BNFA_SPARSE,
+    BNFA_BITMAP
 };
 
 enum
@@ -140,6 +157,18 @@ struct bnfa_struct_t
     bnfa_state_t* bnfaFailState;
     bnfa_state_t* bnfaTransList;
 
+    /* bitmap format; state 0 is a full row of 256 targets */
+    bnfa_bitmap_node_t* bnfaBitmapNodes;
+    bnfa_state_t* bnfaBitmapTargets;
+    bnfa_state_t* bnfaBitmapRoot;
+    void* bnfaBitmapMem;
+    unsigned bnfaBitmapSize;
+
+    /* raw input bytes that leave state 0, split by high nibble into
+       two tables indexed by low nibble for the vector skip at state 0 */
+    uint8_t bnfaRootSet[2][16];
+    bool bnfaRootSkip;
+
     const MpseAgent* agent;
 
     int bnfaForceFullZeroState;
@@ -170,10 +199,24 @@ int bnfaAddPattern(
 
 int bnfaCompile(snort::SnortConfig*, bnfa_struct_t*);
 
+// bnfaCompile() == bnfaBuild() + bnfaFinish(); only the build step is
+// safe to run concurrently with other instances
+int bnfaBuild(bnfa_struct_t*);
+int bnfaFinish(snort::SnortConfig*, bnfa_struct_t*);
+
 unsigned _bnfa_search_csparse_nfa(
     bnfa_struct_t * pstruct, const uint8_t* t, int tlen, MpseMatch,
     void* context, unsigned sindex, int* current_state);
 
+// same matches as _bnfa_search_csparse_nfa() for a BNFA_BITMAP machine;
+// states are node indexes
+unsigned _bnfa_search_bitmap_nfa(
+    bnfa_struct_t * pstruct, const uint8_t* t, int tlen, MpseMatch,
+    void* context, unsigned sindex, int* current_state);
+
+// use the avx2 skip at state 0 if the cpu has it; false turns it off
+void bnfa_init_simd(bool enable = true);
+
 int bnfaPatternCount(bnfa_struct_t* p);
 
 void bnfaPrint(bnfa_struct_t* pstruct);   /* prints the nfa states-verbose!! */
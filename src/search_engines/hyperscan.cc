@@ -25,8 +25,10 @@
 #include <hs_compile.h>
 #include <hs_runtime.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <string>
 
 #include "framework/mpse.h"
 #include "log/messages.h"
@@ -120,6 +122,15 @@ public:
         if ( hs_db )
             hs_free_database(hs_db);
 
+        for ( auto hs : streams )
+        {
+            if ( hs )
+                hs_close_stream(hs, nullptr, nullptr, nullptr);
+        }
+
+        if ( hs_stream_db )
+            hs_free_database(hs_stream_db);
+
         if ( agent )
             user_dtor();
     }
@@ -136,8 +147,23 @@ public:
 
     int prep_patterns(SnortConfig*) override;
 
+    bool can_build_concurrently() override
+    { return true; }
+
+    int build() override;
+    int finish(SnortConfig*) override;
+
     int _search(const uint8_t*, int, MpseMatch, void*, int*) override;
 
+    void enable_stream() override
+    { stream = true; }
+
+    bool can_stream() override
+    { return hs_stream_db != nullptr; }
+
+    int _search_stream(
+        StreamState&, unsigned max, const uint8_t*, int, MpseMatch, void*) override;
+
     int get_pattern_count() override
     { return pvector.size(); }
 
@@ -147,18 +173,35 @@ public:
         unsigned id, unsigned long long from, unsigned long long to,
         unsigned flags, void*);
 
+    static int match_stream(
+        unsigned id, unsigned long long from, unsigned long long to,
+        unsigned flags, void*);
+
 private:
     void user_ctor(SnortConfig*);
     void user_dtor();
+    void build_stream(std::vector<const char*>&, std::vector<unsigned>&, std::vector<unsigned>&);
 
     const MpseAgent* agent;
     PatternVector pvector;
 
     hs_database_t* hs_db = nullptr;
+    hs_database_t* hs_stream_db = nullptr;
+    bool stream = false;
+
+    // one engine stream per packet thread, opened on first use and reset
+    // with each saved state so searches don't allocate
+    std::vector<hs_stream_t*> streams;
+
+    // build() may run off the main thread so compile errors are held
+    // here until finish() can report them
+    std::string build_error;
+    int build_status = 0;
 
     static THREAD_LOCAL MpseMatch match_cb;
     static THREAD_LOCAL void* match_ctx;
     static THREAD_LOCAL int nfound;
+    static THREAD_LOCAL uint64_t match_base;
 
 public:
     static uint64_t instances;
@@ -168,6 +211,7 @@ public:
 THREAD_LOCAL MpseMatch HyperscanMpse::match_cb = nullptr;
 THREAD_LOCAL void* HyperscanMpse::match_ctx = nullptr;
 THREAD_LOCAL int HyperscanMpse::nfound = 0;
+THREAD_LOCAL uint64_t HyperscanMpse::match_base = 0;
 
 uint64_t HyperscanMpse::instances = 0;
 uint64_t HyperscanMpse::patterns = 0;
@@ -209,14 +253,23 @@ void HyperscanMpse::user_dtor()
 }
 
 int HyperscanMpse::prep_patterns(SnortConfig* sc)
+{
+    if ( int rval = build() )
+        return rval;
+
+    return finish(sc);
+}
+
+int HyperscanMpse::build()
 {
     if ( pvector.empty() )
         return -1;
 
     if ( hs_valid_platform() != HS_SUCCESS )
     {
-        ParseError("This host does not support Hyperscan.");
-        return -1;
+        build_error = "This host does not support Hyperscan.";
+        build_status = -1;
+        return 0;
     }
 
     hs_compile_error_t* errptr = nullptr;
@@ -236,19 +289,82 @@ int HyperscanMpse::prep_patterns(SnortConfig* sc)
     if ( hs_compile_multi(&pats[0], &flags[0], &ids[0], pvector.size(), HS_MODE_BLOCK,
             nullptr, &hs_db, &errptr) or !hs_db )
     {
-        ParseError("can't compile hyperscan pattern database: %s (%d) - '%s'",
-            errptr->message, errptr->expression,
-            errptr->expression >= 0 ? pats[errptr->expression] : "");
-        hs_free_compile_error(errptr);
-        return -2;
+        build_error = "can't compile hyperscan pattern database: ";
+
+        if ( errptr )
+        {
+            build_error += errptr->message;
+            build_error += " (" + std::to_string(errptr->expression) + ") - '";
+
+            if ( errptr->expression >= 0 )
+                build_error += pats[errptr->expression];
+
+            build_error += "'";
+            hs_free_compile_error(errptr);
+        }
+        build_status = -2;
     }
+    else if ( stream )
+        build_stream(pats, flags, ids);
+
+    return 0;
+}
+
+// the stream database is in addition to the block database which is still
+// used for everything that isn't searched as a stream.  single match mode
+// would suppress a pattern for the rest of the stream after its first hit
+// so it is dropped here; each buffer must report its own matches.  streams
+// are optional so a failure here just leaves this instance in block mode.
+
+void HyperscanMpse::build_stream(
+    std::vector<const char*>& pats, std::vector<unsigned>& flags, std::vector<unsigned>& ids)
+{
+#ifdef HAVE_HS_COMPRESS_STREAM
+    for ( auto& f : flags )
+        f &= ~HS_FLAG_SINGLEMATCH;
+
+    hs_compile_error_t* errptr = nullptr;
 
+    if ( hs_compile_multi(&pats[0], &flags[0], &ids[0], pvector.size(), HS_MODE_STREAM,
+            nullptr, &hs_stream_db, &errptr) or !hs_stream_db )
+    {
+        if ( errptr )
+            hs_free_compile_error(errptr);
+
+        hs_stream_db = nullptr;
+    }
+#else
+    UNUSED(pats);
+    UNUSED(flags);
+    UNUSED(ids);
+#endif
+}
+
+int HyperscanMpse::finish(SnortConfig* sc)
+{
+    if ( build_status )
+    {
+        ParseError("%s", build_error.c_str());
+        return build_status;
+    }
+
+    // the scratch space is shared by all instances so it is grown here
+    // on the main thread rather than in build()
     if ( hs_error_t err = hs_alloc_scratch(hs_db, &s_scratch) )
     {
         ParseError("can't allocate search scratch space (%d)", err);
         return -3;
     }
 
+    if ( hs_stream_db and hs_alloc_scratch(hs_stream_db, &s_scratch) )
+    {
+        hs_free_database(hs_stream_db);
+        hs_stream_db = nullptr;
+    }
+
+    if ( hs_stream_db )
+        streams.resize(sc->num_slots, nullptr);
+
     if ( agent )
         user_ctor(sc);
 
@@ -271,6 +387,19 @@ int HyperscanMpse::match(
     return  h->match(id, to);
 }
 
+// stream offsets count from the start of the engine stream; the rule
+// options evaluate the current buffer so matches are rebased onto it.
+// a match is always reported while scanning the buffer it ends in.
+
+int HyperscanMpse::match_stream(
+    unsigned id, unsigned long long /*from*/, unsigned long long to,
+    unsigned /*flags*/, void* pv)
+{
+    HyperscanMpse* h = (HyperscanMpse*)pv;
+    assert(to >= match_base);
+    return  h->match(id, to - match_base);
+}
+
 int HyperscanMpse::_search(
     const uint8_t* buf, int n, MpseMatch mf, void* pv, int* current_state)
 {
@@ -291,6 +420,90 @@ int HyperscanMpse::_search(
     return nfound;
 }
 
+int HyperscanMpse::_search_stream(
+    StreamState& state, unsigned max, const uint8_t* buf, int n, MpseMatch mf, void* pv)
+{
+#ifdef HAVE_HS_COMPRESS_STREAM
+    if ( !hs_stream_db )
+        return -1;
+
+    hs_scratch_t *ss = (hs_scratch_t *) SnortConfig::get_conf()->state[get_instance_id()][scratch_index];
+    assert(ss);
+
+    hs_stream_t*& hs = streams[get_instance_id()];
+
+    if ( !hs and hs_open_stream(hs_stream_db, 0, &hs) != HS_SUCCESS )
+    {
+        hs = nullptr;
+        return -1;
+    }
+
+    // matches pending at the end of the prior use were reported then so
+    // no callback is given here
+    if ( state.data.empty() )
+    {
+        if ( hs_reset_stream(hs, 0, nullptr, nullptr, nullptr) != HS_SUCCESS )
+            return -1;
+
+        state.offset = 0;
+    }
+    else if ( hs_reset_and_expand_stream(hs, (const char*)state.data.data(),
+        state.data.size(), nullptr, nullptr, nullptr) != HS_SUCCESS )
+    {
+        state.data.clear();
+        return -1;
+    }
+
+    nfound = 0;
+    match_cb = mf;
+    match_ctx = pv;
+    match_base = state.offset;
+
+    hs_error_t err = hs_scan_stream(hs, (const char*)buf, n, 0, ss,
+        HyperscanMpse::match_stream, this);
+
+    state.offset += n;
+
+    // the saved state is reused in place when it fits; otherwise the
+    // compress call reports the size needed and is repeated once with a
+    // buffer that large if the limit allows
+    size_t used = 0;
+
+    if ( err == HS_SUCCESS )
+    {
+        size_t room = std::min(state.data.capacity(), (size_t)max);
+        state.data.resize(room);
+        err = hs_compress_stream(hs, (char*)state.data.data(), room, &used);
+
+        if ( err == HS_INSUFFICIENT_SPACE and used <= max )
+        {
+            state.data.resize(used);
+            err = hs_compress_stream(hs, (char*)state.data.data(), used, &used);
+        }
+    }
+
+    // a callback that stops the scan (HS_SCAN_TERMINATED) leaves a stream
+    // that can't be resumed; that and a state too big to save both end
+    // the stream for the caller
+    if ( err != HS_SUCCESS )
+    {
+        state.full = true;
+        used = 0;
+    }
+    state.data.resize(used);
+
+    return nfound;
+#else
+    UNUSED(state);
+    UNUSED(max);
+    UNUSED(buf);
+    UNUSED(n);
+    UNUSED(mf);
+    UNUSED(pv);
+    return -1;
+#endif
+}
+
 static void scratch_setup(SnortConfig* sc)
 {
     for ( unsigned i = 0; i < sc->num_slots; ++i )
@@ -35,6 +35,8 @@ struct PatMatQStat
     PegCount non_qualified_events;
     PegCount qualified_events;
     PegCount matched_bytes;
+    PegCount stream_searches;
+    PegCount stream_fallbacks;
 };
 
 namespace snort
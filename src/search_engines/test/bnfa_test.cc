@@ -0,0 +1,349 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2018-2018 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+
+// bnfa_test.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "search_engines/bnfa_search.h"
+#include "utils/util.h"
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+using namespace snort;
+
+//-------------------------------------------------------------------------
+// stubs
+//-------------------------------------------------------------------------
+
+namespace snort
+{
+void LogMessage(const char*, ...) { }
+void WarningMessage(const char*, ...) { }
+void LogCount(char const*, uint64_t, FILE*) { }
+void LogValue(const char*, const char*, FILE*) { }
+void LogStat(const char*, double, FILE*) { }
+const char* get_error(int) { return ""; }
+}
+
+//-------------------------------------------------------------------------
+// helpers
+//-------------------------------------------------------------------------
+
+struct Hit
+{
+    intptr_t id;
+    int index;
+
+    bool operator==(const Hit& h) const
+    { return id == h.id and index == h.index; }
+};
+
+struct Hits
+{
+    std::vector<Hit> hits;
+    unsigned stop_after = 0;
+};
+
+// ids divisible by 5 reject the match the way a failed case check does
+static int match(void* user, void*, int index, void* context, void*)
+{
+    Hits* h = (Hits*)context;
+    intptr_t id = (intptr_t)user;
+    h->hits.push_back({ id, index });
+
+    if ( h->stop_after and h->hits.size() >= h->stop_after )
+        return 1;
+
+    return (id % 5) ? 0 : -1;
+}
+
+static int count(void*, void*, int, void* context, void*)
+{
+    ++*(unsigned*)context;
+    return 0;
+}
+
+// patterns start with one of a few characters so state 0 is sparse for
+// binary data, as with protocol keywords
+static std::vector<std::vector<uint8_t>> get_patterns(std::mt19937& rng, unsigned num)
+{
+    static const char* lead = "GPH/<$%";
+    std::uniform_int_distribution<int> len(2, 14);
+    std::uniform_int_distribution<int> first(0, strlen(lead) - 1);
+    std::uniform_int_distribution<int> letter('a', 'z');
+    std::uniform_int_distribution<int> upper(0, 3);
+    std::vector<std::vector<uint8_t>> pats;
+
+    for ( unsigned i = 0; i < num; ++i )
+    {
+        std::vector<uint8_t> pat(len(rng));
+        pat[0] = lead[first(rng)];
+
+        for ( unsigned j = 1; j < pat.size(); ++j )
+            pat[j] = upper(rng) ? letter(rng) : toupper(letter(rng));
+
+        pats.emplace_back(pat);
+    }
+    return pats;
+}
+
+static bnfa_struct_t* get_bnfa(
+    const std::vector<std::vector<uint8_t>>& pats, int format, bool opt = true)
+{
+    bnfa_struct_t* bnfa = bnfaNew(nullptr);
+    bnfa->bnfaFormat = format;
+    bnfaSetOpt(bnfa, opt);
+
+    for ( unsigned i = 0; i < pats.size(); ++i )
+    {
+        bnfaAddPattern(bnfa, pats[i].data(), pats[i].size(), true, false,
+            (void*)(intptr_t)(i + 1));
+    }
+    CHECK(!bnfaCompile(nullptr, bnfa));
+    return bnfa;
+}
+
+// text is mostly letters with the patterns mixed in; binary is mostly
+// bytes that don't start a pattern
+static std::vector<uint8_t> get_buffer(
+    std::mt19937& rng, const std::vector<std::vector<uint8_t>>& pats, unsigned size, bool text)
+{
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> letter('a', 'z');
+    std::uniform_int_distribution<int> pick(0, pats.size() - 1);
+    std::uniform_int_distribution<int> roll(0, 63);
+    std::vector<uint8_t> buf;
+
+    while ( buf.size() < size )
+    {
+        if ( !roll(rng) )
+        {
+            const auto& p = pats[pick(rng)];
+            buf.insert(buf.end(), p.begin(), p.end());
+        }
+        else if ( text )
+            buf.push_back(letter(rng));
+        else
+            buf.push_back(byte(rng) & 0x3f);
+    }
+    buf.resize(size);
+    return buf;
+}
+
+static unsigned search(
+    bnfa_struct_t* bnfa, const uint8_t* buf, int len, MpseMatch mf, void* context)
+{
+    int state = 0;
+
+    if ( bnfa->bnfaFormat == BNFA_BITMAP )
+        return _bnfa_search_bitmap_nfa(bnfa, buf, len, mf, context, 0, &state);
+
+    return _bnfa_search_csparse_nfa(bnfa, buf, len, mf, context, 0, &state);
+}
+
+//-------------------------------------------------------------------------
+// accuracy
+//-------------------------------------------------------------------------
+
+TEST_GROUP(bnfa_bitmap)
+{
+    void setup() override
+    {
+        bnfa_init_xlatcase();
+        bnfaInitSummary();
+    }
+
+    void teardown() override
+    { bnfa_init_simd(); }
+
+    void compare(unsigned num_pats, bool opt, unsigned stop_after)
+    {
+        std::mt19937 rng(num_pats);
+        auto pats = get_patterns(rng, num_pats);
+
+        bnfa_struct_t* sparse = get_bnfa(pats, BNFA_SPARSE, opt);
+        bnfa_struct_t* bitmap = get_bnfa(pats, BNFA_BITMAP, opt);
+
+        for ( unsigned i = 0; i < 64; ++i )
+        {
+            auto buf = get_buffer(rng, pats, i * 23, i & 1);
+
+            for ( bool simd : { false, true } )
+            {
+                bnfa_init_simd(simd);
+
+                Hits expect, got;
+                expect.stop_after = got.stop_after = stop_after;
+
+                unsigned a = search(sparse, buf.data(), buf.size(), match, &expect);
+                unsigned b = search(bitmap, buf.data(), buf.size(), match, &got);
+
+                CHECK(a == b);
+                CHECK(expect.hits == got.hits);
+            }
+        }
+        bnfaFree(sparse);
+        bnfaFree(bitmap);
+    }
+};
+
+TEST(bnfa_bitmap, format)
+{
+    static const uint8_t* pats[] = { (const uint8_t*)"the", (const uint8_t*)"uba",
+        (const uint8_t*)"away", (const uint8_t*)"nothere" };
+
+    bnfa_struct_t* bnfa = bnfaNew(nullptr);
+    bnfa->bnfaFormat = BNFA_BITMAP;
+
+    for ( unsigned i = 0; i < 4; ++i )
+        bnfaAddPattern(bnfa, pats[i], strlen((const char*)pats[i]), true, false,
+            (void*)(intptr_t)(i + 1));
+
+    CHECK(!bnfaCompile(nullptr, bnfa));
+    CHECK(bnfa->bnfaBitmapNodes);
+    CHECK(((uintptr_t)bnfa->bnfaBitmapNodes & 63) == 0);
+    CHECK(!bnfa->bnfaFailState);
+
+    // upper case, uncased and unmatched
+    const uint8_t* s = (const uint8_t*)"THE tuba ran aWay";
+    Hits h;
+
+    CHECK(search(bnfa, s, strlen((const char*)s), match, &h) == 3);
+    CHECK(h.hits.size() == 3);
+    CHECK((h.hits[0] == Hit{ 1, 3 }));
+    CHECK((h.hits[1] == Hit{ 2, 8 }));
+    CHECK((h.hits[2] == Hit{ 3, 17 }));
+
+    bnfaFree(bnfa);
+}
+
+TEST(bnfa_bitmap, root_skip)
+{
+    std::mt19937 rng(1);
+    auto pats = get_patterns(rng, 100);
+    bnfa_struct_t* bnfa = get_bnfa(pats, BNFA_BITMAP);
+
+    // 7 leading characters, 3 of them letters that match either case
+    CHECK(bnfa->bnfaRootSkip);
+
+    unsigned set = 0;
+
+    for ( unsigned b = 0; b < 256; ++b )
+    {
+        bool in = bnfa->bnfaRootSet[b >> 7][b & 0x0f] & (1 << ((b >> 4) & 7));
+        CHECK(in == (bnfa->bnfaBitmapRoot[toupper(b)] != 0));
+        set += in;
+    }
+    CHECK(set == 10);
+
+    bnfaFree(bnfa);
+}
+
+TEST(bnfa_bitmap, small)
+{
+    compare(5, true, 0);
+}
+
+TEST(bnfa_bitmap, large)
+{
+    compare(2000, true, 0);
+}
+
+TEST(bnfa_bitmap, no_opt)
+{
+    compare(500, false, 0);
+}
+
+TEST(bnfa_bitmap, stop)
+{
+    compare(500, true, 4);
+}
+
+//-------------------------------------------------------------------------
+// benchmark - run with -ri
+//-------------------------------------------------------------------------
+
+static double get_rate(bnfa_struct_t* bnfa, const std::vector<std::vector<uint8_t>>& bufs)
+{
+    unsigned hits = 0;
+    size_t bytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned rep = 0; rep < 10; ++rep )
+    {
+        for ( const auto& b : bufs )
+        {
+            search(bnfa, b.data(), b.size(), count, &hits);
+            bytes += b.size();
+        }
+    }
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return bytes / secs.count() / 1.0e6;
+}
+
+IGNORE_TEST(bnfa_bitmap, benchmark)
+{
+    for ( unsigned num_pats : { 1000, 10000, 50000 } )
+    {
+        std::mt19937 rng(num_pats);
+        auto pats = get_patterns(rng, num_pats);
+
+        bnfa_struct_t* sparse = get_bnfa(pats, BNFA_SPARSE);
+        bnfa_struct_t* bitmap = get_bnfa(pats, BNFA_BITMAP);
+
+        for ( bool text : { true, false } )
+        {
+            std::vector<std::vector<uint8_t>> bufs;
+            std::uniform_int_distribution<int> size(64, 1460);
+
+            for ( unsigned i = 0; i < 2000; ++i )
+                bufs.emplace_back(get_buffer(rng, pats, size(rng), text));
+
+            double rs = get_rate(sparse, bufs);
+            bnfa_init_simd(false);
+            double rb = get_rate(bitmap, bufs);
+            bnfa_init_simd(true);
+            double rv = get_rate(bitmap, bufs);
+
+            printf("%5u patterns %s: sparse %.0f MB/s (%d KB), bitmap %.0f MB/s, "
+                "bitmap simd %.0f MB/s (%d KB)\n", num_pats, text ? "text  " : "binary",
+                rs, sparse->nextstate_memory / 1024, rb, rv, bitmap->nextstate_memory / 1024);
+        }
+        bnfaFree(sparse);
+        bnfaFree(bitmap);
+    }
+}
+
+//-------------------------------------------------------------------------
+// main
+//-------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
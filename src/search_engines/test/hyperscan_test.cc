@@ -55,6 +55,12 @@ int Mpse::search_all(
     return _search(T, n, match, context, current_state);
 }
 
+int Mpse::search_stream(
+    StreamState& ss, unsigned max, const uint8_t* T, int n, MpseMatch match, void* context)
+{
+    return _search_stream(ss, max, T, n, match, context);
+}
+
 SnortConfig s_conf;
 THREAD_LOCAL SnortConfig* snort_conf = &s_conf;
 
@@ -101,10 +107,11 @@ unsigned get_instance_id()
 extern const BaseApi* se_hyperscan;
 
 static unsigned hits = 0;
+static int last_index = 0;
 
 static int match(
-    void* /*user*/, void* /*tree*/, int /*index*/, void* /*context*/, void* /*list*/)
-{ ++hits; return 0; }
+    void* /*user*/, void* /*tree*/, int index, void* /*context*/, void* /*list*/)
+{ ++hits; last_index = index; return 0; }
 
 static void* s_user = (void*)"user";
 static void* s_tree = (void*)"tree";
@@ -271,6 +278,98 @@ TEST(mpse_hs_match, multi)
     CHECK(hits == 3);
 }
 
+TEST(mpse_hs_match, no_stream)
+{
+    Mpse::PatternDescriptor desc;
+
+    CHECK(hs->add_pattern(nullptr, (uint8_t*)"foo", 3, desc, s_user) == 0);
+    CHECK(hs->prep_patterns(snort_conf) == 0);
+    CHECK(!hs->can_stream());
+
+    scratch_setup(snort_conf);
+
+    Mpse::StreamState ss;
+    CHECK(hs->search_stream(ss, 2048, (uint8_t*)"foo", 3, match, nullptr) == -1);
+    CHECK(hits == 0);
+}
+
+#ifdef HAVE_HS_COMPRESS_STREAM
+TEST(mpse_hs_match, stream)
+{
+    Mpse::PatternDescriptor desc;
+
+    hs->enable_stream();
+    CHECK(hs->add_pattern(nullptr, (uint8_t*)"foobar", 6, desc, s_user) == 0);
+    CHECK(hs->prep_patterns(snort_conf) == 0);
+    CHECK(hs->can_stream());
+
+    scratch_setup(snort_conf);
+
+    Mpse::StreamState ss;
+    CHECK(hs->search_stream(ss, 2048, (uint8_t*)"xxfoo", 5, match, nullptr) == 0);
+    CHECK(!ss.data.empty());
+    CHECK(ss.offset == 5);
+
+    // the first match spans the buffers; both are relative to the second
+    CHECK(hs->search_stream(ss, 2048, (uint8_t*)"barfoobar", 9, match, nullptr) == 2);
+    CHECK(hits == 2);
+    CHECK(last_index == 9);
+    CHECK(ss.offset == 14);
+    CHECK(!ss.full);
+
+    // block searches are unaffected
+    int state = 0;
+    CHECK(hs->search((uint8_t*)"foobar", 6, match, nullptr, &state) == 1);
+    CHECK(hits == 3);
+}
+
+TEST(mpse_hs_match, stream_full)
+{
+    Mpse::PatternDescriptor desc;
+
+    hs->enable_stream();
+    CHECK(hs->add_pattern(nullptr, (uint8_t*)"foobar", 6, desc, s_user) == 0);
+    CHECK(hs->prep_patterns(snort_conf) == 0);
+
+    scratch_setup(snort_conf);
+
+    // the buffer is still searched but its state can't be saved
+    Mpse::StreamState ss;
+    CHECK(hs->search_stream(ss, 1, (uint8_t*)"foobarfoo", 9, match, nullptr) == 1);
+    CHECK(ss.full);
+    CHECK(ss.data.empty());
+    CHECK(hits == 1);
+}
+
+static int stop(
+    void*, void*, int, void*, void*)
+{ ++hits; return 1; }
+
+TEST(mpse_hs_match, stream_stop)
+{
+    Mpse::PatternDescriptor desc;
+
+    hs->enable_stream();
+    CHECK(hs->add_pattern(nullptr, (uint8_t*)"foo", 3, desc, s_user) == 0);
+    CHECK(hs->prep_patterns(snort_conf) == 0);
+
+    scratch_setup(snort_conf);
+
+    // a stopped search can't be resumed so it is handled like a full state
+    Mpse::StreamState ss;
+    CHECK(hs->search_stream(ss, 2048, (uint8_t*)"foofoo", 6, stop, nullptr) == 1);
+    CHECK(ss.full);
+    CHECK(ss.data.empty());
+    CHECK(hits == 1);
+
+    // the thread's engine stream is reset for the next use
+    Mpse::StreamState next;
+    CHECK(hs->search_stream(next, 2048, (uint8_t*)"xxfoo", 5, match, nullptr) == 1);
+    CHECK(!next.full);
+    CHECK(hits == 2);
+}
+#endif
+
 #if 0
 TEST(mpse_hs_match, regex)
 {
@@ -72,6 +72,8 @@ SO_PUBLIC void LogMessage(const char*, ...) { }
 [[noreturn]] void FatalError(const char*,...) { exit(1); }
 void LogCount(char const*, uint64_t, FILE*) { }
 void LogStat(const char*, double, FILE*) { }
+void WarningMessage(const char*, ...) { }
+const char* get_error(int) { return ""; }
 
 static void* s_tree = (void*)"tree";
 static void* s_list = (void*)"list";
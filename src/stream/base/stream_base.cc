@@ -54,7 +54,10 @@ THREAD_LOCAL BaseStats stream_base_stats;
     { CountType::SUM, proto_str "_uni_prunes", proto_str " uni sessions pruned" }, \
     { CountType::SUM, proto_str "_preemptive_prunes", proto_str " sessions pruned during preemptive pruning" }, \
     { CountType::SUM, proto_str "_memcap_prunes", proto_str " sessions pruned due to memcap" }, \
-    { CountType::SUM, proto_str "_ha_prunes", proto_str " sessions pruned by high availability sync" }
+    { CountType::SUM, proto_str "_ha_prunes", proto_str " sessions pruned by high availability sync" }, \
+    { CountType::SUM, proto_str "_timeout_ticks", "times the " proto_str " timeout wheel was checked" }, \
+    { CountType::SUM, proto_str "_timeout_checks", proto_str " sessions checked for timeout" }, \
+    { CountType::SUM, proto_str "_timeout_lag", "total seconds " proto_str " sessions were retired past their timeout" }
 
 #define SET_PROTO_COUNTS(proto, pkttype) \
     stream_base_stats.proto ## _flows = flow_con->get_flows(PktType::pkttype); \
@@ -70,7 +73,10 @@ THREAD_LOCAL BaseStats stream_base_stats;
     stream_base_stats.proto ## _memcap_prunes = \
         flow_con->get_prunes(PktType::pkttype, PruneReason::MEMCAP), \
     stream_base_stats.proto ## _ha_prunes = \
-        flow_con->get_prunes(PktType::pkttype, PruneReason::HA)
+        flow_con->get_prunes(PktType::pkttype, PruneReason::HA), \
+    stream_base_stats.proto ## _timeout_ticks = flow_con->get_timeout_ticks(PktType::pkttype), \
+    stream_base_stats.proto ## _timeout_checks = flow_con->get_timeout_checks(PktType::pkttype), \
+    stream_base_stats.proto ## _timeout_lag = flow_con->get_timeout_lag(PktType::pkttype)
 
 // FIXIT-L dependency on stats define in another file
 const PegInfo base_pegs[] =
@@ -35,7 +35,7 @@ using namespace std;
 //-------------------------------------------------------------------------
 Trace TRACE_NAME(stream);
 
-#define CACHE_PARAMS(name, max, prune, idle, cleanup) \
+#define CACHE_PARAMS(name, max, prune, idle, half_open, closed, cleanup) \
 static const Parameter name[] = \
 { \
     { "max_sessions", Parameter::PT_INT, "2:", max, \
@@ -46,16 +46,22 @@ static const Parameter name[] = \
  \
     { "idle_timeout", Parameter::PT_INT, "1:", idle, \
       "maximum inactive time before retiring session tracker" }, \
+ \
+    { "half_open_timeout", Parameter::PT_INT, "0:", half_open, \
+      "maximum inactive time before retiring a one way session; 0 uses idle_timeout" }, \
+ \
+    { "closed_timeout", Parameter::PT_INT, "0:", closed, \
+      "maximum inactive time before retiring a closed or reset session; 0 uses idle_timeout" }, \
  \
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr } \
 }
 
-CACHE_PARAMS(ip_params,    "16384",  "30",  "180", "5");
-CACHE_PARAMS(icmp_params,  "65536",  "30",  "180", "5");
-CACHE_PARAMS(tcp_params,  "262144",  "30", "3600", "5");
-CACHE_PARAMS(udp_params,  "131072",  "30",  "180", "5");
-CACHE_PARAMS(user_params,   "1024",  "30",  "180", "5");
-CACHE_PARAMS(file_params,    "128",  "30",  "180", "5");
+CACHE_PARAMS(ip_params,    "16384",  "30",  "180",  "0",  "0", "5");
+CACHE_PARAMS(icmp_params,  "65536",  "30",  "180",  "0",  "0", "5");
+CACHE_PARAMS(tcp_params,  "262144",  "30", "3600",  "0",  "0", "5");
+CACHE_PARAMS(udp_params,  "131072",  "30",  "180",  "0",  "0", "5");
+CACHE_PARAMS(user_params,   "1024",  "30",  "180",  "0",  "0", "5");
+CACHE_PARAMS(file_params,    "128",  "30",  "180",  "0",  "0", "5");
 
 #define CACHE_TABLE(cache, proto, params) \
     { cache, Parameter::PT_TABLE, params, nullptr, \
@@ -165,6 +171,12 @@ bool StreamModule::set(const char* fqn, Value& v, SnortConfig* c)
     else if ( v.is("idle_timeout") )
         fc->nominal_timeout = v.get_long();
 
+    else if ( v.is("half_open_timeout") )
+        fc->half_open_timeout = v.get_long();
+
+    else if ( v.is("closed_timeout") )
+        fc->closed_timeout = v.get_long();
+
     else
         return false;
 
@@ -47,7 +47,10 @@ extern Trace TRACE_NAME(stream);
     PegCount proto ## _uni_prunes; \
     PegCount proto ## _preemptive_prunes; \
     PegCount proto ## _memcap_prunes; \
-    PegCount proto ## _ha_prunes
+    PegCount proto ## _ha_prunes; \
+    PegCount proto ## _timeout_ticks; \
+    PegCount proto ## _timeout_checks; \
+    PegCount proto ## _timeout_lag
 
 struct BaseStats
 {
@@ -119,12 +119,12 @@ using namespace snort;
 
 struct Fragment
 {
-    Fragment(uint16_t flen, const uint8_t* fptr, int ord)
-    { init(flen, fptr, ord); }
+    Fragment(uint16_t flen, const uint8_t* fptr, int ord, bool pooled)
+    { init(flen, fptr, ord, pooled); }
 
-    Fragment(Fragment* other, int ord)
+    Fragment(Fragment* other, int ord, bool pooled)
     {
-        init(other->flen, other->fptr, ord);
+        init(other->flen, other->fptr, ord, pooled);
         data = fptr + (other->data - other->fptr);
         size = other->size;
         offset = other->offset;
@@ -133,7 +133,6 @@ struct Fragment
 
     ~Fragment()
     {
-        delete[] fptr;
         ip_stats.nodes_released++;
     }
 
@@ -141,7 +140,7 @@ struct Fragment
     uint16_t size = 0;          /* adjusted frag size */
     uint16_t offset = 0;        /* adjusted offset position */
 
-    uint8_t* fptr = nullptr;    /* free pointer */
+    uint8_t* fptr = nullptr;    /* copy of the frag, stored right after this */
     uint16_t flen = 0;          /* free len, unneeded? */
 
     Fragment* prev = nullptr;
@@ -149,15 +148,17 @@ struct Fragment
 
     int ord = 0;
     char last = 0;
+    bool pooled = false;        /* carved from the thread's FragArena */
 
 private:
-    inline void init(uint16_t flen, const uint8_t* fptr, int ord)
+    inline void init(uint16_t flen, const uint8_t* fptr, int ord, bool pooled)
     {
         assert(flen > 0);
 
         this->flen = flen;
-        this->fptr = new uint8_t[flen];
+        this->fptr = reinterpret_cast<uint8_t*>(this + 1);
         this->ord = ord;
+        this->pooled = pooled;
 
         memcpy(this->fptr, fptr, flen);
 
@@ -165,6 +166,109 @@ private:
     }
 };
 
+//-------------------------------------------------------------------------
+// fragment arena
+//
+// each packet thread carves Fragments and their data out of a single slab
+// of fixed size slots instead of making two heap allocations per fragment.
+// the slab is sized from max_frags but handed out bump pointer first, so
+// slots that are never used are never touched.  released slots go on a
+// free list.  frags too big for a slot, or arriving when all slots are
+// taken, fall back to the heap.
+//-------------------------------------------------------------------------
+
+#define FRAG_SLOT_SIZE 2048
+
+class FragArena
+{
+public:
+    FragArena(unsigned slots)
+    {
+        max = slots;
+        slab = (uint8_t*)snort_alloc(max, FRAG_SLOT_SIZE);
+    }
+
+    ~FragArena()
+    { snort_free(slab); }
+
+    void* get()
+    {
+        if ( free_list )
+        {
+            Slot* s = free_list;
+            free_list = s->next;
+            return s;
+        }
+        if ( used < max )
+            return slab + FRAG_SLOT_SIZE * used++;
+
+        return nullptr;
+    }
+
+    void put(void* p)
+    {
+        assert(p >= slab and p < slab + FRAG_SLOT_SIZE * max);
+        Slot* s = (Slot*)p;
+        s->next = free_list;
+        free_list = s;
+    }
+
+    static bool fits(uint16_t flen)
+    { return sizeof(Fragment) + flen <= FRAG_SLOT_SIZE; }
+
+private:
+    struct Slot
+    { Slot* next; };
+
+    uint8_t* slab;
+    Slot* free_list = nullptr;
+    unsigned used = 0;
+    unsigned max;
+};
+
+static THREAD_LOCAL FragArena* frag_arena = nullptr;
+
+static void* alloc_fragment(uint16_t flen, bool& pooled)
+{
+    if ( frag_arena and FragArena::fits(flen) )
+    {
+        if ( void* p = frag_arena->get() )
+        {
+            pooled = true;
+            return p;
+        }
+    }
+    pooled = false;
+    return snort_alloc(sizeof(Fragment) + flen);
+}
+
+static Fragment* new_fragment(uint16_t flen, const uint8_t* fptr, int ord)
+{
+    bool pooled;
+    void* p = alloc_fragment(flen, pooled);
+    return new(p) Fragment(flen, fptr, ord, pooled);
+}
+
+static Fragment* new_fragment(Fragment* other, int ord)
+{
+    bool pooled;
+    void* p = alloc_fragment(other->flen, pooled);
+    return new(p) Fragment(other, ord, pooled);
+}
+
+static void delete_fragment(Fragment* f)
+{
+    bool pooled = f->pooled;
+    f->~Fragment();
+
+    if ( !pooled )
+        snort_free(f);
+
+    // with dirty_pig the arena can be gone before the flows; the slot went with it
+    else if ( frag_arena )
+        frag_arena->put(f);
+}
+
 /*  G L O B A L S  **************************************************/
 
 /* enum for policy names */
@@ -816,7 +920,7 @@ static inline void delete_node(FragTracker* ft, Fragment* node)
         ft->fraglist_tail = node->prev;
     }
 
-    delete node;
+    delete_fragment(node);
     ft->fraglist_count--;
 }
 
@@ -838,7 +942,7 @@ static void delete_tracker(FragTracker* ft)
     {
         dump_me = idx;
         idx = idx->next;
-        delete dump_me;
+        delete_fragment(dump_me);
     }
     ft->fraglist = nullptr;
     if (ft->ip_options_data)
@@ -876,6 +980,18 @@ void Defrag::show(SnortConfig*)
     FragPrintEngineConfig(&engine);
 }
 
+void Defrag::tinit()
+{
+    if ( !frag_arena )
+        frag_arena = new FragArena(engine.max_frags);
+}
+
+void Defrag::tterm()
+{
+    delete frag_arena;
+    frag_arena = nullptr;
+}
+
 void Defrag::cleanup(FragTracker* ft)
 {
     if ( !ft->engine )
@@ -1238,24 +1354,41 @@ int Defrag::insert(Packet* p, FragTracker* ft, FragEngine* fe)
 
     /*
      * Need to figure out where in the frag list this frag should go
-     * and who its neighbors are
+     * and who its neighbors are.  The list is kept sorted by offset so
+     * check the ends first; in order and reverse order floods then
+     * insert in constant time instead of walking the whole list.
      */
-    for (idx = ft->fraglist; idx; idx = idx->next)
+    if ( !ft->fraglist )
+        idx = nullptr;
+
+    else if ( ft->fraglist_tail->offset < frag_offset )
+    {
+        left = ft->fraglist_tail;
+        idx = nullptr;
+    }
+    else if ( ft->fraglist->offset >= frag_offset )
     {
-        i++;
-        right = idx;
+        right = idx = ft->fraglist;
+    }
+    else
+    {
+        for (idx = ft->fraglist; idx; idx = idx->next)
+        {
+            i++;
+            right = idx;
 
-        trace_logf(stream_ip,
-            "%d right o %d s %d ptr %p prv %p nxt %p\n",
-            i, right->offset, right->size, (void*) right,
-            (void*) right->prev, (void*) right->next);
+            trace_logf(stream_ip,
+                "%d right o %d s %d ptr %p prv %p nxt %p\n",
+                i, right->offset, right->size, (void*) right,
+                (void*) right->prev, (void*) right->next);
 
-        if (right->offset >= frag_offset)
-        {
-            break;
-        }
+            if (right->offset >= frag_offset)
+            {
+                break;
+            }
 
-        left = right;
+            left = right;
+        }
     }
 
     /*
@@ -1860,7 +1993,7 @@ int Defrag::new_tracker(Packet* p, FragTracker* ft)
     /* initialize the fragment list */
     ft->fraglist = nullptr;
 
-    f = new Fragment(fragLength, fragStart, ft->ordinal++);
+    f = new_fragment(fragLength, fragStart, ft->ordinal++);
 
     f->size = fragLength;
     f->offset = frag_off;
@@ -1979,7 +2112,7 @@ int Defrag::add_frag_node(
         return FRAG_INSERT_ANOMALY;
     }
 
-    newfrag = new Fragment(fragLength, fragStart, ft->ordinal++);
+    newfrag = new_fragment(fragLength, fragStart, ft->ordinal++);
 
     /*
      * twiddle the frag values for overlaps
@@ -2032,7 +2165,7 @@ int Defrag::add_frag_node(
  */
 int Defrag::dup_frag_node( FragTracker* ft, Fragment* left, Fragment** retFrag)
 {
-    Fragment* newfrag = new Fragment(left, ft->ordinal++);
+    Fragment* newfrag = new_fragment(left, ft->ordinal++);
 
     add_node(ft, left, newfrag);
 
@@ -2092,3 +2225,118 @@ inline int Defrag::expired(Packet* p, FragTracker* ft, FragEngine* fe)
     return false;
 }
 
+
+#ifdef UNIT_TEST
+
+#include "catch/snort_catch.h"
+#include "detection/ips_context.h"
+#include "flow/flow.h"
+
+// every flood fragment carries MF and offset 0 is never sent so the
+// datagram never completes and all fragments pile up in one tracker
+#define FLOOD_FRAG_SIZE 8
+#define FLOOD_FRAGS 8000
+
+static void frag_flood(Defrag& defrag, unsigned count, bool reverse)
+{
+    IpsContext ctx(1);
+    Packet* p = ctx.packet;
+    Flow flow;
+
+    FragTracker ft;
+    memset(&ft, 0, sizeof(ft));
+
+    ip::IP4Hdr iph;
+    memset(&iph, 0, sizeof(iph));
+    iph.ip_verhl = 0x45;
+    iph.ip_ttl = 64;
+    iph.ip_proto = IpProtocol::UDP;
+
+    uint8_t payload[FLOOD_FRAG_SIZE] = { };
+
+    memset(ctx.pkth, 0, sizeof(*ctx.pkth));
+    p->pkth = ctx.pkth;
+    p->ptrs.ip_api.set(&iph);
+    p->ptrs.decode_flags = DECODE_FRAG | DECODE_MF;
+    p->data = payload;
+    p->dsize = sizeof(payload);
+    p->flow = &flow;
+
+    for ( unsigned i = 0; i < count; i++ )
+    {
+        unsigned n = reverse ? count - i : i + 1;
+        iph.ip_off = htons(0x2000 | (n * FLOOD_FRAG_SIZE >> 3));
+        defrag.process(p, &ft);
+    }
+
+    CHECK(ft.fraglist_count == (int)count);
+    CHECK(ft.frag_bytes == count * FLOOD_FRAG_SIZE);
+
+    defrag.cleanup(&ft);
+    p->flow = nullptr;
+}
+
+TEST_CASE("defrag flood", "[stream_ip]")
+{
+    FragEngine engine;
+    engine.frag_policy = FRAG_POLICY_DEFAULT;
+    engine.max_frags = FLOOD_FRAGS / 2;
+    engine.min_ttl = 1;
+
+    Defrag defrag(engine);
+    defrag.tinit();
+
+    PegCount created = ip_stats.nodes_created;
+    PegCount released = ip_stats.nodes_released;
+
+    SECTION("in order")
+    {
+        frag_flood(defrag, FLOOD_FRAGS, false);
+    }
+    SECTION("reverse order")
+    {
+        frag_flood(defrag, FLOOD_FRAGS, true);
+    }
+    SECTION("arena reuse")
+    {
+        // half of these overflow the arena onto the heap
+        frag_flood(defrag, FLOOD_FRAGS, false);
+        frag_flood(defrag, FLOOD_FRAGS, true);
+        created -= FLOOD_FRAGS;
+        released -= FLOOD_FRAGS;
+    }
+    CHECK(ip_stats.nodes_created - created == FLOOD_FRAGS);
+    CHECK(ip_stats.nodes_released - released == FLOOD_FRAGS);
+
+    Defrag::tterm();
+}
+
+TEST_CASE("defrag flood benchmark", "[.][stream_ip][benchmark]")
+{
+    FragEngine engine;
+    engine.frag_policy = FRAG_POLICY_DEFAULT;
+    engine.max_frags = FLOOD_FRAGS;
+    engine.min_ttl = 1;
+
+    Defrag defrag(engine);
+
+    BENCHMARK("heap in order")
+    {
+        frag_flood(defrag, FLOOD_FRAGS, false);
+    }
+
+    defrag.tinit();
+
+    BENCHMARK("arena in order")
+    {
+        frag_flood(defrag, FLOOD_FRAGS, false);
+    }
+    BENCHMARK("arena reverse order")
+    {
+        frag_flood(defrag, FLOOD_FRAGS, true);
+    }
+
+    Defrag::tterm();
+}
+
+#endif
@@ -78,6 +78,8 @@ public:
     bool configure(SnortConfig*) override;
     void show(SnortConfig*) override;
 
+    void tinit() override;
+
     NORETURN_ASSERT void eval(Packet*) override;
 
 public:
@@ -109,6 +111,11 @@ void StreamIp::show(SnortConfig* sc)
     defrag->show(sc);
 }
 
+void StreamIp::tinit()
+{
+    defrag->tinit();
+}
+
 NORETURN_ASSERT void StreamIp::eval(Packet*)
 {
     // session::process() instead
@@ -145,6 +152,7 @@ static void ip_tinit()
 static void ip_tterm()
 {
     IpHAManager::tterm();
+    Defrag::tterm();
 }
 
 static Inspector* ip_ctor(Module* m)
@@ -62,6 +62,8 @@ const PegInfo tcp_pegs[] =
     { CountType::SUM, "segs_released", "total segments released" },
     { CountType::SUM, "segs_split", "tcp segments split when reassembling PDUs" },
     { CountType::SUM, "segs_used", "queued tcp segments applied to reassembled PDUs" },
+    { CountType::SUM, "seglist_indexes",
+        "segment lists long enough to be indexed for out of order inserts" },
     { CountType::SUM, "rebuilt_packets", "total reassembled PDUs" },
     { CountType::SUM, "rebuilt_buffers", "rebuilt PDU sections" },
     { CountType::SUM, "rebuilt_bytes", "total rebuilt bytes" },
@@ -80,6 +80,7 @@ struct TcpStats
     PegCount segs_released;
     PegCount segs_split;
     PegCount segs_used;
+    PegCount seglist_indexes;
     PegCount rebuilt_packets;   //iStreamFlushes
     PegCount rebuilt_buffers;
     PegCount rebuilt_bytes;     //total_rebuilt_bytes
@@ -121,15 +121,7 @@ int TcpReassembler::delete_reassembly_segment(TcpReassemblerState& trs, TcpSegme
     int ret;
     assert(tsn);
 
-    if (tsn->prev)
-        tsn->prev->next = tsn->next;
-    else
-        trs.sos.seglist.head = tsn->next;
-
-    if (tsn->next)
-        tsn->next->prev = tsn->prev;
-    else
-        trs.sos.seglist.tail = tsn->prev;
+    trs.sos.seglist.remove(tsn);
 
     trs.sos.seg_bytes_logical -= tsn->payload_size;
     trs.sos.seg_bytes_total -= tsn->orig_dsize;
@@ -1186,6 +1178,14 @@ void TcpReassembler::init_overlap_editor(
     int32_t dist_head;
     int32_t dist_tail;
 
+    if ( trs.sos.seglist.is_indexed() )
+    {
+        left = trs.sos.seglist.find_left(tsd.get_seg_seq());
+        right = left ? left->next : trs.sos.seglist.head;
+        trs.sos.init_soe(tsd, left, right);
+        return;
+    }
+
     if ( trs.sos.seglist.head && trs.sos.seglist.tail )
     {
         if ( SEQ_GT(tsd.get_seg_seq(), trs.sos.seglist.head->seq) )
@@ -35,7 +35,7 @@
 TcpSegmentNode::TcpSegmentNode() :
     prev(nullptr), next(nullptr), data(nullptr),
     tv({ 0, 0 }), ts(0), seq(0), offset(0), orig_dsize(0),
-    payload_size(0), urg_offset(0), buffered(false)
+    payload_size(0), urg_offset(0), buffered(false), level(0), skip(nullptr)
 {
 }
 
@@ -97,3 +97,359 @@ bool TcpSegmentNode::is_retransmit(const uint8_t* rdata, uint16_t rsize, uint32_
 
     return false;
 }
+
+//-------------------------------------------------------------------------
+// TcpSegmentList index
+//-------------------------------------------------------------------------
+
+#define SEG_INDEX_LEVELS 10
+
+struct TcpSegmentIndex
+{
+    TcpSegmentNode* heads[SEG_INDEX_LEVELS] = { };
+    unsigned top = 0;
+};
+
+unsigned TcpSegmentList::index_min = 64;
+
+// each level holds about 1/4 of the nodes of the level below; the level
+// comes from the node address so it needs no state and can't be steered
+// by the traffic
+static unsigned get_level(const TcpSegmentNode* tsn)
+{
+    uint32_t r = ((uint64_t)(uintptr_t)tsn * 0x9E3779B97F4A7C15ull) >> 32;
+    unsigned level = 0;
+
+    while ( level < SEG_INDEX_LEVELS and !(r & 3) )
+    {
+        level++;
+        r >>= 2;
+    }
+    return level;
+}
+
+// a segment with the same seq as a neighbor stays on the list only so
+// that every indexed node has a unique place in each level
+static unsigned get_level(const TcpSegmentNode* tsn, const TcpSegmentNode* prev)
+{
+    const TcpSegmentNode* next = tsn->next;
+
+    if ( (prev and prev->seq == tsn->seq) or (next and next->seq == tsn->seq) )
+        return 0;
+
+    return get_level(tsn);
+}
+
+// returns the last node before seq; if pred is given it is set to the last
+// node before seq in each level, nullptr meaning the level head
+TcpSegmentNode* TcpSegmentList::index_find(uint32_t seq, TcpSegmentNode** pred)
+{
+    assert(index);
+    TcpSegmentNode* left = nullptr;
+
+    for ( int l = index->top - 1; l >= 0; l-- )
+    {
+        TcpSegmentNode* tsn = left ? left->skip[l] : index->heads[l];
+
+        while ( tsn and SEQ_LT(tsn->seq, seq) )
+        {
+            left = tsn;
+            tsn = tsn->skip[l];
+        }
+        if ( pred )
+            pred[l] = left;
+    }
+
+    TcpSegmentNode* tsn = left ? left->next : head;
+
+    while ( tsn and SEQ_LT(tsn->seq, seq) )
+    {
+        left = tsn;
+        tsn = tsn->next;
+    }
+    return left;
+}
+
+void TcpSegmentList::index_insert(TcpSegmentNode* ss)
+{
+    unsigned level = get_level(ss, ss->prev);
+
+    if ( !level )
+        return;
+
+    TcpSegmentNode* pred[SEG_INDEX_LEVELS];
+    index_find(ss->seq, pred);
+
+    for ( unsigned l = index->top; l < level; l++ )
+        pred[l] = nullptr;
+
+    if ( index->top < level )
+        index->top = level;
+
+    ss->skip = (TcpSegmentNode**)snort_alloc(level * sizeof(*ss->skip));
+    ss->level = level;
+
+    for ( unsigned l = 0; l < level; l++ )
+    {
+        TcpSegmentNode*& link = pred[l] ? pred[l]->skip[l] : index->heads[l];
+        ss->skip[l] = link;
+        link = ss;
+    }
+}
+
+void TcpSegmentList::index_remove(TcpSegmentNode* ss)
+{
+    if ( !ss->level )
+        return;
+
+    TcpSegmentNode* pred[SEG_INDEX_LEVELS];
+    index_find(ss->seq, pred);
+
+    for ( unsigned l = 0; l < ss->level; l++ )
+    {
+        TcpSegmentNode** link = pred[l] ? &pred[l]->skip[l] : &index->heads[l];
+
+        // step over segments trimmed to the same seq
+        while ( *link and *link != ss )
+            link = &(*link)->skip[l];
+
+        if ( !*link )
+        {
+            link = &index->heads[l];
+
+            while ( *link != ss )
+                link = &(*link)->skip[l];
+        }
+        *link = ss->skip[l];
+    }
+
+    snort_free(ss->skip);
+    ss->skip = nullptr;
+    ss->level = 0;
+
+    while ( index->top and !index->heads[index->top - 1] )
+        index->top--;
+}
+
+void TcpSegmentList::build_index()
+{
+    index = new TcpSegmentIndex;
+    TcpSegmentNode* last[SEG_INDEX_LEVELS] = { };
+
+    for ( TcpSegmentNode* tsn = head; tsn; tsn = tsn->next )
+    {
+        unsigned level = get_level(tsn, tsn->prev);
+
+        if ( !level )
+            continue;
+
+        tsn->skip = (TcpSegmentNode**)snort_alloc(level * sizeof(*tsn->skip));
+        tsn->level = level;
+
+        for ( unsigned l = 0; l < level; l++ )
+        {
+            tsn->skip[l] = nullptr;
+
+            if ( last[l] )
+                last[l]->skip[l] = tsn;
+            else
+                index->heads[l] = tsn;
+
+            last[l] = tsn;
+        }
+        if ( index->top < level )
+            index->top = level;
+    }
+    tcpStats.seglist_indexes++;
+}
+
+void TcpSegmentList::drop_index()
+{
+    for ( TcpSegmentNode* tsn = head; tsn; tsn = tsn->next )
+    {
+        if ( tsn->skip )
+        {
+            snort_free(tsn->skip);
+            tsn->skip = nullptr;
+            tsn->level = 0;
+        }
+    }
+    delete index;
+    index = nullptr;
+}
+
+#ifdef UNIT_TEST
+
+#include <algorithm>
+#include <climits>
+#include <random>
+#include <vector>
+
+#include "catch/snort_catch.h"
+
+#define REORDER_SEG_SIZE 100
+#define REORDER_SEGS 4000
+
+static TcpSegmentNode* new_segment(uint32_t seq)
+{
+    static const uint8_t data[REORDER_SEG_SIZE] = { };
+    struct timeval tv = { 0, 0 };
+    TcpSegmentNode* tsn = TcpSegmentNode::init(tv, data, sizeof(data));
+    tsn->seq = seq;
+    return tsn;
+}
+
+// same search the reassembler does before it has an index
+static void insert_segment(TcpSegmentList& seglist, TcpSegmentNode* tsn)
+{
+    TcpSegmentNode* left;
+
+    if ( seglist.is_indexed() )
+        left = seglist.find_left(tsn->seq);
+    else
+    {
+        left = seglist.tail;
+
+        while ( left and SEQ_GEQ(left->seq, tsn->seq) )
+            left = left->prev;
+    }
+    seglist.insert(left, tsn);
+}
+
+static bool is_ordered(const TcpSegmentList& seglist)
+{
+    unsigned n = 0;
+
+    for ( TcpSegmentNode* tsn = seglist.head; tsn; tsn = tsn->next, n++ )
+    {
+        if ( tsn->next and !SEQ_LT(tsn->seq, tsn->next->seq) )
+            return false;
+
+        if ( (tsn->prev ? tsn->prev->next : seglist.head) != tsn )
+            return false;
+    }
+    return n == seglist.count;
+}
+
+enum ReorderMode { RO_REVERSE, RO_ODD_EVEN, RO_RANDOM };
+
+// segment seqs in arrival order; starts just short of the wrap
+static std::vector<uint32_t> get_arrivals(ReorderMode mode)
+{
+    std::vector<uint32_t> seqs;
+    uint32_t isn = 0xffffffff - (REORDER_SEGS / 2) * REORDER_SEG_SIZE;
+
+    for ( unsigned i = 0; i < REORDER_SEGS; i++ )
+        seqs.push_back(isn + i * REORDER_SEG_SIZE);
+
+    switch ( mode )
+    {
+    case RO_REVERSE:
+        std::reverse(seqs.begin(), seqs.end());
+        break;
+
+    case RO_ODD_EVEN:
+        // every other segment lost then retransmitted
+        std::stable_partition(seqs.begin(), seqs.end(),
+            [isn](uint32_t seq) { return ((seq - isn) / REORDER_SEG_SIZE) % 2; });
+        break;
+
+    case RO_RANDOM:
+        std::shuffle(seqs.begin(), seqs.end(), std::mt19937(REORDER_SEGS));
+        break;
+    }
+    return seqs;
+}
+
+static void replay(TcpSegmentList& seglist, const std::vector<uint32_t>& seqs)
+{
+    for ( auto seq : seqs )
+        insert_segment(seglist, new_segment(seq));
+}
+
+TEST_CASE("seglist index", "[stream_tcp]")
+{
+    TcpSegmentList seglist;
+
+    SECTION("reverse")
+    {
+        replay(seglist, get_arrivals(RO_REVERSE));
+    }
+    SECTION("odd even")
+    {
+        replay(seglist, get_arrivals(RO_ODD_EVEN));
+    }
+    SECTION("random")
+    {
+        replay(seglist, get_arrivals(RO_RANDOM));
+    }
+    CHECK(seglist.is_indexed());
+    CHECK(is_ordered(seglist));
+
+    // every position, including before the head and after the tail
+    TcpSegmentNode* prev = nullptr;
+
+    for ( TcpSegmentNode* tsn = seglist.head; tsn; tsn = tsn->next )
+    {
+        CHECK(seglist.find_left(tsn->seq) == prev);
+        CHECK(seglist.find_left(tsn->seq + 1) == tsn);
+        prev = tsn;
+    }
+    CHECK(seglist.find_left(seglist.tail->seq + REORDER_SEG_SIZE) == seglist.tail);
+
+    // drain from the middle out, the way overlaps and flushes remove
+    while ( seglist.count > 1 )
+    {
+        TcpSegmentNode* tsn = seglist.head;
+
+        for ( unsigned i = 0; i < seglist.count / 2; i++ )
+            tsn = tsn->next;
+
+        seglist.remove(tsn);
+        tsn->term();
+
+        if ( seglist.is_indexed() )
+            CHECK(seglist.find_left(seglist.tail->seq) == seglist.tail->prev);
+    }
+    CHECK(!seglist.is_indexed());
+    CHECK(is_ordered(seglist));
+
+    CHECK(seglist.reset() == 1);
+}
+
+TEST_CASE("seglist reorder benchmark", "[.][stream_tcp][benchmark]")
+{
+    TcpSegmentList seglist;
+    unsigned index_min = TcpSegmentList::index_min;
+
+    const std::vector<uint32_t> random = get_arrivals(RO_RANDOM);
+    const std::vector<uint32_t> odd_even = get_arrivals(RO_ODD_EVEN);
+
+    TcpSegmentList::index_min = UINT_MAX;
+
+    BENCHMARK("list random")
+    {
+        replay(seglist, random);
+        seglist.reset();
+    }
+    BENCHMARK("list odd even")
+    {
+        replay(seglist, odd_even);
+        seglist.reset();
+    }
+
+    TcpSegmentList::index_min = index_min;
+
+    BENCHMARK("index random")
+    {
+        replay(seglist, random);
+        seglist.reset();
+    }
+    BENCHMARK("index odd even")
+    {
+        replay(seglist, odd_even);
+        seglist.reset();
+    }
+}
+
+#endif
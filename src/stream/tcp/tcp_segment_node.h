@@ -63,8 +63,20 @@ struct TcpSegmentNode
     uint16_t urg_offset;
 
     bool buffered;
+    uint8_t level;          // number of skip levels above the list
+
+    TcpSegmentNode** skip;  // next node at each skip level
 };
 
+//-----------------------------------------------------------------
+// segments are kept on a doubly linked list in seq order.  once the
+// list gets long a skip list index is added over it so the insertion
+// point for an out of order segment is found in O(log n) instead of by
+// walking the list.  the index is dropped again when the list drains.
+//-----------------------------------------------------------------
+
+struct TcpSegmentIndex;
+
 class TcpSegmentList
 {
 public:
@@ -72,6 +84,9 @@ public:
     {
         int i = 0;
 
+        if ( index )
+            drop_index();
+
         while ( head )
         {
             i++;
@@ -110,10 +125,19 @@ public:
         }
 
         count++;
+
+        if ( index )
+            index_insert(ss);
+
+        else if ( count >= index_min )
+            build_index();
     }
 
     void remove(TcpSegmentNode* ss)
     {
+        if ( index )
+            index_remove(ss);
+
         if (ss->prev)
             ss->prev->next = ss->next;
         else
@@ -125,8 +149,22 @@ public:
             tail = ss->prev;
 
         count--;
+
+        if ( index and count < index_min / 2 )
+            drop_index();
     }
 
+    bool is_indexed() const
+    { return index != nullptr; }
+
+    // last segment with seq before the given seq, nullptr if none;
+    // only valid when indexed
+    TcpSegmentNode* find_left(uint32_t seq)
+    { return index_find(seq, nullptr); }
+
+    // segment count at which the index is built
+    static unsigned index_min;
+
     TcpSegmentNode* head = nullptr;
     TcpSegmentNode* tail = nullptr;
 
@@ -136,6 +174,15 @@ public:
     // up to date.
     TcpSegmentNode* next = nullptr;
     uint32_t count = 0;
+
+private:
+    void build_index();
+    void drop_index();
+    void index_insert(TcpSegmentNode*);
+    void index_remove(TcpSegmentNode*);
+    TcpSegmentNode* index_find(uint32_t seq, TcpSegmentNode** pred);
+
+    TcpSegmentIndex* index = nullptr;
 };
 
 #endif